@@ -28,7 +28,11 @@
 #ifndef SANDBOX_LKUCHENB_APPS_IMSEQ_BARCODE_CORRECTION_H
 #define SANDBOX_LKUCHENB_APPS_IMSEQ_BARCODE_CORRECTION_H
 
+#include <algorithm>
+#include <limits>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #include <seqan/sequence.h>
 
@@ -36,6 +40,7 @@
 #include "fastq_io_types.h"
 #include "fastq_multi_record_types.h"
 #include "fastq_multi_record.h"
+#include "sequence_kernels.h"
 #include "thread_pool.h"
 
 using namespace seqan;
@@ -57,9 +62,11 @@ bool hammingDistAtMost(TSequence const & seqA, TSequence const & seqB, unsigned
 }
 
 /**
- * Compute the error rate of two sequences using a global Myers Bit Vector
- * algorithm implementation to compute the Levenshtein distance and derive the
- * error rate from that
+ * Compute the error rate of two sequences using a banded global Myers Bit
+ * Vector algorithm implementation to compute the Levenshtein distance and
+ * derive the error rate from that. The distance is only computed exactly up
+ * to one error above the floored maximum, to keep the rate comparison
+ * identical to an unbounded computation.
  */
 template<typename TSequence>
 bool belowErrRate(TSequence const & seqA, TSequence const & seqB, double const  maxErrRate)
@@ -69,8 +76,8 @@ bool belowErrRate(TSequence const & seqA, TSequence const & seqB, double const
     int lenDiff    = length(seqA) > length(seqB) ? length(seqA) - length(seqB) : length(seqB) - length(seqA);
     if (lenDiff > maxErrors)
         return false;
-    int score      = globalAlignmentScore(seqA, seqB, MyersBitVector());
-    double errRate = static_cast<double>(-score) / static_cast<double>(seqLength);
+    unsigned dist  = boundedEditDistance(seqA, seqB, maxErrors + 1);
+    double errRate = static_cast<double>(dist) / static_cast<double>(seqLength);
     return errRate <= maxErrRate;
 }
 
@@ -98,86 +105,172 @@ inline bool withinClusteringSpecs(FastqMultiRecord<PairedEnd> const & recA,
         belowErrRate(recA.revSeq, recB.revSeq, maxErrRate);
 }
 
-/// Mutex to be used in compareOneRead() when writing results
-static std::mutex compareOneRead_result_write;
+/**
+ * Pigeonhole index over the barcodes of a list of records. Every barcode is
+ * split into nParts = bcDelta + 1 parts, such that two barcodes within a
+ * Hamming distance of bcDelta share at least one identical part. For every
+ * part, the index maps the part sequence to the ascending list positions of
+ * the records carrying it.
+ */
+struct BarcodePartIndex {
+    typedef std::unordered_map<uint64_t, std::vector<uint32_t> > TPartMap;
+
+    unsigned nParts;
+    std::vector<TPartMap> parts;
+};
+
+/**
+ * Key of a barcode part, combining the barcode length and the part sequence.
+ * Colliding keys only lead to additional candidates.
+ */
+inline uint64_t _barcodePartKey(PackedDna5String const & bcSeq, unsigned const part, unsigned const nParts)
+{
+    size_t const len = length(bcSeq);
+    uint64_t key = len;
+    for (size_t pos = part * len / nParts; pos < (part + 1) * len / nParts; ++pos)
+        key = key * 5 + ordValue(value(bcSeq, pos));
+    return key;
+}
+
+template<typename TMRec>
+void buildBarcodePartIndex(BarcodePartIndex & index, std::vector<TMRec*> const & recPtrs, unsigned const bcDelta)
+{
+    index.nParts = bcDelta + 1;
+    index.parts.assign(index.nParts, BarcodePartIndex::TPartMap());
+    for (size_t i = 0; i < recPtrs.size(); ++i)
+        for (unsigned part = 0; part < index.nParts; ++part)
+            index.parts[part][_barcodePartKey(recPtrs[i]->bcSeq, part, index.nParts)].push_back(i);
+}
+
+/// Marks records without a merge target in barcodeCorrection()
+static size_t const NO_MERGE_TARGET = std::numeric_limits<size_t>::max();
+
+/// Number of records per parallelFor() task in barcodeCorrection(). The
+/// progress of the comparison is reported once per chunk of this size.
+static size_t const BARCODE_CORRECTION_GRAIN = 64;
 
 /**
   * Compare one read (pair) against more abundant ones for BC clustering.
   *
-  * Compares one read (pair) (reference record) to every more abundant read
-  * (pair) (target record) from the most frequent to the least frequent, until
-  * it finds a target record to join the reference record with. If a reference
-  * record is found, the method stores this in the passed clusterTodo vector
-  * and returns. Otherwise the clusterTodo object remains unmodified.
+  * Compares one read (pair) (reference record) to the more abundant reads
+  * (pairs) (target records) from the most frequent to the least frequent,
+  * until it finds a target record to join the reference record with. Only
+  * target records that share a barcode part with the reference record
+  * according to the BarcodePartIndex are considered, all others exceed the
+  * barcode distance. If a target record is found, the method stores its index
+  * at the reference index of mergeTargets and returns. Otherwise mergeTargets
+  * remains unmodified. Every call writes a different element, no locking is
+  * required.
   *
-  * @param clusterTodo The to-cluster pairs vector to store a result in.
-  * @param recs The underlying sequence records.
-  * @param sortedIndices The recs indices sorted from the least to the most abundant record.
-  * @param refIndex The sortedIndices index that contains the index of the reference record.
+  * @param mergeTargets The merge target per sortedRecPtrs index.
+  * @param sortedRecPtrs The records sorted from the least to the most abundant record.
+  * @param bcIndex The BarcodePartIndex over sortedRecPtrs.
+  * @param refIndex The sortedRecPtrs index of the reference record.
   * @param bcDelta The maximum hamming distance of two barcodes to trigger a join
   * @param seqErrRate The maximum pairwise sequence error rate for reads to be joined
   * @param maxRatio The maximum ratio refRecord / tarRecord to allow a join
   */
 template<typename TSequencingSpec>
 void compareOneRead(
-        std::vector<std::pair<size_t,size_t> > & clusterTodo,
+        std::vector<size_t> & mergeTargets,
         std::vector<FastqMultiRecord<TSequencingSpec>*> const & sortedRecPtrs,
+        BarcodePartIndex const & bcIndex,
         size_t const refIndex,
         short const bcDelta,
         double const seqErrRate,
-        double const maxRatio,
-        ProgressBar & progBar)
+        double const maxRatio)
 {
     typedef FastqMultiRecord<TSequencingSpec> TMRec;
-    std::vector<std::pair<size_t,size_t> > res;
+    typedef std::vector<uint32_t>::const_iterator TPosIt;
 
     TMRec const & refRec = * sortedRecPtrs[refIndex];
-    uint64_t cnt = 0;
-    for (size_t tarIndex = length(sortedRecPtrs)-1; tarIndex > refIndex; --tarIndex)
+
+    // The candidate positions above refIndex, per barcode part. The candidates
+    // are taken from the back of the ranges.
+    std::vector<std::pair<TPosIt, TPosIt> > candidates;
+    for (unsigned part = 0; part < bcIndex.nParts; ++part)
+    {
+        BarcodePartIndex::TPartMap::const_iterator it = bcIndex.parts[part].find(_barcodePartKey(refRec.bcSeq, part, bcIndex.nParts));
+        if (it == bcIndex.parts[part].end())
+            throw std::runtime_error("compareOneRead(...)[E001]");
+        std::vector<uint32_t> const & positions = it->second;
+        candidates.push_back(std::make_pair(std::upper_bound(positions.begin(), positions.end(), refIndex), positions.end()));
+    }
+
+    while (true)
     {
+        // Next candidate in descending order
+        bool found = false;
+        size_t tarIndex = 0;
+        for (std::pair<TPosIt, TPosIt> const & range : candidates)
+            if (range.first != range.second && (!found || *(range.second - 1) > tarIndex))
+            {
+                tarIndex = *(range.second - 1);
+                found = true;
+            }
+        if (!found)
+            break;
+        for (std::pair<TPosIt, TPosIt> & range : candidates)
+            if (range.first != range.second && *(range.second - 1) == tarIndex)
+                --range.second;
+
         TMRec const & tarRec = * sortedRecPtrs[tarIndex];
         double ratio = static_cast<double>(refRec.ids.size()) / tarRec.ids.size();
-        uint64_t skipped = 0;
         // If the ratio is too high, we can stop looking at additional reads,
         // since we are iterating them in descending order
         if (ratio > maxRatio)
-            skipped = tarIndex - refIndex;
+            break;
         // If barcodes are too different, continue
-        else if (!hammingDistAtMost(refRec.bcSeq, tarRec.bcSeq, bcDelta))
-            ++cnt;
+        if (!hammingDistAtMost(refRec.bcSeq, tarRec.bcSeq, bcDelta))
+            continue;
         // Check if the read sequence(s) are similar within specs
-        else if (withinClusteringSpecs(refRec, tarRec, seqErrRate))
+        if (withinClusteringSpecs(refRec, tarRec, seqErrRate))
         {
-            res.push_back(std::pair<size_t,size_t>(refIndex, tarIndex));
-            skipped = tarIndex - refIndex;
+            mergeTargets[refIndex] = tarIndex;
+            break;
         }
+    }
+}
 
-        cnt += skipped;
-        if (cnt % 1234 == 0) {
-            progBar.updateAndPrint(cnt);
-            cnt=0;
-        }
-        if (skipped > 0)
-            break;
+/**
+ * Merges the records of one or more merge trees into their roots. refs holds
+ * the references of the trees in ascending order, such that every record is
+ * merged into its target only after all of its own references were merged
+ * into it. Read IDs that are already in a target are not added again, see
+ * mergeReadIds().
+ */
+template<typename TMRec>
+void mergeIntoTargets(
+        std::vector<TMRec*> const & sortedRecPtrs,
+        std::vector<size_t> const & mergeTargets,
+        std::vector<size_t>::const_iterator refsBegin,
+        std::vector<size_t>::const_iterator refsEnd)
+{
+    for (; refsBegin != refsEnd; ++refsBegin)
+    {
+        TMRec & refRec = * sortedRecPtrs[*refsBegin];
+        TMRec & tarRec = * sortedRecPtrs[mergeTargets[*refsBegin]];
+        mergeReadIds(tarRec.ids, refRec.ids);
+        refRec.ids.clear();
+        // Should be empty
+        tarRec.bcSeqHistory.insert(refRec.bcSeqHistory.begin(), refRec.bcSeqHistory.end());
     }
-    progBar.updateAndPrint(cnt);
-    // Store result
-    std::lock_guard<std::mutex> lock(compareOneRead_result_write);
-    clusterTodo.insert(clusterTodo.end(), res.begin(), res.end());
 }
 
 /**
  * Performs the barcode correction given a collection of
- * FastqMultiRecordCollection and the runtime options specified by the user
+ * FastqMultiRecordCollection and the runtime options specified by the user.
+ * The work is distributed on the passed shared thread pool, which is unused
+ * without multi-threading support.
  * @special Paired end
  */
 template<typename TSequencingSpec>
 void barcodeCorrection(FastqMultiRecordCollection<TSequencingSpec> & collection,
-        CdrOptions const & options)
+        CdrOptions const & options,
+        ThreadPool * threadPool)
 {
     typedef FastqMultiRecordCollection<TSequencingSpec> TColl;
     typedef typename TColl::TMRec                       TMRec;
-    typedef std::pair<size_t,size_t>                    TPair;
 
     std::cerr << "  |   Sorting unique reads by frequency" << std::endl;
 
@@ -192,45 +285,69 @@ void barcodeCorrection(FastqMultiRecordCollection<TSequencingSpec> & collection,
             return a->ids.size() < b->ids.size();
             });
 
-    // From least to most abundant
-    std::vector<TPair> todoPairs;
+    // Merge target per record, from least to most abundant
+    std::vector<size_t> mergeTargets(sortedRecPtrs.size(), NO_MERGE_TARGET);
+
+    BarcodePartIndex bcIndex;
+    buildBarcodePartIndex(bcIndex, sortedRecPtrs, options.barcodeMaxError);
 
     std::cerr << "  |   Pairwise UMI and read comparison" << std::endl;
-    ProgressBar progBar(std::cerr, (sortedRecPtrs.size()-1)*(sortedRecPtrs.size()-1)/2, 100, "      ");
+    ProgressBar progBar(std::cerr, sortedRecPtrs.size(), 100, "      ");
     progBar.print_progress();
 
-    { // Scope for ThreadPool which joins threads on destruct
-#ifdef __WITHCDR3THREADS__
-        ThreadPool threadPool(options.jobs);
-#endif
-        for (size_t i = 0; i < sortedRecPtrs.size(); ++i)
-        {
-#ifdef __WITHCDR3THREADS__
-            threadPool.enqueue<void>([i,&todoPairs,&collection,&sortedRecPtrs, &options, &progBar]()
-                    {
-#endif
-                    compareOneRead(todoPairs, sortedRecPtrs, i, options.barcodeMaxError, options.bcClustMaxErrRate, options.bcClustMaxFreqRate, progBar);
+    // Compare the records chunk wise, such that the shared progress bar is
+    // only updated once per chunk
+    size_t const nChunks = (sortedRecPtrs.size() + BARCODE_CORRECTION_GRAIN - 1) / BARCODE_CORRECTION_GRAIN;
+    auto compare = [&mergeTargets, &sortedRecPtrs, &bcIndex, &options, &progBar](size_t c)
+    {
+        size_t const chunkBegin = c * BARCODE_CORRECTION_GRAIN;
+        size_t const chunkEnd = std::min(chunkBegin + BARCODE_CORRECTION_GRAIN, sortedRecPtrs.size());
+        for (size_t i = chunkBegin; i < chunkEnd; ++i)
+            compareOneRead(mergeTargets, sortedRecPtrs, bcIndex, i, options.barcodeMaxError, options.bcClustMaxErrRate, options.bcClustMaxFreqRate);
+        progBar.updateAndPrint(chunkEnd - chunkBegin);
+    };
 #ifdef __WITHCDR3THREADS__
-                    });
+    threadPool->parallelFor(0, nChunks, 1, compare)->wait();
+#else
+    for (size_t c = 0; c < nChunks; ++c)
+        compare(c);
 #endif
-        }
-    } // End ThreadPool
 
     progBar.clear();
 
     std::cerr << "  |   Merging identified pairs of reads" << std::endl;
 
-    std::sort(todoPairs.begin(), todoPairs.end(), [](TPair const & a, TPair const & b) -> bool { return a.second < b.second; });
+    // The merge targets form a forest, targets are always located behind
+    // their references. Resolve the root of every record's merge tree.
+    std::vector<size_t> roots(sortedRecPtrs.size());
+    for (size_t i = sortedRecPtrs.size(); i-- > 0;)
+        roots[i] = mergeTargets[i] == NO_MERGE_TARGET ? i : roots[mergeTargets[i]];
+
+    // Group the references by tree, ascending within each tree. A record is
+    // thereby merged into its target only after its own references were
+    // merged into it, which resolves chains of merges.
+    std::vector<size_t> refs;
+    for (size_t i = 0; i < sortedRecPtrs.size(); ++i)
+        if (mergeTargets[i] != NO_MERGE_TARGET)
+            refs.push_back(i);
+    std::stable_sort(refs.begin(), refs.end(), [&roots](size_t a, size_t b) -> bool { return roots[a] < roots[b]; });
 
-    for (auto & todoPair : todoPairs)
+    // The trees are independent of each other and merged in parallel
+    std::vector<size_t> treeBegins;
+    for (size_t r = 0; r < refs.size(); ++r)
+        if (r == 0 || roots[refs[r]] != roots[refs[r - 1]])
+            treeBegins.push_back(r);
+    treeBegins.push_back(refs.size());
+    auto merge = [&treeBegins, &refs, &sortedRecPtrs, &mergeTargets](size_t t)
     {
-        TMRec & refRec = * sortedRecPtrs[todoPair.first];
-        TMRec & tarRec = * sortedRecPtrs[todoPair.second];
-        tarRec.ids.insert(refRec.ids.begin(), refRec.ids.end());
-        refRec.ids.clear();
-        // Should be empty
-        tarRec.bcSeqHistory.insert(refRec.bcSeqHistory.begin(), refRec.bcSeqHistory.end());
-    }
+        mergeIntoTargets(sortedRecPtrs, mergeTargets, refs.begin() + treeBegins[t], refs.begin() + treeBegins[t + 1]);
+    };
+#ifdef __WITHCDR3THREADS__
+    threadPool->parallelFor(0, treeBegins.size() - 1, BARCODE_CORRECTION_GRAIN, merge)->wait();
+#else
+    for (size_t t = 0; t + 1 < treeBegins.size(); ++t)
+        merge(t);
+#endif
 }
 
 #endif
@@ -0,0 +1,146 @@
+// ============================================================================
+// IMSEQ - An immunogenetic sequence analysis tool
+// (C) Charite, Universitaetsmedizin Berlin
+// Author: Leon Kuchenbecker
+// ============================================================================
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License version 2 as published by
+// the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+// ============================================================================
+
+// ============================================================================
+// HEADER FILE DESCRIPTION
+// ============================================================================
+// A monotonic per-thread arena for the short lived containers of the gene
+// segment analysis. Memory handed out by the arena is never freed
+// individually, the whole arena is rewound by processReads() once a block of
+// reads was analysed. The chunks backing the arena are kept, such that a
+// thread stops hitting the heap for these containers after its first blocks.
+// ============================================================================
+
+#ifndef IMSEQ_BLOCK_ARENA_H
+#define IMSEQ_BLOCK_ARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include <set>
+#include <map>
+#include <functional>
+
+#include "fixed_size_types.h"
+
+/**
+ * Monotonic allocator over a list of heap chunks. reset() invalidates all
+ * memory handed out before.
+ */
+class BlockArena {
+public:
+    static size_t const CHUNK_SIZE = 1 << 20;
+
+    // Counters, never reset
+    uint64_t nAllocations;      // Allocations served by the arena
+    uint64_t nBytes;            // Bytes served by the arena
+    uint64_t nChunks;           // Heap allocations made by the arena
+
+    BlockArena() : nAllocations(0), nBytes(0), nChunks(0), current(0), offset(0) {}
+
+    BlockArena(BlockArena const &) = delete;
+    BlockArena & operator=(BlockArena const &) = delete;
+
+    void * allocate(size_t const bytes, size_t const alignment)
+    {
+        ++nAllocations;
+        nBytes += bytes;
+        for (; current < chunks.size(); ++current, offset = 0)
+        {
+            size_t const begin = (offset + alignment - 1) / alignment * alignment;
+            if (begin + bytes <= chunkSizes[current])
+            {
+                offset = begin + bytes;
+                return chunks[current].get() + begin;
+            }
+        }
+        // No retained chunk left that is large enough
+        size_t const chunkSize = bytes + alignment > CHUNK_SIZE ? bytes + alignment : CHUNK_SIZE;
+        chunks.push_back(std::unique_ptr<char[]>(new char[chunkSize]));
+        chunkSizes.push_back(chunkSize);
+        ++nChunks;
+        current = chunks.size() - 1;
+        size_t const begin = (alignment - reinterpret_cast<uintptr_t>(chunks[current].get()) % alignment) % alignment;
+        offset = begin + bytes;
+        return chunks[current].get() + begin;
+    }
+
+    void reset()
+    {
+        current = 0;
+        offset = 0;
+    }
+
+private:
+    std::vector<std::unique_ptr<char[]> > chunks;
+    std::vector<size_t> chunkSizes;
+    size_t current;             // The chunk allocations are currently served from
+    size_t offset;              // The first unused byte in the current chunk
+};
+
+/**
+ * The arena of the calling thread
+ */
+inline BlockArena & threadBlockArena()
+{
+    static thread_local BlockArena arena;
+    return arena;
+}
+
+/**
+ * STL allocator serving from a BlockArena, by default the arena of the
+ * constructing thread. Deallocation is a no-op.
+ */
+template <typename T>
+struct ArenaAllocator {
+    typedef T value_type;
+
+    BlockArena * arena;
+
+    ArenaAllocator() : arena(&threadBlockArena()) {}
+
+    template <typename U>
+    ArenaAllocator(ArenaAllocator<U> const & other) : arena(other.arena) {}
+
+    T * allocate(size_t const n)
+    {
+        return static_cast<T *>(arena->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T *, size_t) {}
+};
+
+template <typename T, typename U>
+inline bool operator==(ArenaAllocator<T> const & a, ArenaAllocator<U> const & b)
+{
+    return a.arena == b.arena;
+}
+
+template <typename T, typename U>
+inline bool operator!=(ArenaAllocator<T> const & a, ArenaAllocator<U> const & b)
+{
+    return a.arena != b.arena;
+}
+
+/// Set of segment or SCF ids living in the arena of the current thread
+typedef std::set<unsigned, std::less<unsigned>, ArenaAllocator<unsigned> > TArenaIdSet;
+
+#endif
@@ -0,0 +1,164 @@
+// ============================================================================
+// IMSEQ - An immunogenetic sequence analysis tool
+// (C) Charite, Universitaetsmedizin Berlin
+// Author: Leon Kuchenbecker
+// ============================================================================
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License version 2 as published by
+// the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+// ============================================================================
+
+// ============================================================================
+// HEADER FILE DESCRIPTION
+// ============================================================================
+// A bounded, blocking multi-producer / multi-consumer queue used to connect
+// the stages of the input pipeline, and a window limiting how far the
+// stages may run ahead of the in-order consumer.
+// ============================================================================
+
+#ifndef IMSEQ_BOUNDED_QUEUE_H
+#define IMSEQ_BOUNDED_QUEUE_H
+
+#include "thread_check.h"
+
+#ifdef __WITHCDR3THREADS__
+
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+/**
+ * FIFO queue holding at most 'capacity' elements. push() blocks while the
+ * queue is full, pop() blocks while it is empty. Once close() was called,
+ * push() fails and pop() fails as soon as the remaining elements were
+ * consumed.
+ */
+template <typename TValue>
+class BoundedQueue {
+public:
+    BoundedQueue(size_t _capacity) : capacity(_capacity > 0 ? _capacity : 1), closed(false) {}
+
+    /**
+     * Appends a value to the queue. Returns false if the queue was closed.
+     */
+    bool push(TValue && val)
+    {
+        TUniqueLock lock(MUTEX_queue);
+        while (!closed && queue.size() >= capacity)
+            notFull.wait(lock);
+        if (closed)
+            return false;
+        queue.push_back(std::move(val));
+        lock.unlock();
+        notEmpty.notify_one();
+        return true;
+    }
+
+    /**
+     * Removes the first value from the queue. Returns false if the queue was
+     * closed and no values are left.
+     */
+    bool pop(TValue & val)
+    {
+        TUniqueLock lock(MUTEX_queue);
+        while (!closed && queue.empty())
+            notEmpty.wait(lock);
+        if (queue.empty())
+            return false;
+        val = std::move(queue.front());
+        queue.pop_front();
+        lock.unlock();
+        notFull.notify_one();
+        return true;
+    }
+
+    /**
+     * Closes the queue and wakes up all waiting producers and consumers.
+     */
+    void close()
+    {
+        {
+            TUniqueLock lock(MUTEX_queue);
+            closed = true;
+        }
+        notFull.notify_all();
+        notEmpty.notify_all();
+    }
+
+private:
+    std::deque<TValue>      queue;
+    size_t const            capacity;
+    bool                    closed;
+    std::mutex              MUTEX_queue;
+    std::condition_variable notFull, notEmpty;
+};
+
+/**
+ * Window of sequence numbers that may be in flight ahead of an in-order
+ * consumer. enter() blocks until the given number lies within
+ * [next, next + size), advance() moves the window by one once the consumer
+ * processed number 'next'. Once close() was called, enter() fails.
+ */
+class SequenceWindow {
+public:
+    SequenceWindow(uint64_t _size) : size(_size > 0 ? _size : 1), next(0), closed(false) {}
+
+    /**
+     * Waits until 'seqNo' lies within the window. Returns false if the
+     * window was closed.
+     */
+    bool enter(uint64_t const seqNo)
+    {
+        TUniqueLock lock(MUTEX_window);
+        while (!closed && seqNo >= next + size)
+            moved.wait(lock);
+        return !closed;
+    }
+
+    /**
+     * Moves the window by one
+     */
+    void advance()
+    {
+        {
+            TUniqueLock lock(MUTEX_window);
+            ++next;
+        }
+        moved.notify_all();
+    }
+
+    /**
+     * Closes the window and wakes up all waiting threads
+     */
+    void close()
+    {
+        {
+            TUniqueLock lock(MUTEX_window);
+            closed = true;
+        }
+        moved.notify_all();
+    }
+
+private:
+    uint64_t const          size;
+    uint64_t                next;
+    bool                    closed;
+    std::mutex              MUTEX_window;
+    std::condition_variable moved;
+};
+
+#endif // Multi-threading enabled
+
+#endif
@@ -80,6 +80,8 @@ inline void parseCommandLine(CdrOptions & options, String<std::string> & inFileP
 
     addUsageLine(parser, "-ref <segment reference> [\\fIOPTIONS\\fP] <VDJ reads>");
     addUsageLine(parser, "-ref <segment reference> [\\fIOPTIONS\\fP] <V reads> <VDJ reads>");
+    addUsageLine(parser, "-rfi <reference index> [\\fIOPTIONS\\fP] <VDJ reads>");
+    addUsageLine(parser, "index -ref <segment reference> [\\fIOPTIONS\\fP] <reference index>");
 
     addDescription(parser,
             "\\fBimseq\\fP is a tool for the analysis of T- and B-cell receptor chain sequences. It can be used "
@@ -100,9 +102,9 @@ inline void parseCommandLine(CdrOptions & options, String<std::string> & inFileP
     // Plenty of options
     // ============================================================================
 
-    addSection(parser, "The following switch must be specified");
+    addSection(parser, "Exactly one of the following switches must be specified");
     addOption(parser, ArgParseOption("ref", "reference", "FASTA file with gene segment reference sequences.", ArgParseArgument::INPUT_FILE ));
-    setRequired(parser, "ref");
+    addOption(parser, ArgParseOption("rfi", "ref-index", "Reference index file created using 'imseq index'.", ArgParseArgument::INPUT_FILE ));
     addSection(parser, "Output files. At least one of the following switches must be specified");
     addOption(parser, ArgParseOption("oa", "out-amino", "Output file path for translated clonotypes.", (ArgParseArgument::STRING)));
     addOption(parser, ArgParseOption("on", "out-nuc", "Output file path for untranslated clonotypes.", (ArgParseArgument::STRING)));
@@ -170,6 +172,9 @@ inline void parseCommandLine(CdrOptions & options, String<std::string> & inFileP
     setMinValue(parser, "vce", "0");
     addOption(parser, ArgParseOption("jce", "j-core-errors", "Maximum number of errors when matching the J core fragments. (Default: Match -ej).", ArgParseArgument::INTEGER));
     setMinValue(parser, "jce", "0");
+    addOption(parser, ArgParseOption("sf", "scf-filter", "Filter used to find candidate core fragment matches in the reads. 'kmer' looks up the reads in an exact k-mer table built from the core fragments.", ArgParseArgument::STRING));
+    setValidValues(parser, "sf", "kmer swift");
+    setDefaultValue(parser, "sf", "swift");
 
     //================================================================================
     // QUALITY CONTROL [Alignment score thresholds, q-score thresholds]
@@ -255,7 +260,9 @@ inline void parseCommandLine(CdrOptions & options, String<std::string> & inFileP
 #ifdef __WITHCDR3THREADS__
     addOption(parser, ArgParseOption("j", "jobs", "Number of parallel jobs (threads).", (ArgParseArgument::INTEGER)));
     setDefaultValue(parser, "j", OPT_JOBS_DEFAULT);
+    addOption(parser, ArgParseOption("pt", "pin-threads", "Pin the worker threads to CPUs. Only supported on Linux."));
 #endif
+    addOption(parser, ArgParseOption("ips", "input-pre-scan", "Read the input files once before processing them to determine their uncompressed size. Only affects the progress indicator."));
 
     //================================================================================
     // Other options
@@ -281,6 +288,11 @@ inline void parseCommandLine(CdrOptions & options, String<std::string> & inFileP
     // Check some conditions that cannot be specified with the ArgumentParser
     // ============================================================================
 
+    if (isSet(parser, "ref") == isSet(parser, "rfi")) {
+        std::cerr << "You have to specify exactly one of the following options: -ref, -rfi\n";
+        exit(1);
+    }
+
     if (!isSet(parser, "oa") && !isSet(parser, "on") && !isSet(parser, "o")) {
         std::cerr << "You have to specify at least one of the following options: -o, -oa, -on\n";
         exit(1);
@@ -315,6 +327,7 @@ inline void parseCommandLine(CdrOptions & options, String<std::string> & inFileP
     // ============================================================================
 
     getOptionValue(options.refFasta, parser, "ref");
+    getOptionValue(options.refIndexPath, parser, "rfi");
     getOptionValue(options.aminoOut, parser, "oa");
     if (options.aminoOut=="-") options.aminoOut = options.outFileBaseName + ".act";
     getOptionValue(options.nucOut, parser, "on");
@@ -378,6 +391,10 @@ inline void parseCommandLine(CdrOptions & options, String<std::string> & inFileP
     else
         options.vSCFLength = AUTO_TUNE;
 
+    std::string scfFilter;
+    getOptionValue(scfFilter, parser, "sf");
+    options.scfKmerFilter = scfFilter == "kmer";
+
     getOptionValue(options.qmin, parser, "mq");
     getOptionValue(options.barcodeMaxError, parser, "bse");
     getOptionValue(options.bcQmin, parser, "bmq");
@@ -412,8 +429,10 @@ inline void parseCommandLine(CdrOptions & options, String<std::string> & inFileP
     {
         options.jobs = std::thread::hardware_concurrency();
     }
+    options.pinThreads = isSet(parser, "pt");
 #endif
 //    setConditionalLog(parser, outFiles.clusterCLog, "cl");
+    options.inputPreScan = isSet(parser, "ips");
     options.outputAligments = isSet(parser, "pa");
     if (options.outputAligments)
         options.jobs = 1;
@@ -421,9 +440,59 @@ inline void parseCommandLine(CdrOptions & options, String<std::string> & inFileP
     options.vCrop = options.pairedEnd ? 0 : 150;
     options.jCrop = 150;
 
-    //TODO Does it make sense to make this configurable?
+    // Initial block size of the analysis stage, adapted at runtime
     options.maxBlockSize = 1000;
 
 }
 
+/**
+ * Parses the command line of the 'imseq index' mode, which writes a
+ * precompiled reference index file. Only the reference related options are
+ * accepted. If no V core fragment length is specified, the V SCFs are built
+ * at analysis time since they depend on the read lengths.
+ */
+inline void parseIndexCommandLine(CdrOptions & options, CharString & indexPath, const int argc, const char** argv) {
+
+    ArgumentParser parser("imseq index");
+    setVersion(parser, IMSEQ_VERSION::STRING);
+    setDate(parser, "August 2018");
+
+    addUsageLine(parser, "-ref <segment reference> [\\fIOPTIONS\\fP] <reference index>");
+
+    addDescription(parser,
+            "Prepares the gene segment reference sequences once and writes them to a reference index file "
+            "which can be passed to \\fBimseq\\fP using -rfi instead of -ref.");
+
+    addArgument(parser, ArgParseArgument(ArgParseArgument::OUTPUT_FILE, "<reference index>"));
+
+    addOption(parser, ArgParseOption("ref", "reference", "FASTA file with gene segment reference sequences.", ArgParseArgument::INPUT_FILE ));
+    setRequired(parser, "ref");
+
+    addSection(parser, "V/J segment alignment (Expert settings)");
+    addOption(parser, ArgParseOption("jcl", "j-core-length", "Length of the J core fragment.", ArgParseArgument::INTEGER));
+    setMinValue(parser, "jcl", "5");
+    setMaxValue(parser, "jcl", "45");
+    setDefaultValue(parser, "jcl", 12);
+    addOption(parser, ArgParseOption("jco", "j-core-offset", "Offset of the V core fragment.", ArgParseArgument::INTEGER));
+    setDefaultValue(parser, "jco", -6);
+    addOption(parser, ArgParseOption("vcl", "v-core-length", "Length of the V core fragment. Default: Select at analysis time based on minimum observed read length.", ArgParseArgument::INTEGER));
+    setMinValue(parser, "vcl", "5");
+    addOption(parser, ArgParseOption("vco", "v-core-offset", "Offset of the V core fragment.", ArgParseArgument::INTEGER));
+    setDefaultValue(parser, "vco", 0);
+
+    ArgumentParser::ParseResult res = parse(parser, argc, argv);
+    if (res != ArgumentParser::PARSE_OK)
+        exit(res == ArgumentParser::PARSE_ERROR);
+
+    getArgumentValue(indexPath, parser, 0);
+    getOptionValue(options.refFasta, parser, "ref");
+    getOptionValue(options.jSCFLength, parser, "jcl");
+    getOptionValue(options.jSCFOffset, parser, "jco");
+    getOptionValue(options.vSCFOffset, parser, "vco");
+    if (isSet(parser, "vcl"))
+        getOptionValue(options.vSCFLength, parser, "vcl");
+    else
+        options.vSCFLength = AUTO_TUNE;
+}
+
 #endif
@@ -106,6 +106,26 @@ inline uint64_t computeFileSize(std::string const & path) {
     return res;
 }
 
+/**
+ * Determines the uncompressed size of the input files by reading them once
+ * and switches the progress computation to approximated uncompressed record
+ * sizes. Only used if requested by the user, since it doubles the
+ * decompression work.
+ * @special Single end implementation
+ */
+inline void preScanInputSize(SeqInputStreams<SingleEnd> & inStreams) {
+    inStreams.totalInBytes = computeFileSize(inStreams.path);
+    inStreams.offsetProgress = false;
+}
+
+/**
+ * @special Paired end implementation
+ */
+inline void preScanInputSize(SeqInputStreams<PairedEnd> & inStreams) {
+    inStreams.totalInBytes = computeFileSize(inStreams.fwPath) + computeFileSize(inStreams.revPath);
+    inStreams.offsetProgress = false;
+}
+
 /**
  * Returns the longer sequence of a FastqRecord. Simply returns the sequence
  * for a single end record, the longer sequence of the two for a paired end
@@ -269,20 +289,8 @@ inline uint64_t approxSizeInBytes(FastqRecord<PairedEnd> const & rec) {
  * @special Paired end implementation
  */
 inline void readRecord(FastqRecord<PairedEnd> & fastqRecord, SeqInputStreams<PairedEnd> & inStreams) {
-    try {
-        readRecord(fastqRecord.id, fastqRecord.revSeq, inStreams.revStream);
-    } catch (IOError e) {
-        throw std::string("An I/O error occurred: ") + std::string(e.what());
-    } catch (ParseError e) {
-        throw std::string("Could not parse FASTQ file '") + inStreams.revPath + std::string("': ") + std::string(e.what());
-    }
-    try {
-        readRecord(fastqRecord.id, fastqRecord.fwSeq, inStreams.fwStream);
-    } catch (IOError e) {
-        throw std::string("An I/O error occurred: ") + std::string(e.what());
-    } catch (ParseError e) {
-        throw std::string("Could not parse FASTQ file '") + inStreams.fwPath + std::string("': ") + std::string(e.what());
-    }
+    readInputRecord(fastqRecord.id, fastqRecord.revSeq, inStreams.revStream, inStreams.revRawStream, inStreams.revPath);
+    readInputRecord(fastqRecord.id, fastqRecord.fwSeq, inStreams.fwStream, inStreams.fwRawStream, inStreams.fwPath);
 }
 
 /**
@@ -290,13 +298,7 @@ inline void readRecord(FastqRecord<PairedEnd> & fastqRecord, SeqInputStreams<Pai
  * @special Single end implementation
  */
 inline void readRecord(FastqRecord<SingleEnd> & fastqRecord, SeqInputStreams<SingleEnd> & inStreams) {
-    try {
-        readRecord(fastqRecord.id, fastqRecord.seq, inStreams.stream);
-    } catch (IOError e) {
-        throw std::string("An I/O error occurred: ") + std::string(e.what());
-    } catch (ParseError e) {
-        throw std::string("Could not parse FASTQ file '") + inStreams.path + std::string("': ") + std::string(e.what());
-    }
+    readInputRecord(fastqRecord.id, fastqRecord.seq, inStreams.stream, inStreams.rawStream, inStreams.path);
 }
 
 /**
@@ -313,8 +315,7 @@ inline bool readRecord(FastqRecord<SingleEnd> & fastqRecord, SeqInputStreams<Sin
  * @special Paired end implementation
  */
 inline bool readRecord(FastqRecord<PairedEnd> & fastqRecord, SeqInputStreams<PairedEnd> & inStreams, bool const barcodeVDJRead, unsigned const barcodeLength) {
-    readRecord(fastqRecord.id, fastqRecord.revSeq, inStreams.revStream);
-    readRecord(fastqRecord.id, fastqRecord.fwSeq, inStreams.fwStream);
+    readRecord(fastqRecord, inStreams);
     return splitBarcodeSeq(fastqRecord, barcodeVDJRead, barcodeLength);
 }
 
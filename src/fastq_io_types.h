@@ -29,11 +29,16 @@
 #define IMSEQ_FASTQ_IO_TYPES_H
 
 #include <string>
+#include <fstream>
+#include <cctype>
+#include <cstring>
+#include <sys/stat.h>
 
 #include <seqan/basic.h>
 #include <seqan/sequence.h>
 #include <seqan/seq_io.h>
 
+#include "gzip_input.h"
 #include "sequence_data_types.h"
 
 /********************************************************************************
@@ -80,18 +85,119 @@ struct FastqRecord<SingleEnd> {
     }
 };
 
-inline void openOrExit(SeqFileIn & stream, std::string const & path)
+/**
+ * Opens a sequence file on top of an InputFile. The InputFile decompresses
+ * gzip compressed input ahead of the parser and tracks the position within
+ * the input file.
+ */
+inline void openOrExit(SeqFileIn & stream, InputFile & rawStream, std::string const & path, unsigned const threads, ThreadPool * pool)
 {
-    if (!open(stream, path.c_str())) {
+    if (!rawStream.open(path, threads, pool) || (rawStream.mappedFastq() == NULL && !open(stream, rawStream.stream()))) {
         std::cerr << "[ERROR] Cannot open '" << path << "'" << std::endl;
         std::exit(1);
     }
 }
 
+/**
+ * Rewinds a sequence file opened with openOrExit() to the beginning of the
+ * input file.
+ */
+inline void reopenOrExit(SeqFileIn & stream, InputFile & rawStream, std::string const & path)
+{
+    if (rawStream.mappedFastq() == NULL)
+        close(stream);
+    if (!rawStream.reopen() || (rawStream.mappedFastq() == NULL && !open(stream, rawStream.stream()))) {
+        std::cerr << "[ERROR] Cannot open '" << path << "'" << std::endl;
+        std::exit(1);
+    }
+}
+
+/**
+ * Returns the size of a file on disk, 0 if it cannot be determined
+ */
+inline uint64_t fileSizeOnDisk(std::string const & path)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0)
+        return 0;
+    return st.st_size;
+}
+
+/**
+ * Checks whether an input file opened with openOrExit() is exhausted
+ */
+inline bool inputAtEnd(SeqFileIn const & stream, InputFile const & rawStream)
+{
+    if (rawStream.mappedFastq() != NULL)
+        return rawStream.mappedFastq()->atEnd();
+    return atEnd(stream);
+}
+
+/**
+ * Converts a FastqRecordView into an ID and a sequence with quality values
+ */
+inline void materializeRecord(CharString & id, String<Dna5Q> & seq, FastqRecordView const & view, std::string const & path)
+{
+    resize(id, view.idLength);
+    if (view.idLength > 0)
+        std::memcpy(&id[0], view.id, view.idLength);
+
+    resize(seq, view.length);
+    char const * s = view.seq;
+    char const * q = view.qual;
+    for (size_t i = 0; i < view.length; ++i, ++s, ++q) {
+        while (s != view.seqEnd && std::isspace(static_cast<unsigned char>(*s)))
+            ++s;
+        while (q != view.qualEnd && std::isspace(static_cast<unsigned char>(*q)))
+            ++q;
+        if (s == view.seqEnd || q == view.qualEnd)
+            throw std::string("Could not parse FASTQ file '") + path + std::string("': Truncated record");
+        if (!std::isalpha(static_cast<unsigned char>(*s)))
+            throw std::string("Could not parse FASTQ file '") + path + std::string("': Invalid character in sequence");
+        Dna5Q base = Dna5(*s);
+        assignQualityValue(base, *q);
+        seq[i] = base;
+    }
+}
+
+/**
+ * Read a single sequence from an input file opened with openOrExit()
+ */
+inline void readInputRecord(CharString & id, String<Dna5Q> & seq, SeqFileIn & stream, InputFile & rawStream, std::string const & path) {
+    if (FastqMmapReader * mapped = rawStream.mappedFastq()) {
+        FastqRecordView view;
+        mapped->readRecord(view);
+        materializeRecord(id, seq, view, path);
+        return;
+    }
+    try {
+        readRecord(id, seq, stream);
+    } catch (IOError e) {
+        throw std::string("An I/O error occurred: ") + std::string(e.what());
+    } catch (ParseError e) {
+        throw std::string("Could not parse FASTQ file '") + path + std::string("': ") + std::string(e.what());
+    }
+}
+
+/**
+ * Returns the current read position within a raw input file
+ */
+inline uint64_t rawStreamPosition(InputFile & rawStream)
+{
+    return rawStream.position();
+}
+
 /**
  * SeqInputStreams can hold either one or two paths to sequence files and the
  * corresponding SeqFileIn objects. Upon construction with given path(s) it
- * opens the streams.
+ * opens the streams. Uncompressed FASTQ files are memory mapped instead, the
+ * SeqFileIn objects are not opened in that case.
+ *
+ * By default, the progress of reading the input is measured as the position
+ * within the (compressed) input files relative to their size on disk, such
+ * that the input has to be read only once. If 'offsetProgress' is false,
+ * 'totalInBytes' holds the uncompressed input size determined by a pre-scan,
+ * see preScanInputSize().
  */
 template<typename TSequencingType>
 struct SeqInputStreams {};
@@ -102,13 +208,13 @@ struct SeqInputStreams {};
 template<>
 struct SeqInputStreams<SingleEnd> {
     std::string path;
+    InputFile rawStream;
     SeqFileIn stream;
     uint64_t totalInBytes;
-    SeqInputStreams<SingleEnd>(std::string path_) : path(path_), totalInBytes(0) {
-        openOrExit(stream, path.c_str());
-    }
-    SeqInputStreams<SingleEnd>(std::string path_, uint64_t totalInBytes_) : path(path_), totalInBytes(totalInBytes_) {
-        openOrExit(stream, path.c_str());
+    bool offsetProgress;
+    SeqInputStreams<SingleEnd>(std::string path_, unsigned threads = 1, ThreadPool * pool = NULL) : path(path_), totalInBytes(0), offsetProgress(true) {
+        openOrExit(stream, rawStream, path, threads, pool);
+        totalInBytes = fileSizeOnDisk(path);
     }
 };
 
@@ -118,16 +224,32 @@ struct SeqInputStreams<SingleEnd> {
 template<>
 struct SeqInputStreams<PairedEnd> {
     std::string fwPath, revPath;
+    InputFile fwRawStream, revRawStream;
     SeqFileIn fwStream, revStream;
     uint64_t totalInBytes;
-    SeqInputStreams<PairedEnd>(std::string fwPath_, std::string revPath_) : fwPath(fwPath_), revPath(revPath_), totalInBytes(0) {
-        openOrExit(fwStream,fwPath.c_str());
-        openOrExit(revStream,revPath.c_str());
-    }
-    SeqInputStreams<PairedEnd>(std::string fwPath_, std::string revPath_, uint64_t totalInBytes_) : fwPath(fwPath_), revPath(revPath_), totalInBytes(totalInBytes_) {
-        openOrExit(fwStream,fwPath.c_str());
-        openOrExit(revStream,revPath.c_str());
+    bool offsetProgress;
+    SeqInputStreams<PairedEnd>(std::string fwPath_, std::string revPath_, unsigned threads = 1, ThreadPool * pool = NULL) : fwPath(fwPath_), revPath(revPath_), totalInBytes(0), offsetProgress(true) {
+        openOrExit(fwStream, fwRawStream, fwPath, threads, pool);
+        openOrExit(revStream, revRawStream, revPath, threads, pool);
+        totalInBytes = fileSizeOnDisk(fwPath) + fileSizeOnDisk(revPath);
     }
 };
 
+/**
+ * Returns the number of bytes of the input files that were consumed so far
+ * @special Single end implementation
+ */
+inline uint64_t consumedInBytes(SeqInputStreams<SingleEnd> & inStreams)
+{
+    return rawStreamPosition(inStreams.rawStream);
+}
+
+/**
+ * @special Paired end implementation
+ */
+inline uint64_t consumedInBytes(SeqInputStreams<PairedEnd> & inStreams)
+{
+    return rawStreamPosition(inStreams.fwRawStream) + rawStreamPosition(inStreams.revRawStream);
+}
+
 #endif
@@ -0,0 +1,233 @@
+// ============================================================================
+// IMSEQ - An immunogenetic sequence analysis tool
+// (C) Charite, Universitaetsmedizin Berlin
+// Author: Leon Kuchenbecker
+// ============================================================================
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License version 2 as published by
+// the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+// ============================================================================
+
+#include "fastq_mmap.h"
+
+#include <cstring>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define IMSEQ_WITH_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// ============================================================================
+// Functions
+// ============================================================================
+
+static bool _isSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+/**
+ * Counts the non-whitespace characters in a range
+ */
+static size_t _countNonSpace(char const * begin, char const * end)
+{
+    size_t n = 0;
+    for (; begin != end; ++begin)
+        if (!_isSpace(*begin))
+            ++n;
+    return n;
+}
+
+// ============================================================================
+// FastqMmapReader
+// ============================================================================
+
+FastqMmapReader::FastqMmapReader() : data(NULL), size(0), pos(0) {}
+
+FastqMmapReader::~FastqMmapReader()
+{
+    close();
+}
+
+/**
+ * Maps a file. Returns false if the file cannot be mapped or does not look
+ * like an uncompressed FASTQ file, i.e. does not start with '@'.
+ */
+bool FastqMmapReader::open(std::string const & _path)
+{
+    close();
+#ifdef IMSEQ_WITH_MMAP
+    int fd = ::open(_path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+    void * mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED)
+        return false;
+    madvise(mapping, st.st_size, MADV_SEQUENTIAL);
+
+    data = static_cast<char const *>(mapping);
+    size = st.st_size;
+    pos  = 0;
+    path = _path;
+    size_t first = skipWhitespace(0);
+    if (first == size || data[first] != '@') {
+        close();
+        return false;
+    }
+    return true;
+#else
+    (void) _path;
+    return false;
+#endif
+}
+
+void FastqMmapReader::close()
+{
+#ifdef IMSEQ_WITH_MMAP
+    if (data != NULL)
+        munmap(const_cast<char *>(data), size);
+#endif
+    data = NULL;
+    size = 0;
+    pos  = 0;
+}
+
+bool FastqMmapReader::isOpen() const
+{
+    return data != NULL;
+}
+
+bool FastqMmapReader::atEnd() const
+{
+    return skipWhitespace(pos) == size;
+}
+
+void FastqMmapReader::rewind()
+{
+    pos = 0;
+}
+
+/**
+ * Returns the number of bytes of the file consumed so far
+ */
+uint64_t FastqMmapReader::position() const
+{
+    return pos;
+}
+
+std::string const & FastqMmapReader::filePath() const
+{
+    return path;
+}
+
+void FastqMmapReader::parseError(std::string const & message) const
+{
+    throw std::string("Could not parse FASTQ file '") + path + std::string("': ") + message;
+}
+
+size_t FastqMmapReader::skipWhitespace(size_t p) const
+{
+    while (p < size && _isSpace(data[p]))
+        ++p;
+    return p;
+}
+
+/**
+ * Returns a pointer to the line break terminating the line containing
+ * position p or to the end of the mapping.
+ */
+char const * FastqMmapReader::lineEnd(size_t p) const
+{
+    char const * end = static_cast<char const *>(std::memchr(data + p, '\n', size - p));
+    return end != NULL ? end : data + size;
+}
+
+/**
+ * Locates the next record. For the common four line layout this only
+ * searches for four line breaks, records spanning multiple sequence and
+ * quality lines are supported as well.
+ */
+void FastqMmapReader::readRecord(FastqRecordView & view)
+{
+    pos = skipWhitespace(pos);
+    if (pos == size)
+        parseError("Unexpected end of file");
+    if (data[pos] != '@')
+        parseError("Expected '@' at the beginning of a record");
+
+    // Identifier line
+    char const * end = lineEnd(pos);
+    view.id = data + pos + 1;
+    view.idLength = end - view.id;
+    if (view.idLength > 0 && view.id[view.idLength - 1] == '\r')
+        --view.idLength;
+    pos = end - data + 1;
+
+    // Sequence line(s), up to the '+' separator line
+    view.seq = data + pos;
+    size_t nLines = 0;
+    while (true) {
+        if (pos >= size)
+            parseError("Unexpected end of file");
+        if (data[pos] == '+')
+            break;
+        pos = lineEnd(pos) - data + 1;
+        ++nLines;
+    }
+    view.seqEnd = data + pos;
+    if (nLines == 1) {
+        char const * seqEnd = view.seqEnd - 1;
+        if (seqEnd > view.seq && seqEnd[-1] == '\r')
+            --seqEnd;
+        view.length = seqEnd - view.seq;
+    } else {
+        view.length = _countNonSpace(view.seq, view.seqEnd);
+    }
+    pos = lineEnd(pos) - data + 1;
+
+    // Quality line(s), until as many quality values as bases were read
+    view.qual = data + pos;
+    size_t nQual = 0;
+    if (view.length > 0 && pos < size) {
+        char const * end = lineEnd(pos);
+        char const * qualEnd = end;
+        if (qualEnd > view.qual && qualEnd[-1] == '\r')
+            --qualEnd;
+        if (static_cast<size_t>(qualEnd - view.qual) == view.length) {
+            nQual = view.length;
+            pos = end - data + 1;
+        }
+    }
+    while (nQual < view.length) {
+        if (pos >= size)
+            parseError("Unexpected end of file");
+        char const * end = lineEnd(pos);
+        nQual += _countNonSpace(data + pos, end);
+        pos = end - data + 1;
+    }
+    if (pos > size)
+        pos = size;
+    view.qualEnd = data + pos;
+    if (nQual != view.length)
+        parseError("Number of quality values differs from the sequence length");
+}
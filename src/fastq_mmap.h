@@ -0,0 +1,95 @@
+// ============================================================================
+// IMSEQ - An immunogenetic sequence analysis tool
+// (C) Charite, Universitaetsmedizin Berlin
+// Author: Leon Kuchenbecker
+// ============================================================================
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License version 2 as published by
+// the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+// ============================================================================
+
+// ============================================================================
+// HEADER FILE DESCRIPTION
+// ============================================================================
+// Memory mapped reader for uncompressed FASTQ files.
+//
+// The reader only locates the record boundaries, using memchr() to find line
+// breaks, and hands out the records as views into the mapping. The sequence
+// and quality characters are converted later, see materializeRecord() in
+// fastq_io.h, which allows to do that in the worker threads of the input
+// pipeline rather than in the parser thread.
+// ============================================================================
+
+#ifndef IMSEQ_FASTQ_MMAP_H
+#define IMSEQ_FASTQ_MMAP_H
+
+#include <string>
+#include <cstddef>
+
+#include "fixed_size_types.h"
+
+// ============================================================================
+// Tags, Classes, Enums
+// ============================================================================
+
+/**
+ * A FASTQ record within a memory mapped file. The sequence and quality
+ * ranges may contain line breaks if the record spans multiple lines.
+ * 'length' is the number of bases of the record.
+ */
+struct FastqRecordView {
+    char const * id;
+    size_t       idLength;
+    char const * seq;
+    char const * seqEnd;
+    char const * qual;
+    char const * qualEnd;
+    size_t       length;
+
+    FastqRecordView() : id(NULL), idLength(0), seq(NULL), seqEnd(NULL), qual(NULL), qualEnd(NULL), length(0) {}
+};
+
+/**
+ * Reads the records of an uncompressed FASTQ file from a memory mapping.
+ * Parse errors are reported as std::string exceptions.
+ */
+class FastqMmapReader {
+
+    public:
+        FastqMmapReader();
+        ~FastqMmapReader();
+        bool open(std::string const & path);
+        void close();
+        bool isOpen() const;
+        bool atEnd() const;
+        void readRecord(FastqRecordView & view);
+        void rewind();
+        uint64_t position() const;
+        std::string const & filePath() const;
+
+    private:
+        FastqMmapReader(FastqMmapReader const &);
+        FastqMmapReader & operator=(FastqMmapReader const &);
+
+        void parseError(std::string const & message) const;
+        size_t skipWhitespace(size_t p) const;
+        char const * lineEnd(size_t p) const;
+
+        std::string path;
+        char const * data;
+        size_t size;
+        size_t pos;
+};
+
+#endif
@@ -27,8 +27,22 @@
 #ifndef IMSEQ_FASTQ_MULTI_RECORD_H
 #define IMSEQ_FASTQ_MULTI_RECORD_H
 
+#include <algorithm>
 #include <iterator>
+#include <limits>
 #include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include "thread_check.h"
+#ifdef __WITHCDR3THREADS__
+#include <atomic>
+#include <exception>
+#include <map>
+#include <memory>
+#include <thread>
+#include "bounded_queue.h"
+#endif
 
 #include "fastq_io_types.h"
 #include "fastq_multi_record_types.h"
@@ -58,160 +72,136 @@ inline std::string toString(FastqMultiRecord<PairedEnd> const & rec)
 }
 
 /**
- * Compact a FastqMultiRecordCollection, i.e. free all FastqMultiRecords that
- * have no members (ids is empty) and remove all mappings related to those.
- * @special Single end
+ * Returns the slot of the lookup table that refers to the record with the
+ * same sequences as the probe, or the empty slot where such a record would be
+ * inserted. The lookup table must not be empty.
  */
-inline void compact(FastqMultiRecordCollection<SingleEnd> & collection)
+template<typename TSequencingSpec>
+size_t _findSlot(FastqMultiRecordCollection<TSequencingSpec> const & collection,
+        FastqMultiRecord<TSequencingSpec> const & probe,
+        uint64_t const hash)
 {
-    typedef std::list<FastqMultiRecord<SingleEnd> >::iterator TListIt;
-    std::vector<FastqMultiRecord<SingleEnd>*> delPtrs;
-    std::vector<TListIt> delListIts;
-    // Collect list iterators pointing to empty FastqMultiRecords
-    for (TListIt listIt = collection.multiRecords.begin(); listIt != collection.multiRecords.end(); ++listIt)
-        if (listIt->ids.empty())
-            delListIts.push_back(listIt);
-    for (TListIt listIt : delListIts)
+    size_t const mask = collection.slots.size() - 1;
+    uint32_t const fingerprint = static_cast<uint32_t>(hash >> 32);
+    for (size_t slotIdx = hash & mask; ; slotIdx = (slotIdx + 1) & mask)
     {
-        FastqMultiRecord<SingleEnd> & rec = *listIt;
-        auto bcMapIt = collection.bcMap.find(listIt->bcSeq);
-        if (bcMapIt == collection.bcMap.end() || bcMapIt->second.erase(listIt->seq) != 1)
-            throw std::runtime_error("compact<SingleEnd>(...)[E001]");
-        if (bcMapIt->second.empty()) collection.bcMap.erase(bcMapIt);
-        collection.multiRecords.erase(listIt);
+        FastqMultiRecordSlot const & slot = collection.slots[slotIdx];
+        if (slot.recId == FastqMultiRecordSlot::EMPTY)
+            return slotIdx;
+        if (slot.fingerprint == fingerprint && sameSequences(collection.multiRecords[slot.recId], probe))
+            return slotIdx;
     }
 }
 
 /**
- * @special Paired end
+ * Number of lookup table slots required for a number of records, keeping the
+ * load factor at or below 3/4
  */
-inline void compact(FastqMultiRecordCollection<PairedEnd> & collection)
+inline size_t _requiredSlots(size_t const nRecords)
 {
-    typedef std::list<FastqMultiRecord<PairedEnd> >::iterator TListIt;
-    std::vector<FastqMultiRecord<PairedEnd>*> delPtrs;
-    std::vector<TListIt> delListIts;
-    // Collect list iterators pointing to empty FastqMultiRecords
-    for (TListIt listIt = collection.multiRecords.begin(); listIt != collection.multiRecords.end(); ++listIt)
-        if (listIt->ids.empty())
-            delListIts.push_back(listIt);
-    for (TListIt listIt : delListIts)
+    size_t nSlots = 16;
+    while (nSlots / 4 * 3 < nRecords)
+        nSlots *= 2;
+    return nSlots;
+}
+
+/**
+ * Rebuilds the lookup table of a FastqMultiRecordCollection with the given
+ * number of slots, which has to be a power of two
+ */
+template<typename TSequencingSpec>
+void _rebuildSlots(FastqMultiRecordCollection<TSequencingSpec> & collection, size_t const nSlots)
+{
+    collection.slots.assign(nSlots, FastqMultiRecordSlot());
+    size_t const mask = nSlots - 1;
+    for (size_t recId = 0; recId < collection.multiRecords.size(); ++recId)
     {
-        FastqMultiRecord<PairedEnd> & rec = *listIt;
-        auto bcMapIt = collection.bcMap.find(listIt->bcSeq);
-        if (bcMapIt == collection.bcMap.end())
-            throw std::runtime_error("compact<PairedEnd>(...)[E001]");
-        auto fwSeqMapIt = bcMapIt->second.find(listIt->fwSeq);
-        if (fwSeqMapIt == bcMapIt->second.end() || fwSeqMapIt->second.erase(listIt->revSeq) != 1)
-            throw std::runtime_error("compact<PairedEnd>(...)[E002]");
-        if (fwSeqMapIt->second.empty()) bcMapIt->second.erase(fwSeqMapIt);
-        if (bcMapIt->second.empty()) collection.bcMap.erase(bcMapIt);
-        collection.multiRecords.erase(listIt);
+        uint64_t const hash = hashSequences(collection.multiRecords[recId]);
+        size_t slotIdx = hash & mask;
+        while (collection.slots[slotIdx].recId != FastqMultiRecordSlot::EMPTY)
+            slotIdx = (slotIdx + 1) & mask;
+        collection.slots[slotIdx].recId = static_cast<uint32_t>(recId);
+        collection.slots[slotIdx].fingerprint = static_cast<uint32_t>(hash >> 32);
     }
 }
 
+/**
+ * Compact a FastqMultiRecordCollection, i.e. free all FastqMultiRecords that
+ * have no members (ids is empty) and remove all mappings related to those.
+ * The remaining records keep their order but are assigned new record ids.
+ */
+template<typename TSequencingSpec>
+void compact(FastqMultiRecordCollection<TSequencingSpec> & collection)
+{
+    typedef FastqMultiRecord<TSequencingSpec> TMRec;
+
+    collection.multiRecords.erase(std::remove_if(collection.multiRecords.begin(), collection.multiRecords.end(),
+                [](TMRec const & rec) -> bool { return rec.ids.empty(); }),
+            collection.multiRecords.end());
+    _rebuildSlots(collection, _requiredSlots(collection.multiRecords.size()));
+}
+
 /**
  * Make a FastqRecord from a FastqMultiRecord, with an empty ID and default qualities
  */
 inline FastqRecord<SingleEnd> toFastqRecordSkel(FastqMultiRecord<SingleEnd> const & mRec)
 {
     FastqRecord<SingleEnd> rec;
-    rec.seq    = mRec.seq;
-    rec.bcSeq  = mRec.bcSeq;
+    rec.seq = unpack(mRec.seq);
+    rec.bcSeq = unpack(mRec.bcSeq);
     return rec;
 }
 
 inline FastqRecord<PairedEnd> toFastqRecordSkel(FastqMultiRecord<PairedEnd> const & mRec)
 {
     FastqRecord<PairedEnd> rec;
-    rec.fwSeq  = mRec.fwSeq;
-    rec.revSeq = mRec.revSeq;
-    rec.bcSeq  = mRec.bcSeq;
+    rec.fwSeq = unpack(mRec.fwSeq);
+    rec.revSeq = unpack(mRec.revSeq);
+    rec.bcSeq = unpack(mRec.bcSeq);
     return rec;
 }
 
-template<typename TSequencingSpec>
-FastqMultiRecord<TSequencingSpec> & getMultiRecord(FastqMultiRecordCollection<TSequencingSpec> & coll, size_t const idx)
-{
-    SEQAN_CHECK(idx >= 0 && idx < coll.multiRecords.size(), "Please report this error.");
-    return coll.multiRecords[idx];
-}
-
-template<typename TSequencingSpec>
-FastqMultiRecord<TSequencingSpec> const & getMultiRecord(FastqMultiRecordCollection<TSequencingSpec> const & coll, size_t const idx)
-{
-    SEQAN_CHECK(idx >= 0 && idx < coll.multiRecords.size(), "Please report this error.");
-    return coll.multiRecords[idx];
-}
-
 /**
  * Clear all data from a FastqMultiRecordCollection
  */
-inline void clear(FastqMultiRecordCollection<SingleEnd> & coll) {
-    coll.multiRecords.clear();
-    coll.bcMap.clear();
-}
-
-inline void clear(FastqMultiRecordCollection<PairedEnd> & coll) {
+template<typename TSequencingSpec>
+void clear(FastqMultiRecordCollection<TSequencingSpec> & coll) {
     coll.multiRecords.clear();
-    coll.bcMap.clear();
-}
-
-template <typename TSequencingSpec>
-std::tuple<uint64_t, uint64_t> getBarcodeStatsHelper(std::unordered_map<typename FastqMultiRecord<TSequencingSpec>::TSequence, FastqMultiRecord<TSequencingSpec> *> const & map)
-{
-    uint64_t unique = 0;
-    uint64_t total = 0;
-    for (auto & elem : map)
-    {
-        uint64_t nIds = elem.second->ids.size();
-        if (nIds > 0)
-        {
-            ++unique;
-            total += nIds;
-        }
-    }
-    return std::make_tuple(unique, total);
-}
-
-template <typename TKey, typename TValue>
-std::tuple<uint64_t, uint64_t> getBarcodeStatsHelper(std::unordered_map<TKey, TValue> const & map)
-{
-    uint64_t unique = 0;
-    uint64_t total = 0;
-    for (auto & elem : map)
-    {
-        uint64_t _unique, _total;
-        std::tie(_unique, _total) =  getBarcodeStatsHelper(elem.second);
-        unique += _unique;
-        total += _total;
-    }
-    return std::make_tuple(unique, total);
+    coll.slots.clear();
+    clear(coll.seqStore);
+    clear(coll.readIds);
+    clear(coll.readIdTable);
+    coll.repeatedReadIds = false;
 }
 
 /**
- * Generates BarcodeStats given a FastqMultiRecordCollection
+ * Generates BarcodeStats given a FastqMultiRecordCollection. Barcodes are
+ * reported in the order of their first occurrence in the collection.
  *
  * @param coll The FastqMultiRecordCollection
  * @return The barcode usage stats
  */
 template <typename TSequencingSpec>
 BarcodeStats getBarcodeStats(FastqMultiRecordCollection<TSequencingSpec> const & coll) {
-    typedef typename FastqMultiRecordCollection<TSequencingSpec>::TBcMap TBcMap;
-    TBcMap const & bcMap = coll.bcMap;
     typedef FastqMultiRecord<TSequencingSpec> TMRec;
     BarcodeStats stats;
 
-    for (typename TBcMap::const_iterator bcIt = bcMap.begin(); bcIt != bcMap.end(); ++bcIt) {
-        uint64_t numUnique = 0;
-        uint64_t numTotal = 0;
-        std::tie(numUnique, numTotal) = getBarcodeStatsHelper(bcIt->second);
-        if (numUnique > 0) {
-            appendValue(stats.bcSeqs, bcIt->first);
-            appendValue(stats.nReads, numTotal);
-            appendValue(stats.nUniqueReads, numUnique);
-            stats.nTotalUniqueReads += numUnique;
-            stats.nTotalReads += numTotal;
+    std::unordered_map<PackedDna5String, size_t, PackedDna5StringHash> bcIndices;
+    for (TMRec const & rec : coll.multiRecords) {
+        uint64_t nIds = rec.ids.size();
+        if (nIds == 0)
+            continue;
+        auto inserted = bcIndices.insert(std::make_pair(rec.bcSeq, length(stats.bcSeqs)));
+        if (inserted.second) {
+            appendValue(stats.bcSeqs, unpack(rec.bcSeq));
+            appendValue(stats.nReads, static_cast<uint64_t>(0));
+            appendValue(stats.nUniqueReads, static_cast<uint64_t>(0));
         }
+        size_t const idx = inserted.first->second;
+        stats.nReads[idx] += nIds;
+        stats.nUniqueReads[idx] += 1;
+        stats.nTotalUniqueReads += 1;
+        stats.nTotalReads += nIds;
     }
 
     return stats;
@@ -231,187 +221,380 @@ inline void writeBarcodeStats(BarcodeStats const & bcStats, std::string const &
     ofs.close();
 }
 
+template <typename TSequencingSpec>
+uint64_t _findMultiRecordId(FastqMultiRecordCollection<TSequencingSpec> const & collection,
+        FastqMultiRecord<TSequencingSpec> const & probe,
+        uint64_t const hash)
+{
+    if (collection.slots.empty())
+        return FastqMultiRecordCollection<TSequencingSpec>::NO_MATCH;
+    uint32_t const recId = collection.slots[_findSlot(collection, probe, hash)].recId;
+    if (recId == FastqMultiRecordSlot::EMPTY)
+        return FastqMultiRecordCollection<TSequencingSpec>::NO_MATCH;
+    return recId;
+}
+
 /**
- * Returns the position of a FastqMultiRecord in a FastqMultiRecordCollection
- * given the sequences
+ * Returns the id of the FastqMultiRecord in a FastqMultiRecordCollection that
+ * has the same sequences as the passed record
  *
- * @returns Position of the corresponding FastqMultiRecord in the collection if
- *          there is a match, NO_MATCH otherwise.
- * @special Single end
+ * @returns Record id of the corresponding FastqMultiRecord in the collection
+ *          if there is a match, NO_MATCH otherwise.
  */
-inline FastqMultiRecord<SingleEnd>* getMultiRecordPtr(FastqMultiRecordCollection<SingleEnd> const & collection,
-        FastqRecord<SingleEnd>::TSequence const & bcSeq,
-        FastqRecord<SingleEnd>::TSequence const & seq)
+template <typename TSequencingSpec>
+uint64_t findMultiRecordId(FastqMultiRecordCollection<TSequencingSpec> const & collection,
+        FastqMultiRecord<TSequencingSpec> const & probe)
 {
-    typedef FastqMultiRecordCollection<SingleEnd> TColl;
-    typedef typename TColl::TMRec *               TPtr;
+    return _findMultiRecordId(collection, probe, hashSequences(probe));
+}
 
-    // Get the index sets for bc and seq
-    TColl::TBcMap::const_iterator bcMapIt = collection.bcMap.find(bcSeq);
-    if (bcMapIt == collection.bcMap.end())
-        return nullptr;
-    TColl::TSeqMap::const_iterator seqMapIt = bcMapIt->second.find(seq);
-    if (seqMapIt == bcMapIt->second.end())
+/**
+ * Returns a pointer to the FastqMultiRecord in a FastqMultiRecordCollection
+ * that has the same sequences as the passed record. The pointer is
+ * invalidated by subsequent insertions into the collection.
+ *
+ * @returns Pointer to the corresponding FastqMultiRecord in the collection if
+ *          there is a match, nullptr otherwise.
+ */
+template <typename TSequencingSpec>
+FastqMultiRecord<TSequencingSpec>* getMultiRecordPtr(FastqMultiRecordCollection<TSequencingSpec> & collection,
+        FastqMultiRecord<TSequencingSpec> const & probe)
+{
+    uint64_t const recId = findMultiRecordId(collection, probe);
+    if (recId == FastqMultiRecordCollection<TSequencingSpec>::NO_MATCH)
         return nullptr;
+    return &collection.multiRecords[recId];
+}
 
-    return seqMapIt->second;
+/**
+ * Creates a FastqMultiRecord holding only the packed sequences of a
+ * FastqRecord, which are allocated from the passed store
+ * @special Single end
+ */
+inline FastqMultiRecord<SingleEnd> packedSkeleton(FastqRecord<SingleEnd> const & record, PackedSequenceStore & store)
+{
+    FastqMultiRecord<SingleEnd> multiRecord;
+    assignPacked(multiRecord.bcSeq, record.bcSeq, store);
+    assignPacked(multiRecord.seq, record.seq, store);
+    return multiRecord;
 }
 
 /**
  * @special Paired end
  */
-inline FastqMultiRecord<PairedEnd>* getMultiRecordPtr(FastqMultiRecordCollection<PairedEnd> const & collection,
-        FastqRecord<PairedEnd>::TSequence const & bcSeq,
-        FastqRecord<PairedEnd>::TSequence const & fwSeq,
-        FastqRecord<PairedEnd>::TSequence const & revSeq)
+inline FastqMultiRecord<PairedEnd> packedSkeleton(FastqRecord<PairedEnd> const & record, PackedSequenceStore & store)
 {
-    typedef FastqMultiRecordCollection<PairedEnd> TColl;
-    typedef typename TColl::TMRec *               TPtr;
+    FastqMultiRecord<PairedEnd> multiRecord;
+    assignPacked(multiRecord.bcSeq, record.bcSeq, store);
+    assignPacked(multiRecord.fwSeq, record.fwSeq, store);
+    assignPacked(multiRecord.revSeq, record.revSeq, store);
+    return multiRecord;
+}
 
-    // Get the index sets for bc, fwSeq and revSeq
-    TColl::TBcMap::const_iterator bcMapIt = collection.bcMap.find(bcSeq);
-    if (bcMapIt == collection.bcMap.end())
-        return nullptr;
-    TColl::TFwSeqMap::const_iterator fwSeqMapIt = bcMapIt->second.find(fwSeq);
-    if (fwSeqMapIt == bcMapIt->second.end())
-        return nullptr;
-    TColl::TRevSeqMap::const_iterator revSeqMapIt = fwSeqMapIt->second.find(revSeq);
-    if (revSeqMapIt == fwSeqMapIt->second.end())
-        return nullptr;
+template <typename TSequencingSpec>
+uint64_t findMultiRecordId(FastqMultiRecordCollection<TSequencingSpec> const & collection,
+        FastqRecord<TSequencingSpec> const & rec) {
+    PackedSequenceStore probeStore;
+    return findMultiRecordId(collection, packedSkeleton(rec, probeStore));
+}
 
-    return revSeqMapIt->second;
+template <typename TSequencingSpec>
+FastqMultiRecord<TSequencingSpec>* getMultiRecordPtr(FastqMultiRecordCollection<TSequencingSpec> & collection,
+        FastqRecord<TSequencingSpec> const & rec) {
+    PackedSequenceStore probeStore;
+    return getMultiRecordPtr(collection, packedSkeleton(rec, probeStore));
 }
 
-inline FastqMultiRecord<SingleEnd>* getMultiRecordPtr(FastqMultiRecordCollection<SingleEnd> const & collection,
-        FastqRecord<SingleEnd> const & rec) {
-    return getMultiRecordPtr(collection, rec.bcSeq, rec.seq);
+// Number of reads whose quality values can be summed up without overflow.
+// Beyond, the quality sums and their read count are scaled down.
+static uint32_t const MAX_QUAL_READS = std::numeric_limits<uint32_t>::max() / 64;
+
+/**
+ * Adds the quality values of a read to per position quality sums. Written as
+ * a plain loop over the underlying arrays, such that it can be vectorized.
+ */
+template<typename TQualSequence>
+void _addQualityValues(String<uint32_t> & qualSums, TQualSequence const & seq)
+{
+    SEQAN_CHECK(length(qualSums) == length(seq), "Please report this error");
+    uint32_t * sums = begin(qualSums, Standard());
+    typename Iterator<TQualSequence const, Standard>::Type quals = begin(seq, Standard());
+    size_t const len = length(seq);
+    for (size_t i = 0; i < len; ++i)
+        sums[i] += getQualityValue(quals[i]);
 }
 
-inline FastqMultiRecord<PairedEnd>* getMultiRecordPtr(FastqMultiRecordCollection<PairedEnd> const & collection,
-        FastqRecord<PairedEnd> const & rec) {
-    return getMultiRecordPtr(collection, rec.bcSeq, rec.fwSeq, rec.revSeq);
+/**
+ * Adds quality sums divided by 2^shift to other quality sums
+ */
+inline void _addQualitySums(String<uint32_t> & target, String<uint32_t> const & source, unsigned const shift)
+{
+    SEQAN_CHECK(length(target) == length(source), "Please report this error");
+    uint32_t * targetSums = begin(target, Standard());
+    uint32_t const * sourceSums = begin(source, Standard());
+    size_t const len = length(target);
+    for (size_t i = 0; i < len; ++i)
+        targetSums[i] += sourceSums[i] >> shift;
 }
 
-template <typename TSequencingSpec>
-FastqMultiRecord<TSequencingSpec> _generic_newMultiRecord(FastqRecord<TSequencingSpec> const & record) {
-    FastqMultiRecord<TSequencingSpec> multiRecord;
-    multiRecord.bcSeq = record.bcSeq;
-    multiRecord.ids.insert(record.id);
-    return(multiRecord);
+/**
+ * Divides quality sums by 2^shift, which approximately keeps the mean
+ * qualities if their read count is divided alike
+ */
+inline void _scaleDownQualitySums(String<uint32_t> & qualSums, unsigned const shift)
+{
+    uint32_t * sums = begin(qualSums, Standard());
+    size_t const len = length(qualSums);
+    for (size_t i = 0; i < len; ++i)
+        sums[i] >>= shift;
 }
 
-inline void updateMeanQualityValues(String<double> & targetQualities,
-        uint64_t const targetWeight,
-        String<double> const & newQualities,
-        uint64_t const newWeight)
+/**
+ * The number of halvings required to sum up the qualities of n reads
+ * without overflow
+ */
+inline unsigned _qualitySumsShift(uint64_t const n)
 {
-    SEQAN_CHECK((length(targetQualities)==0 && targetWeight==0) || (length(targetQualities) == length(newQualities) && length(targetQualities) > 0), "Please report this error.");
-    if (length(targetQualities) == 0)
-    {
-        targetQualities = newQualities;
-    } else {
-        for (size_t i = 0; i<length(targetQualities); ++i)
-            targetQualities[i] = (static_cast<double>(targetWeight) * targetQualities[i]
-                    + static_cast<double>(newWeight) * newQualities[i]) / (targetWeight + newWeight);
+    unsigned shift = 0;
+    while ((n >> shift) > MAX_QUAL_READS)
+        ++shift;
+    return shift;
+}
+
+/**
+ * Adds the quality values of a FastqRecord to the quality sums of a
+ * FastqMultiRecord. Once MAX_QUAL_READS reads were added, the sums and the
+ * read count are halved first.
+ * @special Single end
+ */
+inline void addQualityValues(FastqMultiRecord<SingleEnd> & multiRecord, FastqRecord<SingleEnd> const & record)
+{
+    if (multiRecord.nQualReads == 0) {
+        resize(multiRecord.qualSums, length(record.seq), 0);
+    } else if (multiRecord.nQualReads >= MAX_QUAL_READS) {
+        _scaleDownQualitySums(multiRecord.qualSums, 1);
+        multiRecord.nQualReads >>= 1;
     }
+    _addQualityValues(multiRecord.qualSums, record.seq);
+    ++multiRecord.nQualReads;
 }
 
 /**
- * Updates mean quality values based on the current mean quality values, the
- * number of elements that contributed to them (origWeight) and the new quality
- * values
+ * @special Paired end
  */
-template<typename TQualSequence>
-void updateMeanQualityValues(String<double> & qualities,
-        uint64_t const origWeight,
-        TQualSequence const & seq) {
-    SEQAN_CHECK((length(qualities) == 0 && origWeight == 0) || (length(qualities) == length(seq) && origWeight > 0), "Please report this error");
-    if (origWeight == 0)
-        resize(qualities, length(seq), 0);
-    for (unsigned i=0; i<length(seq); ++i)
-        qualities[i] = ((qualities[i] * origWeight) + getQualityValue(seq[i])) / (origWeight+1);
+inline void addQualityValues(FastqMultiRecord<PairedEnd> & multiRecord, FastqRecord<PairedEnd> const & record)
+{
+    if (multiRecord.nQualReads == 0) {
+        resize(multiRecord.fwQualSums, length(record.fwSeq), 0);
+        resize(multiRecord.revQualSums, length(record.revSeq), 0);
+    } else if (multiRecord.nQualReads >= MAX_QUAL_READS) {
+        _scaleDownQualitySums(multiRecord.fwQualSums, 1);
+        _scaleDownQualitySums(multiRecord.revQualSums, 1);
+        multiRecord.nQualReads >>= 1;
+    }
+    _addQualityValues(multiRecord.fwQualSums, record.fwSeq);
+    _addQualityValues(multiRecord.revQualSums, record.revSeq);
+    ++multiRecord.nQualReads;
 }
 
-inline void updateMeanQualityValues(FastqMultiRecord<SingleEnd> & target,
-        FastqMultiRecord<SingleEnd> const & source)
+/**
+ * Adds the quality sums of a FastqMultiRecord to those of another one with
+ * the same sequences. If the read counts add up to more than MAX_QUAL_READS,
+ * both records' sums are scaled down by the same factor.
+ * @special Single end
+ */
+inline void mergeQualityValues(FastqMultiRecord<SingleEnd> & target, FastqMultiRecord<SingleEnd> const & source)
 {
-    updateMeanQualityValues(target.qualities, target.ids.size(), source.qualities, source.ids.size());
+    if (source.nQualReads == 0)
+        return;
+    if (target.nQualReads == 0) {
+        target.qualSums = source.qualSums;
+        target.nQualReads = source.nQualReads;
+        return;
+    }
+    unsigned const shift = _qualitySumsShift(static_cast<uint64_t>(target.nQualReads) + source.nQualReads);
+    _scaleDownQualitySums(target.qualSums, shift);
+    _addQualitySums(target.qualSums, source.qualSums, shift);
+    target.nQualReads = (target.nQualReads >> shift) + (source.nQualReads >> shift);
 }
 
-inline void updateMeanQualityValues(FastqMultiRecord<PairedEnd> & target,
-        FastqMultiRecord<PairedEnd> const & source)
+/**
+ * @special Paired end
+ */
+inline void mergeQualityValues(FastqMultiRecord<PairedEnd> & target, FastqMultiRecord<PairedEnd> const & source)
 {
-    updateMeanQualityValues(target.fwQualities, target.ids.size(), source.fwQualities, source.ids.size());
-    updateMeanQualityValues(target.revQualities, target.ids.size(), source.revQualities, source.ids.size());
+    if (source.nQualReads == 0)
+        return;
+    if (target.nQualReads == 0) {
+        target.fwQualSums = source.fwQualSums;
+        target.revQualSums = source.revQualSums;
+        target.nQualReads = source.nQualReads;
+        return;
+    }
+    unsigned const shift = _qualitySumsShift(static_cast<uint64_t>(target.nQualReads) + source.nQualReads);
+    _scaleDownQualitySums(target.fwQualSums, shift);
+    _scaleDownQualitySums(target.revQualSums, shift);
+    _addQualitySums(target.fwQualSums, source.fwQualSums, shift);
+    _addQualitySums(target.revQualSums, source.revQualSums, shift);
+    target.nQualReads = (target.nQualReads >> shift) + (source.nQualReads >> shift);
 }
 
 /**
- * Creates a new FastqMultiRecord based on a FastqRecord
+ * Computes the per position mean qualities from quality sums
  */
-inline FastqMultiRecord<SingleEnd> newMultiRecord(FastqRecord<SingleEnd> const & record) {
-    FastqMultiRecord<SingleEnd> multiRecord = _generic_newMultiRecord(record);
-    multiRecord.seq = record.seq;
-    updateMeanQualityValues(multiRecord.qualities, 0, record.seq);
-    return(multiRecord);
+inline void meanQualityValues(String<double> & means, String<uint32_t> const & qualSums, uint32_t const nQualReads)
+{
+    resize(means, length(qualSums));
+    for (size_t i = 0; i < length(qualSums); ++i)
+        means[i] = nQualReads == 0 ? 0 : static_cast<double>(qualSums[i]) / nQualReads;
+}
+
+inline String<double> meanQualityValues(String<uint32_t> const & qualSums, uint32_t const nQualReads)
+{
+    String<double> means;
+    meanQualityValues(means, qualSums, nQualReads);
+    return means;
+}
+
+/**
+ * Completes a FastqMultiRecord created by packedSkeleton() with the read ID
+ * index and the qualities of the FastqRecord
+ */
+template <typename TSequencingSpec>
+void completeMultiRecord(FastqMultiRecord<TSequencingSpec> & multiRecord, FastqRecord<TSequencingSpec> const & record,
+        TReadId const readId) {
+    multiRecord.ids.push_back(readId);
+    addQualityValues(multiRecord, record);
 }
 
-inline FastqMultiRecord<PairedEnd> newMultiRecord(FastqRecord<PairedEnd> const & record) {
-    FastqMultiRecord<PairedEnd> multiRecord = _generic_newMultiRecord(record);
-    multiRecord.fwSeq = record.fwSeq;
-    updateMeanQualityValues(multiRecord.fwQualities, 0, record.fwSeq);
-    multiRecord.revSeq = record.revSeq;
-    updateMeanQualityValues(multiRecord.revQualities, 0, record.revSeq);
+/**
+ * Creates a new FastqMultiRecord based on a FastqRecord, the sequences are
+ * allocated from the passed store
+ */
+template <typename TSequencingSpec>
+FastqMultiRecord<TSequencingSpec> newMultiRecord(FastqRecord<TSequencingSpec> const & record, TReadId const readId,
+        PackedSequenceStore & store) {
+    FastqMultiRecord<TSequencingSpec> multiRecord = packedSkeleton(record, store);
+    completeMultiRecord(multiRecord, record, readId);
     return(multiRecord);
 }
 
+template <typename TSequencingSpec>
+FastqMultiRecord<TSequencingSpec> & _mapMultiRecord(FastqMultiRecordCollection<TSequencingSpec> & collection,
+        FastqMultiRecord<TSequencingSpec> && multiRecord,
+        uint64_t const hash) {
+    if (collection.multiRecords.size() >= FastqMultiRecordSlot::EMPTY)
+        throw std::runtime_error("mapMultiRecord(...)[E001]");
+    collection.multiRecords.push_back(std::move(multiRecord));
+    size_t const nSlots = _requiredSlots(collection.multiRecords.size());
+    if (nSlots > collection.slots.size()) {
+        _rebuildSlots(collection, nSlots);
+    } else {
+        FastqMultiRecordSlot & slot = collection.slots[_findSlot(collection, collection.multiRecords.back(), hash)];
+        slot.recId = static_cast<uint32_t>(collection.multiRecords.size() - 1);
+        slot.fingerprint = static_cast<uint32_t>(hash >> 32);
+    }
+    return collection.multiRecords.back();
+}
+
 /**
  * Appends a FastqMultiRecord to a FastqMultiRecordCollection and updates the
- * internal maps
+ * lookup table. The collection must not contain a record with the same
+ * sequences yet. The returned reference is invalidated by subsequent
+ * insertions into the collection.
  */
-inline FastqMultiRecord<PairedEnd> & mapMultiRecord(FastqMultiRecordCollection<PairedEnd> & collection,
-        FastqMultiRecord<PairedEnd> const & multiRecord) {
-    FastqMultiRecord<PairedEnd> & newRec = * collection.multiRecords.insert(collection.multiRecords.end(), multiRecord);
-    collection.bcMap[multiRecord.bcSeq][multiRecord.fwSeq][multiRecord.revSeq] = &newRec;
-    return newRec;
+template <typename TSequencingSpec>
+FastqMultiRecord<TSequencingSpec> & mapMultiRecord(FastqMultiRecordCollection<TSequencingSpec> & collection,
+        FastqMultiRecord<TSequencingSpec> && multiRecord) {
+    uint64_t const hash = hashSequences(multiRecord);
+    return _mapMultiRecord(collection, std::move(multiRecord), hash);
 }
 
-inline FastqMultiRecord<SingleEnd> & mapMultiRecord(FastqMultiRecordCollection<SingleEnd> & collection,
-        FastqMultiRecord<SingleEnd> const & multiRecord) {
-    FastqMultiRecord<SingleEnd> & newRec = * collection.multiRecords.insert(collection.multiRecords.end(), multiRecord);
-    collection.bcMap[multiRecord.bcSeq][multiRecord.seq] = &newRec;
-    return newRec;
+template <typename TSequencingSpec>
+FastqMultiRecord<TSequencingSpec> & mapMultiRecord(FastqMultiRecordCollection<TSequencingSpec> & collection,
+        FastqMultiRecord<TSequencingSpec> const & multiRecord) {
+    return mapMultiRecord(collection, FastqMultiRecord<TSequencingSpec>(multiRecord));
 }
 
 /**
- * Adds a FastqRecord to a FastqMultiRecord by adding the ID and updating the
- * median qualities. No checking for sequence identity is performed!
+ * Adds a FastqRecord to a FastqMultiRecord by adding the read ID index and
+ * the quality values. No checking for sequence identity is
+ * performed!
  *
  * @param multiRecord The FastqMultiRecord object to modify
  * @param      record The FastqRecord to add to the FastqMultiRecord
+ * @param      readId The index of the record's ID in the ReadIdStore, not
+ *                    yet in the FastqMultiRecord. It is larger than all
+ *                    indices in the record unless the ID is repeated.
+ */
+template <typename TSequencingSpec>
+void updateMultiRecord(FastqMultiRecord<TSequencingSpec> & multiRecord,
+        FastqRecord<TSequencingSpec> const & record,
+        TReadId const readId) {
+    if (multiRecord.ids.empty() || multiRecord.ids.back() < readId) {
+        multiRecord.ids.push_back(readId);
+    } else {
+        std::vector<TReadId>::iterator const pos = std::lower_bound(multiRecord.ids.begin(), multiRecord.ids.end(), readId);
+        SEQAN_CHECK(*pos != readId, "Please report this error");
+        multiRecord.ids.insert(pos, readId);
+    }
+    addQualityValues(multiRecord, record);
+}
+
+/**
+ * Merges the sorted read ID indices of a FastqMultiRecord into another one.
+ * Equal read IDs share one index, see _addReadId(), such that indices
+ * already in the target are skipped.
  */
-inline void updateMultiRecord(FastqMultiRecord<SingleEnd> & multiRecord,
-        FastqRecord<SingleEnd> const & record) {
-    uint64_t old_size = multiRecord.ids.size();
-    multiRecord.ids.insert(record.id);
-    SEQAN_CHECK(old_size < multiRecord.ids.size(), "Please report this error");
-    updateMeanQualityValues(multiRecord.qualities, old_size, record.seq);
+inline void mergeReadIds(std::vector<TReadId> & target, std::vector<TReadId> const & source)
+{
+    size_t const oldSize = target.size();
+    target.insert(target.end(), source.begin(), source.end());
+    std::inplace_merge(target.begin(), target.begin() + oldSize, target.end());
+    target.erase(std::unique(target.begin(), target.end()), target.end());
 }
 
-inline void updateMultiRecord(FastqMultiRecord<PairedEnd> & multiRecord,
-        FastqRecord<PairedEnd> const & record) {
-    uint64_t old_size = multiRecord.ids.size();
-    multiRecord.ids.insert(record.id);
-    SEQAN_CHECK(old_size < multiRecord.ids.size(), "Please report this error");
-    updateMeanQualityValues(multiRecord.fwQualities, old_size, record.fwSeq);
-    updateMeanQualityValues(multiRecord.revQualities, old_size, record.revSeq);
+/**
+ * Looks up the ID of a read to be inserted into a record, which may be NULL
+ * for a new record. Returns true if the record already holds a read with
+ * this ID. Otherwise, the index of the ID is returned in readId. An ID that
+ * is already held by another record keeps its index, new IDs are added to
+ * the collection's ReadIdStore and ReadIdTable. Equal IDs thus share one
+ * index within the records.
+ */
+template <typename TSequencingSpec>
+bool _addReadId(TReadId & readId,
+        FastqMultiRecordCollection<TSequencingSpec> & collection,
+        FastqMultiRecord<TSequencingSpec> const * multiRecord,
+        CharString const & id)
+{
+    bool contained = false;
+    bool repeated = false;
+    forEachEqualReadId(collection.readIdTable, collection.readIds, id, [&](TReadId const other) {
+        if (multiRecord != NULL && std::binary_search(multiRecord->ids.begin(), multiRecord->ids.end(), other))
+            contained = true;
+        readId = other;
+        repeated = true;
+    });
+    if (contained)
+        return true;
+    if (repeated) {
+        collection.repeatedReadIds = true;
+        return false;
+    }
+    readId = appendReadId(collection.readIds, id);
+    insertReadId(collection.readIdTable, collection.readIds, readId);
+    return false;
 }
 
 /**
  * Find the FastqMultiRecord that contains a certain FastqRecord within a
- * FastqMultiRecordCollection. If the specified FastqRecord is not yet in the
- * FastqMultiRecordCollection and insert=true is specified, add the record to
- * the collection. Matching does not consider FASTQ ID, the 'insert' feature
- * does.
+ * FastqMultiRecordCollection. If insert=true is specified, the ID of the
+ * FastqRecord is added to the collection's ReadIdStore and the record is
+ * added to the matching FastqMultiRecord, or inserted as a new one if there
+ * is no match. Matching does not consider the FASTQ ID, the 'insert' feature
+ * does: a FastqRecord whose ID is already in the matching FastqMultiRecord
+ * is not added again.
  *
  * @param multiRecord The output FastqMultiRecord object to write the maching
  *                    multi-record to if one was found or inserted.
@@ -420,7 +603,8 @@ inline void updateMultiRecord(FastqMultiRecord<PairedEnd> & multiRecord,
  * @param      insert true = insert if no match, false = don't insert. Default: false;
  *
  * @return            A pointer to the found record, NULL if there was no
- *                    matching record.
+ *                    matching record. The pointer is invalidated by
+ *                    subsequent insertions into the collection.
  */
 template <typename TSequencingSpec>
 FastqMultiRecord<TSequencingSpec> * findContainingMultiRecord(FastqMultiRecordCollection<TSequencingSpec> & collection,
@@ -429,50 +613,436 @@ FastqMultiRecord<TSequencingSpec> * findContainingMultiRecord(FastqMultiRecordCo
 {
     typedef FastqMultiRecordCollection<TSequencingSpec>      TColl;
     typedef typename TColl::TMRec                            TMRec;
-    typedef typename FastqMultiRecord<TSequencingSpec>::TIds TIds;
-
-    TMRec * recPtr = getMultiRecordPtr(collection, record);
-    if (recPtr != nullptr) {
-        TMRec & oldMultiRecord = *recPtr;
-        TIds & ids = oldMultiRecord.ids;
-        if (ids.find(record.id) != ids.end()) {
-            return & oldMultiRecord;
-        } else {
-            if (!insert)
-                return & oldMultiRecord;
-            updateMultiRecord(oldMultiRecord, record);
-            return & oldMultiRecord;
-        }
+
+    // The probe sequences are only kept if the probe becomes a new record
+    PackedSequenceStore::Mark const probeMark = collection.seqStore.mark();
+    TMRec probe = packedSkeleton(record, collection.seqStore);
+    uint64_t const hash = hashSequences(probe);
+    uint64_t const recId = _findMultiRecordId(collection, probe, hash);
+    if (recId != TColl::NO_MATCH) {
+        collection.seqStore.rewind(probeMark);
+        TMRec & oldMultiRecord = collection.multiRecords[recId];
+        TReadId readId;
+        if (insert && !_addReadId(readId, collection, &oldMultiRecord, record.id))
+            updateMultiRecord(oldMultiRecord, record, readId);
+        return & oldMultiRecord;
     } else {
-        if (!insert)
+        if (!insert) {
+            collection.seqStore.rewind(probeMark);
             return NULL;
-        return &(mapMultiRecord(collection, newMultiRecord(record)));
+        }
+        TReadId readId;
+        _addReadId(readId, collection, static_cast<TMRec const *>(NULL), record.id);
+        completeMultiRecord(probe, record, readId);
+        return &(_mapMultiRecord(collection, std::move(probe), hash));
     }
 }
 
 /**
  * Merge a FastqMultiRecord into a FastqMultiRecordCollection. If there already
  * exists a FastqMultiRecord with the very same sequence specifications, the
- * mean qualities are updated and the FASTQ_IDS are added. If no
+ * quality sums and the read IDs are added. Read IDs that are already in the
+ * existing record are not added twice. If no
  * FastqMultiRecord matches, the passed FastqMultiRecord is inserted and mapped
- * accordingly.
+ * accordingly. The read ID indices and the sequences of the passed
+ * FastqMultiRecord have to refer to the ReadIdStore and the
+ * PackedSequenceStore of the collection.
  */
 template<typename TSequencingSpec>
 FastqMultiRecord<TSequencingSpec> & mergeRecord(FastqMultiRecordCollection<TSequencingSpec> & collection,
         FastqMultiRecord<TSequencingSpec> const & rec)
 {
-    FastqMultiRecord<TSequencingSpec> * existingRecPtr = findContainingMultiRecord(collection, toFastqRecordSkel(rec), false);
+    FastqMultiRecord<TSequencingSpec> * existingRecPtr = getMultiRecordPtr(collection, rec);
     if (existingRecPtr != NULL)
     {
         FastqMultiRecord<TSequencingSpec> & existingRec = *existingRecPtr;
-        updateMeanQualityValues(existingRec, rec);
-        existingRec.ids.insert(rec.ids.begin(), rec.ids.end());
+        mergeQualityValues(existingRec, rec);
+        mergeReadIds(existingRec.ids, rec.ids);
         existingRec.bcSeqHistory.insert(rec.bcSeqHistory.begin(), rec.bcSeqHistory.end());
         return existingRec;
     }
     return mapMultiRecord(collection, rec);
 }
 
+#ifdef __WITHCDR3THREADS__
+
+/*-------------------------------------------------------------------------------
+ - Input pipeline
+ -------------------------------------------------------------------------------*/
+
+// Number of records passed between the input pipeline stages at once
+static size_t const INPUT_PIPELINE_BATCH_SIZE = 1024;
+
+/**
+ * A batch of consecutive records parsed from one input file. Records of
+ * memory mapped files are passed as views and only converted by the worker
+ * threads.
+ */
+struct FastqStreamBatch {
+    uint64_t                batchNo;
+    std::string const *     path;
+    String<CharString>      ids;
+    String<String<Dna5Q> >  seqs;
+    String<FastqRecordView> views;
+};
+
+inline size_t length(FastqStreamBatch const & batch)
+{
+    return empty(batch.views) ? length(batch.ids) : length(batch.views);
+}
+
+/**
+ * Extracts the i-th record of a batch
+ */
+inline void _batchRecord(CharString & id, String<Dna5Q> & seq, FastqStreamBatch const & batch, size_t const i)
+{
+    if (!empty(batch.views)) {
+        materializeRecord(id, seq, batch.views[i], *batch.path);
+    } else {
+        id  = batch.ids[i];
+        seq = batch.seqs[i];
+    }
+}
+
+/**
+ * A batch of consecutive FastqRecords that passed through barcode splitting,
+ * truncation, quality control and orientation syncing. 'reasons' holds the
+ * quality control result of every record.
+ */
+template <typename TSequencingSpec>
+struct FastqRecordBatch {
+    uint64_t                                batchNo;
+    String<FastqRecord<TSequencingSpec> >   records;
+    String<RejectReason>                    reasons;
+};
+
+/**
+ * One input file as seen by a parser thread of the input pipeline
+ */
+struct FastqPipelineInput {
+    SeqFileIn *     stream;
+    InputFile *     rawStream;
+    std::string     path;
+    FastqPipelineInput(SeqFileIn & _stream, InputFile & _rawStream, std::string const & _path) :
+        stream(&_stream), rawStream(&_rawStream), path(_path) {}
+};
+
+/**
+ * @special Single end implementation
+ */
+inline std::vector<FastqPipelineInput> _pipelineInputs(SeqInputStreams<SingleEnd> & inStreams)
+{
+    return std::vector<FastqPipelineInput>(1, FastqPipelineInput(inStreams.stream, inStreams.rawStream, inStreams.path));
+}
+
+/**
+ * @special Paired end implementation. The forward file comes first, its IDs
+ * are used for the records.
+ */
+inline std::vector<FastqPipelineInput> _pipelineInputs(SeqInputStreams<PairedEnd> & inStreams)
+{
+    std::vector<FastqPipelineInput> inputs;
+    inputs.push_back(FastqPipelineInput(inStreams.fwStream, inStreams.fwRawStream, inStreams.fwPath));
+    inputs.push_back(FastqPipelineInput(inStreams.revStream, inStreams.revRawStream, inStreams.revPath));
+    return inputs;
+}
+
+/**
+ * Builds the i-th FastqRecord from the batches parsed from the input files
+ * @special Single end implementation
+ */
+inline void _assembleRecord(FastqRecord<SingleEnd> & rec, std::vector<std::unique_ptr<FastqStreamBatch> > const & parts, size_t const i)
+{
+    _batchRecord(rec.id, rec.seq, *parts[0], i);
+}
+
+/**
+ * @special Paired end implementation
+ */
+inline void _assembleRecord(FastqRecord<PairedEnd> & rec, std::vector<std::unique_ptr<FastqStreamBatch> > const & parts, size_t const i)
+{
+    CharString revId;
+    _batchRecord(rec.id, rec.fwSeq, *parts[0], i);
+    _batchRecord(revId, rec.revSeq, *parts[1], i);
+}
+
+/**
+ * Parser stage of the input pipeline. Reads one input file in batches.
+ * Parsing stops at the end of the file or, for paired input, as soon as as
+ * many records were read as the mate file turned out to contain ('mateEnd').
+ * In the latter case 'lengthMismatch' is set.
+ */
+inline void _parseInputBatches(BoundedQueue<std::unique_ptr<FastqStreamBatch> > & queue,
+        FastqPipelineInput & input,
+        std::atomic<uint64_t> & ownEnd,
+        std::atomic<uint64_t> const & mateEnd,
+        std::atomic<bool> & lengthMismatch,
+        ProgressBar * progBar,
+        bool const offsetProgress)
+{
+    FastqMmapReader * mapped = input.rawStream->mappedFastq();
+    uint64_t nRead = 0;
+    uint64_t batchNo = 0;
+    uint64_t blockBytes = 0;
+    uint64_t reportedBytes = 0;
+    bool done = false;
+    while (!done) {
+        std::unique_ptr<FastqStreamBatch> batch(new FastqStreamBatch());
+        batch->batchNo = batchNo++;
+        batch->path = &input.path;
+        if (mapped != NULL) {
+            reserve(batch->views, INPUT_PIPELINE_BATCH_SIZE);
+        } else {
+            reserve(batch->ids, INPUT_PIPELINE_BATCH_SIZE);
+            reserve(batch->seqs, INPUT_PIPELINE_BATCH_SIZE);
+        }
+        while (length(*batch) < INPUT_PIPELINE_BATCH_SIZE) {
+            if (inputAtEnd(*input.stream, *input.rawStream)) {
+                ownEnd = nRead;
+                done = true;
+                break;
+            }
+            if (nRead >= mateEnd) {
+                lengthMismatch = true;
+                done = true;
+                break;
+            }
+            if (mapped != NULL) {
+                resize(batch->views, length(batch->views) + 1);
+                mapped->readRecord(back(batch->views));
+                blockBytes += 2 * back(batch->views).length + back(batch->views).idLength + 6;
+            } else {
+                resize(batch->ids, length(batch->ids) + 1);
+                resize(batch->seqs, length(batch->seqs) + 1);
+                readInputRecord(back(batch->ids), back(batch->seqs), *input.stream, *input.rawStream, input.path);
+                blockBytes += 2 * length(back(batch->seqs)) + length(back(batch->ids)) + 6;
+            }
+            ++nRead;
+
+            // Progress, see readRecords()
+            if (nRead % 1234 == 0 && progBar != NULL) {
+                if (offsetProgress) {
+                    uint64_t consumedBytes = rawStreamPosition(*input.rawStream);
+                    if (consumedBytes > reportedBytes) {
+                        progBar->updateAndPrint(consumedBytes - reportedBytes);
+                        reportedBytes = consumedBytes;
+                    }
+                } else {
+                    progBar->updateAndPrint(blockBytes);
+                }
+                blockBytes = 0;
+            }
+        }
+        if (length(*batch) > 0 && !queue.push(std::move(batch)))
+            break;
+    }
+    queue.close();
+}
+
+/**
+ * QC stage of the input pipeline. Takes matching batches from the parser
+ * queues, performs the per-record processing of readRecords() and passes the
+ * results on to the insertion stage. Pairing stops at the first batch the
+ * input files disagree on, the surplus records of the longer file are
+ * discarded and 'lengthMismatch' is set. A batch is only passed on once it
+ * lies within the reorder window of the insertion stage.
+ */
+template <typename TSequencingSpec>
+void _qcInputBatches(BoundedQueue<std::unique_ptr<FastqRecordBatch<TSequencingSpec> > > & outQueue,
+        std::vector<std::unique_ptr<BoundedQueue<std::unique_ptr<FastqStreamBatch> > > > & inQueues,
+        SequenceWindow & reorderWindow,
+        std::mutex & MUTEX_pairing,
+        bool & pairingDone,
+        std::atomic<bool> & lengthMismatch,
+        CdrOptions const & options)
+{
+    while (true) {
+        std::vector<std::unique_ptr<FastqStreamBatch> > parts(inQueues.size());
+        size_t nRecords = std::numeric_limits<size_t>::max();
+        { ////////////////////////////////////////////////////////////////////
+            TUniqueLock lock(MUTEX_pairing);                                //
+            if (pairingDone)                                                //
+                break;                                                      //
+            bool complete = true;                                           //
+            bool mismatch = false;                                          //
+            for (size_t i = 0; i < inQueues.size(); ++i) {                  //
+                size_t n = 0;                                               // pairing mutex locked
+                if (inQueues[i]->pop(parts[i]))                             //
+                    n = length(*parts[i]);                                  //
+                else                                                        //
+                    complete = false;                                       //
+                if (i > 0 && n != nRecords)                                 //
+                    mismatch = true;                                        //
+                nRecords = std::min(nRecords, n);                           //
+            }                                                               //
+            if (!complete || mismatch) {                                    //
+                pairingDone = true;                                         //
+                for (size_t i = 0; i < inQueues.size(); ++i)                //
+                    inQueues[i]->close();                                   //
+            }                                                               //
+            if (mismatch)                                                   //
+                lengthMismatch = true;                                      //
+        } ////////////////////////////////////////////////////////////////////
+        if (nRecords == 0)
+            break;
+
+        std::unique_ptr<FastqRecordBatch<TSequencingSpec> > batch(new FastqRecordBatch<TSequencingSpec>());
+        batch->batchNo = parts[0]->batchNo;
+        resize(batch->records, nRecords);
+        resize(batch->reasons, nRecords);
+        for (size_t i = 0; i < nRecords; ++i) {
+            FastqRecord<TSequencingSpec> & rec = batch->records[i];
+            _assembleRecord(rec, parts, i);
+            bool tsfb = options.barcodeLength > 0 && !splitBarcodeSeq(rec, options.barcodeVDJRead, options.barcodeLength);
+            // Truncate record if requested
+            if (options.trunkReads != 0)
+                truncate(rec, options.trunkReads);
+            // FASTQ-Read QC
+            RejectReason r = tsfb ? TOO_SHORT_FOR_BARCODE : qualityControl(rec, options);
+            // Sync orientation for further processing
+            if (r == NONE)
+                syncOrientation(rec, options);
+            batch->reasons[i] = r;
+        }
+        if (!reorderWindow.enter(batch->batchNo) || !outQueue.push(std::move(batch)))
+            break;
+    }
+}
+
+/**
+ * Insertion stage of the input pipeline. Records are inserted strictly in
+ * input order, the order of the collection and of the reject events as well
+ * as the mean qualities thus equal those of the sequential implementation.
+ */
+template <typename TSequencingSpec>
+void _insertRecordBatch(FastqMultiRecordCollection<TSequencingSpec> & collection,
+        InputInformation & ii,
+        String<RejectEvent> & rejectEvents,
+        FastqRecordBatch<TSequencingSpec> & batch)
+{
+    for (size_t i = 0; i < length(batch.records); ++i) {
+        FastqRecord<TSequencingSpec> & rec = batch.records[i];
+        ++ii.totalReadCount;
+        if (batch.reasons[i] == NONE) {
+            // Statistics
+            ii.maxReadLength = ii.maxReadLength > length(longerSeq(rec)) ? ii.maxReadLength : length(longerSeq(rec));
+            ii.minReadLength = ii.minReadLength < length(shorterSeq(rec)) ? ii.minReadLength : length(shorterSeq(rec));
+            // Insert into collection
+            findContainingMultiRecord(collection, rec, true);
+        } else {
+            appendValue(rejectEvents, RejectEvent(appendReadId(collection.readIds, rec.id), batch.reasons[i]));
+        }
+    }
+}
+
+/**
+ * Multi-threaded implementation of readRecords(). One thread per input file
+ * parses records, a number of worker threads performs barcode splitting,
+ * truncation, quality control and orientation syncing and the calling thread
+ * inserts the records into the collection. The stages are connected by
+ * bounded queues. Batches finished out of order wait for their predecessors,
+ * at most 'reorderWindow' of them are in flight ahead of the insertion.
+ * Produces the same collection and reject events as the sequential
+ * implementation.
+ */
+template <typename TSequencingSpec>
+void _readRecordsPipelined(FastqMultiRecordCollection<TSequencingSpec> & collection,
+        InputInformation & ii,
+        String<RejectEvent> & rejectEvents,
+        SeqInputStreams<TSequencingSpec> & inStreams,
+        CdrOptions const & options,
+        ProgressBar * progBar)
+{
+    typedef BoundedQueue<std::unique_ptr<FastqStreamBatch> >                       TParseQueue;
+    typedef BoundedQueue<std::unique_ptr<FastqRecordBatch<TSequencingSpec> > >     TQCQueue;
+
+    std::vector<FastqPipelineInput> inputs = _pipelineInputs(inStreams);
+    size_t const queueCapacity = 2 * options.jobs;
+    int const nWorkers = std::max(1, options.jobs - 1 - static_cast<int>(inputs.size()));
+
+    std::vector<std::unique_ptr<TParseQueue> > parseQueues;
+    for (size_t i = 0; i < inputs.size(); ++i)
+        parseQueues.push_back(std::unique_ptr<TParseQueue>(new TParseQueue(queueCapacity)));
+    TQCQueue qcQueue(queueCapacity);
+    SequenceWindow reorderWindow(queueCapacity + nWorkers);
+
+    // Number of records found in each input file, the second entry stays at
+    // its maximum for single end input
+    std::atomic<uint64_t> inputEnds[2];
+    inputEnds[0] = std::numeric_limits<uint64_t>::max();
+    inputEnds[1] = std::numeric_limits<uint64_t>::max();
+    std::atomic<bool> lengthMismatch(false);
+    std::atomic<int> activeWorkers(nWorkers);
+    std::mutex MUTEX_pairing;
+    bool pairingDone = false;
+
+    // The first error raised by any stage shuts down the pipeline and is
+    // rethrown in the calling thread
+    std::mutex MUTEX_pipelineError;
+    std::exception_ptr pipelineError;
+    auto abortPipeline = [&](std::exception_ptr e) {
+        {
+            TUniqueLock lock(MUTEX_pipelineError);
+            if (!pipelineError)
+                pipelineError = e;
+        }
+        for (size_t i = 0; i < parseQueues.size(); ++i)
+            parseQueues[i]->close();
+        qcQueue.close();
+        reorderWindow.close();
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < inputs.size(); ++i)
+        threads.push_back(std::thread([&, i]() {
+            try {
+                _parseInputBatches(*parseQueues[i], inputs[i], inputEnds[i], inputEnds[1 - i], lengthMismatch,
+                        progBar, inStreams.offsetProgress);
+            } catch (...) {
+                abortPipeline(std::current_exception());
+            }
+        }));
+    for (int w = 0; w < nWorkers; ++w)
+        threads.push_back(std::thread([&]() {
+            try {
+                _qcInputBatches(qcQueue, parseQueues, reorderWindow, MUTEX_pairing, pairingDone, lengthMismatch, options);
+            } catch (...) {
+                abortPipeline(std::current_exception());
+            }
+            if (--activeWorkers == 0)
+                qcQueue.close();
+        }));
+
+    // Insert the batches in input order
+    try {
+        std::map<uint64_t, std::unique_ptr<FastqRecordBatch<TSequencingSpec> > > pending;
+        uint64_t nextBatchNo = 0;
+        std::unique_ptr<FastqRecordBatch<TSequencingSpec> > batch;
+        while (qcQueue.pop(batch)) {
+            uint64_t batchNo = batch->batchNo;
+            pending[batchNo] = std::move(batch);
+            for (auto it = pending.find(nextBatchNo); it != pending.end(); it = pending.find(nextBatchNo)) {
+                _insertRecordBatch(collection, ii, rejectEvents, *(it->second));
+                pending.erase(it);
+                ++nextBatchNo;
+                reorderWindow.advance();
+            }
+        }
+    } catch (...) {
+        abortPipeline(std::current_exception());
+    }
+
+    for (std::thread & t : threads)
+        t.join();
+
+    if (pipelineError)
+        std::rethrow_exception(pipelineError);
+    if (lengthMismatch)
+        std::cerr << "\nWARNING - Reached end of one input file before reaching the end of the other!\n";
+}
+
+#endif // Multi-threading enabled
+
 /**
  * Read all or at most 'counts' records from the input streams and perform
  * barcode splitting if specified.
@@ -510,8 +1080,18 @@ bool readRecords(FastqMultiRecordCollection<TSequencingSpec> & collection,
     // ============================================================================
 
     clear(collection);
+#ifdef __WITHCDR3THREADS__
+    if (count == 0 && options.jobs > 1) {
+        _readRecordsPipelined(collection, ii, rejectEvents, inStreams, options, progBar);
+        clear(collection.readIdTable);
+        if (progBar != nullptr) progBar->clear();
+        delete progBar;
+        return false;
+    }
+#endif
     FastqRecord<TSequencingSpec> rec;
     uint64_t blockBytes = 0;
+    uint64_t reportedBytes = 0;
     while (!inStreamsAtEnd(inStreams)) {
         bool tsfb = false;
         if (count > 0 && ii.totalReadCount == count) {
@@ -530,7 +1110,15 @@ bool readRecords(FastqMultiRecordCollection<TSequencingSpec> & collection,
         ++ii.totalReadCount;
         blockBytes += approxSizeInBytes(rec);
         if (ii.totalReadCount % 1234 == 0  && progBar != NULL) {
-            progBar->updateAndPrint(blockBytes);
+            if (inStreams.offsetProgress) {
+                uint64_t consumedBytes = consumedInBytes(inStreams);
+                if (consumedBytes > reportedBytes) {
+                    progBar->updateAndPrint(consumedBytes - reportedBytes);
+                    reportedBytes = consumedBytes;
+                }
+            } else {
+                progBar->updateAndPrint(blockBytes);
+            }
             blockBytes = 0;
         }
 
@@ -548,52 +1136,113 @@ bool readRecords(FastqMultiRecordCollection<TSequencingSpec> & collection,
             // Insert into collection
             findContainingMultiRecord(collection, rec, true);
         } else {
-            appendValue(rejectEvents, RejectEvent(rec.id, r));
+            appendValue(rejectEvents, RejectEvent(appendReadId(collection.readIds, rec.id), r));
         }
     }
+    clear(collection.readIdTable);
     if (progBar != nullptr) progBar->clear();
     delete progBar;
     return false;
 }
 
 /**
- * Build a QueryDataCollection from a String of FastqMultiRecords
+ * Resizes the query data string sets to hold n records. The strings kept from
+ * previous blocks retain their capacity, such that a QueryData object that is
+ * reused for consecutive blocks no longer allocates once it has seen the
+ * longest reads.
+ *
+ * @special Single end
+ */
+inline void _resizeQueryData(QueryData<SingleEnd> & qData, size_t const n)
+{
+    resize(qData.seqs, n);
+    resize(qData.avgQVals, n);
+}
+
+/**
+ * @special Paired end
+ */
+inline void _resizeQueryData(QueryData<PairedEnd> & qData, size_t const n)
+{
+    resize(qData.fwSeqs, n);
+    resize(qData.revSeqs, n);
+    resize(qData.fwAvgQVals, n);
+    resize(qData.revAvgQVals, n);
+}
+
+/**
+ * The query data strings are written in place, the string set limits have to
+ * be recomputed afterwards.
+ *
+ * @special Single end
+ */
+inline void _refreshQueryDataLimits(QueryData<SingleEnd> & qData)
+{
+    _refreshStringSetLimits(qData.seqs);
+    _refreshStringSetLimits(qData.avgQVals);
+}
+
+/**
+ * @special Paired end
+ */
+inline void _refreshQueryDataLimits(QueryData<PairedEnd> & qData)
+{
+    _refreshStringSetLimits(qData.fwSeqs);
+    _refreshStringSetLimits(qData.revSeqs);
+    _refreshStringSetLimits(qData.fwAvgQVals);
+    _refreshStringSetLimits(qData.revAvgQVals);
+}
+
+/**
+ * Fills a QueryDataCollection from a String of FastqMultiRecords. The
+ * collection is meant to be reused for consecutive blocks, see
+ * _resizeQueryData().
  *
  * @special Single end
  */
-inline QueryDataCollection<SingleEnd> buildQDCollection(String<FastqMultiRecord<SingleEnd> const *> const & ptrs)
+inline void buildQDCollection(QueryDataCollection<SingleEnd> & qdc, String<FastqMultiRecord<SingleEnd> const *> const & ptrs)
 {
-    QueryDataCollection<SingleEnd> qdc;
-    for (FastqMultiRecord<SingleEnd> const * ptr : ptrs) {
-        appendValue(qdc.queryData.seqs, ptr->seq);
-        appendValue(qdc.queryData.avgQVals, ptr->qualities);
+    _resizeQueryData(qdc.queryData, length(ptrs));
+    for (size_t i = 0; i < length(ptrs); ++i) {
+        unpack(qdc.queryData.seqs[i], ptrs[i]->seq);
+        meanQualityValues(qdc.queryData.avgQVals[i], ptrs[i]->qualSums, ptrs[i]->nQualReads);
     }
-    return qdc;
+    _refreshQueryDataLimits(qdc.queryData);
 }
 
 /**
  * @special Paired end
  */
-inline QueryDataCollection<PairedEnd> buildQDCollection(String<FastqMultiRecord<PairedEnd> const *> const & ptrs)
+inline void buildQDCollection(QueryDataCollection<PairedEnd> & qdc, String<FastqMultiRecord<PairedEnd> const *> const & ptrs)
 {
-    QueryDataCollection<PairedEnd> qdc;
+    size_t nSingle = 0;
+    for (FastqMultiRecord<PairedEnd> const * ptr : ptrs)
+        if (empty(ptr->fwSeq))
+            ++nSingle;
+    _resizeQueryData(qdc.pairedQueryData, length(ptrs) - nSingle);
+    _resizeQueryData(qdc.singleQueryData, nSingle);
+    resize(qdc.sePositions, nSingle);
 
+    size_t pe_idx = 0, se_idx = 0;
     for (size_t i=0; i<length(ptrs); ++i)
     {
         FastqMultiRecord<PairedEnd> const * ptr = ptrs[i];
         if (!empty(ptr->fwSeq))
         {
-            appendValue(qdc.pairedQueryData.fwSeqs, ptr->fwSeq);
-            appendValue(qdc.pairedQueryData.revSeqs, ptr->revSeq);
-            appendValue(qdc.pairedQueryData.fwAvgQVals, ptr->fwQualities);
-            appendValue(qdc.pairedQueryData.revAvgQVals, ptr->revQualities);
+            unpack(qdc.pairedQueryData.fwSeqs[pe_idx], ptr->fwSeq);
+            unpack(qdc.pairedQueryData.revSeqs[pe_idx], ptr->revSeq);
+            meanQualityValues(qdc.pairedQueryData.fwAvgQVals[pe_idx], ptr->fwQualSums, ptr->nQualReads);
+            meanQualityValues(qdc.pairedQueryData.revAvgQVals[pe_idx], ptr->revQualSums, ptr->nQualReads);
+            ++pe_idx;
         } else {
-            appendValue(qdc.singleQueryData.seqs, ptr->revSeq);
-            appendValue(qdc.singleQueryData.avgQVals, ptr->revQualities);
-            appendValue(qdc.sePositions, i);
+            unpack(qdc.singleQueryData.seqs[se_idx], ptr->revSeq);
+            meanQualityValues(qdc.singleQueryData.avgQVals[se_idx], ptr->revQualSums, ptr->nQualReads);
+            qdc.sePositions[se_idx] = i;
+            ++se_idx;
         }
     }
-    return qdc;
+    _refreshQueryDataLimits(qdc.pairedQueryData);
+    _refreshQueryDataLimits(qdc.singleQueryData);
 }
 
 #endif
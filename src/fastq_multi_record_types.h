@@ -27,14 +27,16 @@
 #ifndef IMSEQ_FASTQ_MULTI_RECORD_TYPES_H
 #define IMSEQ_FASTQ_MULTI_RECORD_TYPES_H
 
-#include <unordered_map>
-#include <list>
+#include <vector>
+#include <set>
 #include <limits>
 
 #include <seqan/basic.h>
 #include <seqan/sequence.h>
 
 #include "sequence_data_types.h"
+#include "packed_sequence.h"
+#include "read_id_store.h"
 
 using namespace seqan;
 
@@ -43,7 +45,15 @@ using namespace seqan;
  -------------------------------------------------------------------------------*/
 
 /**
- * A FastqMultiRecord holds reads that share the same sequence
+ * A FastqMultiRecord holds reads that share the same sequence. The sequences
+ * are stored packed in the PackedSequenceStore of the collection, see
+ * packed_sequence.h. The reads are referred to by the
+ * indices of their IDs in the ReadIdStore of the collection, in ascending
+ * order. A read ID occurs at most once per record, reads with a repeated ID
+ * are ignored. Reads of different records with the same ID share its index.
+ * The qualities are kept as the per position sums of the quality
+ * values of nQualReads reads, the mean qualities are computed only for the
+ * output.
  */
 template<typename T>
 struct FastqMultiRecord {};
@@ -53,14 +63,17 @@ struct FastqMultiRecord {};
  */
 template<>
 struct FastqMultiRecord<SingleEnd> {
-    typedef String<Dna5> TSequence;
-    typedef String<double> TQualities;
-    typedef std::set<CharString> TIds;
+    typedef PackedDna5String TSequence;
+    typedef String<uint32_t> TQualities;
+    typedef std::vector<TReadId> TIds;
 
     TSequence   seq, bcSeq;
-    std::set<TSequence> bcSeqHistory;
-    TQualities  qualities;
+    std::set<String<Dna5> > bcSeqHistory;
+    TQualities  qualSums;
+    uint32_t    nQualReads;
     TIds        ids;
+
+    FastqMultiRecord() : nQualReads(0) {}
 };
 
 /**
@@ -68,72 +81,99 @@ struct FastqMultiRecord<SingleEnd> {
  */
 template<>
 struct FastqMultiRecord<PairedEnd> {
-    typedef String<Dna5> TSequence;
-    typedef String<double> TQualities;
-    typedef std::set<CharString> TIds;
+    typedef PackedDna5String TSequence;
+    typedef String<uint32_t> TQualities;
+    typedef std::vector<TReadId> TIds;
 
     TSequence   fwSeq, revSeq, bcSeq;
-    std::set<TSequence> bcSeqHistory;
-    TQualities  fwQualities, revQualities;
+    std::set<String<Dna5> > bcSeqHistory;
+    TQualities  fwQualSums, revQualSums;
+    uint32_t    nQualReads;
     TIds        ids;
+
+    FastqMultiRecord() : nQualReads(0) {}
 };
 
 /*-------------------------------------------------------------------------------
  - FastqMultiRecordCollection
  -------------------------------------------------------------------------------*/
 
-namespace std {
-
-  template<>
-  struct hash<seqan::String<Dna5> >
-  {
-    std::size_t operator()(const seqan::String<Dna5> & k) const
-    {
-        size_t res = 12345678910;
-        for (seqan::Iterator<seqan::String<Dna5> const,Rooted>::Type it = begin(k); !atEnd(it); goNext(it))
-        {
-            res = res * 101 + static_cast<int>(*it) * 60;
-        }
-        return res;
-    }
-  };
+/**
+ * Sequence identity of two FastqMultiRecords, i.e. identity of the barcode
+ * and read sequences
+ * @special Single end implementation
+ */
+inline bool sameSequences(FastqMultiRecord<SingleEnd> const & a, FastqMultiRecord<SingleEnd> const & b)
+{
+    return a.seq == b.seq && a.bcSeq == b.bcSeq;
+}
 
+/**
+ * @special Paired end implementation
+ */
+inline bool sameSequences(FastqMultiRecord<PairedEnd> const & a, FastqMultiRecord<PairedEnd> const & b)
+{
+    return a.fwSeq == b.fwSeq && a.revSeq == b.revSeq && a.bcSeq == b.bcSeq;
 }
 
-template<typename T>
-struct FastqMultiRecordCollection {};
+/**
+ * Hash value of the barcode and read sequences of a FastqMultiRecord
+ * @special Single end implementation
+ */
+inline uint64_t hashSequences(FastqMultiRecord<SingleEnd> const & rec)
+{
+    return hashPacked(rec.seq, hashPacked(rec.bcSeq));
+}
 
-template<>
-struct FastqMultiRecordCollection<SingleEnd> {
-    typedef FastqMultiRecord<SingleEnd>         TMRec;
-    typedef TMRec::TSequence                    TSequence;
-    typedef std::list<TMRec>                    TRecList;
-    typedef std::list<TMRec>::const_iterator    TRecListIt;
+/**
+ * @special Paired end implementation
+ */
+inline uint64_t hashSequences(FastqMultiRecord<PairedEnd> const & rec)
+{
+    return hashPacked(rec.revSeq, hashPacked(rec.fwSeq, hashPacked(rec.bcSeq)));
+}
 
-    static uint64_t const NO_MATCH = std::numeric_limits<uint64_t>::max();
+/**
+ * Slot of the open addressing lookup table of a FastqMultiRecordCollection.
+ * Next to the record id, the upper half of the record's hash value is stored
+ * such that most non-matching slots can be skipped without accessing the
+ * record.
+ */
+struct FastqMultiRecordSlot {
+    static uint32_t const EMPTY = std::numeric_limits<uint32_t>::max();
 
-    typedef std::unordered_map<TMRec::TSequence, TMRec*> TSeqMap;
-    typedef std::unordered_map<TMRec::TSequence, TSeqMap> TBcMap;
+    uint32_t recId;
+    uint32_t fingerprint;
 
-    TRecList multiRecords;
-    TBcMap bcMap;
+    FastqMultiRecordSlot() : recId(EMPTY), fingerprint(0) {}
 };
 
-template<>
-struct FastqMultiRecordCollection<PairedEnd> {
-    typedef FastqMultiRecord<PairedEnd>         TMRec;
-    typedef TMRec::TSequence                    TSequence;
-    typedef std::list<TMRec>                    TRecList;
-    typedef std::list<TMRec>::const_iterator    TRecListIt;
+/**
+ * A FastqMultiRecordCollection holds FastqMultiRecords with pairwise distinct
+ * sequences. The records are stored contiguously, their position is the
+ * record id. Record ids are stable until the collection is compacted.
+ * The collection can be moved but not copied, the records refer to its
+ * PackedSequenceStore.
+ * The lookup table uses linear probing and has a power of two size.
+ */
+template<typename TSequencingSpec>
+struct FastqMultiRecordCollection {
+    typedef FastqMultiRecord<TSequencingSpec>       TMRec;
+    typedef typename TMRec::TSequence               TSequence;
+    typedef std::vector<TMRec>                      TRecList;
+    typedef typename TRecList::const_iterator       TRecListIt;
+    typedef std::vector<FastqMultiRecordSlot>       TSlots;
 
     static uint64_t const NO_MATCH = std::numeric_limits<uint64_t>::max();
 
-    typedef std::unordered_map<TMRec::TSequence, TMRec*> TRevSeqMap;
-    typedef std::unordered_map<TMRec::TSequence, TRevSeqMap> TFwSeqMap;
-    typedef std::unordered_map<TMRec::TSequence, TFwSeqMap> TBcMap;
-
     TRecList multiRecords;
-    TBcMap bcMap;
+    TSlots slots;
+    PackedSequenceStore seqStore;   // The packed sequences of the records
+    ReadIdStore readIds;
+    ReadIdTable readIdTable;    // The IDs of the inserted reads, only filled while reading the input
+    bool repeatedReadIds;       // Whether a read ID was inserted into more than one record
+
+    FastqMultiRecordCollection() : repeatedReadIds(false) {}
 };
 
 /*-------------------------------------------------------------------------------
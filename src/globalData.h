@@ -25,6 +25,7 @@
 #include <iostream>
 
 #include <seqan/index.h>
+#include <seqan/find.h>
 #include <seqan/arg_parse.h>
 
 #include "runtime_options.h"
@@ -32,6 +33,8 @@
 #include "segment_meta.h"
 #include "logging.h"
 #include "fastq_io.h"
+#include "thread_pool.h"
+#include "scf_seed_table.h"
 
 using namespace seqan;
 
@@ -80,17 +83,26 @@ struct CdrReferences {
     typedef Index<TSegmentStringSet, IndexQGram<TShape, OpenAddressing> >       TQGramIndex;
     typedef String<SegmentMeta>                                                 TSegmentMetas;
     typedef String<BeginEndPos<unsigned> >                                      TSCFPos;
+    typedef String<Pattern<String<Dna5>, Myers<> > >                           TSCFPatterns;
 
     TSegmentStringSet rightSegs, leftSegs;                      // The sequences of the segments
     TSegCoreFragmentStringSet rightSCFs, leftSCFs;              // The sequences of the segment core fragments
     TSCFToSegIds leftSCFToSegIds, rightSCFToSegIds;             // For each core fragment the ids of the corresponding segments
-    TQGramIndex leftIndex, rightIndex;                          // The q-gram indices for the core fragments
+    TQGramIndex leftIndex, rightIndex;                          // The q-gram indices for the core fragments, see buildSCFIndices()
+    TSCFPatterns leftSCFPatterns, rightSCFPatterns;             // The Myers patterns for the core fragments, see buildSCFIndices()
+    SCFSeedTable leftSCFSeeds, rightSCFSeeds;                   // The k-mer seed tables for the core fragments, only built for '--scf-filter kmer'
+    TSCFToSegIds leftSCFWindowIds, rightSCFWindowIds;           // For each core fragment and segment the first segment with the same alignment window position, see buildSCFIndices()
+    TSCFToSegIds leftSCFWindowShared, rightSCFWindowShared;     // For each core fragment and segment the window length shared with that segment, from the SCF side
     String<SegmentMeta> leftMeta, rightMeta;                    // The meta information for the segments
     TSCFPos leftSCFPos, rightSCFPos;                            // For each segment the begin and end position of the core fragment
     StringSet<String<unsigned> > leftIdentOffsets,              // The left and right identity offsets
         rightIdentOffsets;
     String<unsigned> leftToFirstAllel, rightToFirstAllel;       // Map pointing to the ID of the first allel for all allels
     String<unsigned> leftSegToScfId, rightSegToScfId;           // Map from segment ID to SCF id
+    int leftSCFStart, rightSCFStart;                            // The SCF start positions relative to the motif position
+    unsigned leftSCFLength, rightSCFLength;                     // The SCF lengths, 0 if the SCFs were not built yet
+
+    CdrReferences() : leftSCFStart(0), rightSCFStart(0), leftSCFLength(0), rightSCFLength(0) {}
 };
 
 struct CdrOutputFiles {
@@ -105,12 +117,14 @@ struct CdrGlobalData {
     CdrReferences const &               references;
     SeqInputStreams<TSequencingType> &  input;
     CdrOutputFiles &                    outFiles;
+    ThreadPool *                        threadPool;     // Shared by all stages, NULL without multi-threading support
 
-    CdrGlobalData(CdrOptions const & _options, CdrReferences const & _references, SeqInputStreams<TSequencingType> & _input, CdrOutputFiles & _outFiles) : 
+    CdrGlobalData(CdrOptions const & _options, CdrReferences const & _references, SeqInputStreams<TSequencingType> & _input, CdrOutputFiles & _outFiles, ThreadPool * _threadPool) : 
         options(_options),
         references(_references),
         input(_input),
-        outFiles(_outFiles)
+        outFiles(_outFiles),
+        threadPool(_threadPool)
     {}
 };
 
@@ -236,5 +250,158 @@ inline CdrReferences::TSegCoreFragmentStringSet const & getSCFs(CdrReferences co
     return references.leftSCFs;
 }
 
+// ============================================================================
+// Getter for SCF seed tables
+// ============================================================================
+
+inline SCFSeedTable & getSCFSeedTable(CdrReferences & references, RightOverlap const)
+{
+    return references.rightSCFSeeds;
+}
+
+inline SCFSeedTable & getSCFSeedTable(CdrReferences & references, LeftOverlap const)
+{
+    return references.leftSCFSeeds;
+}
+
+inline SCFSeedTable const & getSCFSeedTable(CdrReferences const & references, RightOverlap const)
+{
+    return references.rightSCFSeeds;
+}
+
+inline SCFSeedTable const & getSCFSeedTable(CdrReferences const & references, LeftOverlap const)
+{
+    return references.leftSCFSeeds;
+}
+
+// ============================================================================
+// Getter for SCF alignment window ids
+// ============================================================================
+
+inline CdrReferences::TSCFToSegIds & getSCFWindowIds(CdrReferences & references, RightOverlap const)
+{
+    return references.rightSCFWindowIds;
+}
+
+inline CdrReferences::TSCFToSegIds & getSCFWindowIds(CdrReferences & references, LeftOverlap const)
+{
+    return references.leftSCFWindowIds;
+}
+
+inline CdrReferences::TSCFToSegIds const & getSCFWindowIds(CdrReferences const & references, RightOverlap const)
+{
+    return references.rightSCFWindowIds;
+}
+
+inline CdrReferences::TSCFToSegIds const & getSCFWindowIds(CdrReferences const & references, LeftOverlap const)
+{
+    return references.leftSCFWindowIds;
+}
+
+inline CdrReferences::TSCFToSegIds & getSCFWindowShared(CdrReferences & references, RightOverlap const)
+{
+    return references.rightSCFWindowShared;
+}
+
+inline CdrReferences::TSCFToSegIds & getSCFWindowShared(CdrReferences & references, LeftOverlap const)
+{
+    return references.leftSCFWindowShared;
+}
+
+inline CdrReferences::TSCFToSegIds const & getSCFWindowShared(CdrReferences const & references, RightOverlap const)
+{
+    return references.rightSCFWindowShared;
+}
+
+inline CdrReferences::TSCFToSegIds const & getSCFWindowShared(CdrReferences const & references, LeftOverlap const)
+{
+    return references.leftSCFWindowShared;
+}
+
+// ============================================================================
+// Alignment windows
+// ============================================================================
+
+/**
+ * The part of a gene segment that is aligned to a read. It begins (J) or ends
+ * (V) with the motif and is extended if the SCF is shifted into the CDR3
+ * region.
+ *
+ * @special Left overlap
+ */
+inline BeginEndPos<unsigned> getAlignmentWindow(CdrReferences const & references, unsigned const segId, int const shift,
+        LeftOverlap const)
+{
+    unsigned endPos = references.leftMeta[segId].motifPos + 3;
+    if (shift > 0)
+        endPos += shift;
+    return BeginEndPos<unsigned>(0, endPos);
+}
+
+/**
+ * @special Right overlap
+ */
+inline BeginEndPos<unsigned> getAlignmentWindow(CdrReferences const & references, unsigned const segId, int const shift,
+        RightOverlap const)
+{
+    unsigned beginPos = references.rightMeta[segId].motifPos;
+    if (shift < 0)
+        beginPos += shift;
+    return BeginEndPos<unsigned>(beginPos, length(references.rightSegs[segId]));
+}
+
+// ============================================================================
+// Getter for SCF Myers patterns
+// ============================================================================
+
+inline CdrReferences::TSCFPatterns & getSCFPatterns(CdrReferences & references, RightOverlap const)
+{
+    return references.rightSCFPatterns;
+}
+
+inline CdrReferences::TSCFPatterns & getSCFPatterns(CdrReferences & references, LeftOverlap const)
+{
+    return references.leftSCFPatterns;
+}
+
+inline CdrReferences::TSCFPatterns const & getSCFPatterns(CdrReferences const & references, RightOverlap const)
+{
+    return references.rightSCFPatterns;
+}
+
+inline CdrReferences::TSCFPatterns const & getSCFPatterns(CdrReferences const & references, LeftOverlap const)
+{
+    return references.leftSCFPatterns;
+}
+
+// ============================================================================
+// Getter for SCF q-gram indices
+// ============================================================================
+
+inline CdrReferences::TQGramIndex & getSCFIndex(CdrReferences & references, RightOverlap const)
+{
+    return references.rightIndex;
+}
+
+inline CdrReferences::TQGramIndex & getSCFIndex(CdrReferences & references, LeftOverlap const)
+{
+    return references.leftIndex;
+}
+
+/**
+ * The SWIFT pattern can only be constructed over a non-const index. Once all
+ * fibres were built by buildSCFIndices(), the index is only read from, hence
+ * it can be shared among the analysis threads.
+ */
+inline CdrReferences::TQGramIndex & getSCFIndex(CdrReferences const & references, RightOverlap const)
+{
+    return const_cast<CdrReferences::TQGramIndex &>(references.rightIndex);
+}
+
+inline CdrReferences::TQGramIndex & getSCFIndex(CdrReferences const & references, LeftOverlap const)
+{
+    return const_cast<CdrReferences::TQGramIndex &>(references.leftIndex);
+}
+
 
 #endif
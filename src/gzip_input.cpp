@@ -0,0 +1,425 @@
+// ============================================================================
+// IMSEQ - An immunogenetic sequence analysis tool
+// (C) Charite, Universitaetsmedizin Berlin
+// Author: Leon Kuchenbecker
+// ============================================================================
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License version 2 as published by
+// the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+// ============================================================================
+
+#include "gzip_input.h"
+
+#include <cstring>
+
+#ifdef __WITHCDR3THREADS__
+#include <zlib.h>
+#endif
+
+// ============================================================================
+// Constants
+// ============================================================================
+
+#ifdef __WITHCDR3THREADS__
+
+// Size of the compressed input blocks read by the plain gzip reader
+static size_t const GZIP_READ_SIZE = 1 << 18;
+// Size of the inflated chunks produced by the plain gzip reader
+static size_t const GZIP_CHUNK_SIZE = 1 << 20;
+// Number of inflated chunks the plain gzip reader may run ahead
+static size_t const GZIP_READ_AHEAD = 32;
+// Compressed size of the BGZF block groups inflated by one pool task
+static size_t const BGZF_GROUP_SIZE = 1 << 20;
+
+// ============================================================================
+// Functions
+// ============================================================================
+
+static uint16_t _readLE16(unsigned char const * buf)
+{
+    return buf[0] | (buf[1] << 8);
+}
+
+static uint32_t _readLE32(unsigned char const * buf)
+{
+    return buf[0] | (buf[1] << 8) | (buf[2] << 16) | (static_cast<uint32_t>(buf[3]) << 24);
+}
+
+/**
+ * Checks whether a buffer starts with a gzip member header carrying a BGZF
+ * block size subfield and extracts the block size.
+ */
+static bool _parseBgzfHeader(unsigned char const * buf, size_t len, uint32_t & blockSize)
+{
+    if (len < 12 || buf[0] != 0x1f || buf[1] != 0x8b || buf[2] != 8 || (buf[3] & 4) == 0)
+        return false;
+    size_t xlen = _readLE16(buf + 10);
+    if (len < 12 + xlen)
+        return false;
+    for (size_t pos = 12; pos + 4 <= 12 + xlen; ) {
+        size_t slen = _readLE16(buf + pos + 2);
+        if (buf[pos] == 'B' && buf[pos + 1] == 'C' && slen == 2 && pos + 6 <= 12 + xlen) {
+            blockSize = _readLE16(buf + pos + 4) + 1;
+            return true;
+        }
+        pos += 4 + slen;
+    }
+    return false;
+}
+
+// ============================================================================
+// GzipInputBuf
+// ============================================================================
+
+GzipInputBuf::GzipInputBuf(std::istream & _source, bool bgzf, unsigned threads, ThreadPool * sharedPool) :
+    source(_source),
+    chunks(bgzf ? 4 * (threads > 0 ? threads : 1) : GZIP_READ_AHEAD),
+    pool(sharedPool),
+    consumedCompressed(0)
+{
+    setg(NULL, NULL, NULL);
+    if (bgzf) {
+        if (pool == NULL) {
+            ownPool.reset(new ThreadPool(threads > 0 ? threads : 1));
+            pool = ownPool.get();
+        }
+        reader = std::thread(&GzipInputBuf::readBgzfBlocks, this);
+    } else {
+        reader = std::thread(&GzipInputBuf::inflateMembers, this);
+    }
+}
+
+GzipInputBuf::~GzipInputBuf()
+{
+    chunks.close();
+    reader.join();
+    ownPool.reset();
+}
+
+uint64_t GzipInputBuf::compressedPosition() const
+{
+    return consumedCompressed;
+}
+
+GzipInputBuf::int_type GzipInputBuf::underflow()
+{
+    if (gptr() < egptr())
+        return traits_type::to_int_type(*gptr());
+    while (true) {
+        std::future<Chunk> next;
+        if (!chunks.pop(next))
+            return traits_type::eof();
+        current = next.get();
+        consumedCompressed = current.compressedEnd;
+        if (!current.data.empty())
+            break;
+    }
+    char * begin = &current.data[0];
+    setg(begin, begin, begin + current.data.size());
+    return traits_type::to_int_type(*gptr());
+}
+
+/**
+ * Passes an error to the consumer and terminates the production of chunks
+ */
+void GzipInputBuf::fail(std::string const & message)
+{
+    std::promise<Chunk> error;
+    error.set_exception(std::make_exception_ptr(message));
+    chunks.push(error.get_future());
+    chunks.close();
+}
+
+/**
+ * Reader thread for non-BGZF gzip files. Inflates all gzip members of the
+ * source into chunks of GZIP_CHUNK_SIZE.
+ */
+void GzipInputBuf::inflateMembers()
+{
+    z_stream zs;
+    std::memset(&zs, 0, sizeof(zs));
+    if (inflateInit2(&zs, 15 + 16) != Z_OK) {
+        fail("Could not initialize zlib");
+        return;
+    }
+
+    std::vector<char> in(GZIP_READ_SIZE);
+    uint64_t readBytes = 0;
+    uint64_t readMembers = 0;
+    bool memberOpen = false;
+    bool inputDone = false;
+    std::string error;
+
+    while (!inputDone && error.empty()) {
+        Chunk chunk;
+        chunk.data.resize(GZIP_CHUNK_SIZE);
+        zs.next_out  = reinterpret_cast<Bytef *>(&chunk.data[0]);
+        zs.avail_out = GZIP_CHUNK_SIZE;
+        while (zs.avail_out > 0) {
+            if (zs.avail_in == 0) {
+                source.read(&in[0], in.size());
+                if (source.bad()) {
+                    error = "An I/O error occurred while reading compressed input";
+                    break;
+                }
+                if (source.gcount() == 0) {
+                    inputDone = true;
+                    if (memberOpen)
+                        error = "Unexpected end of compressed input file";
+                    break;
+                }
+                readBytes += source.gcount();
+                zs.next_in  = reinterpret_cast<Bytef *>(&in[0]);
+                zs.avail_in = source.gcount();
+            }
+            // Multi-member files: continue with the next member unless only
+            // padding follows
+            if (!memberOpen && readMembers > 0 && zs.next_in[0] != 0x1f) {
+                zs.avail_in = 0;
+                inputDone = true;
+                break;
+            }
+            int ret = inflate(&zs, Z_NO_FLUSH);
+            if (ret == Z_STREAM_END) {
+                memberOpen = false;
+                ++readMembers;
+                inflateReset(&zs);
+            } else if (ret == Z_OK) {
+                memberOpen = true;
+            } else {
+                error = std::string("Corrupt compressed input (zlib: ") + (zs.msg != NULL ? zs.msg : "unknown error") + ")";
+                break;
+            }
+        }
+        chunk.data.resize(GZIP_CHUNK_SIZE - zs.avail_out);
+        chunk.compressedEnd = readBytes - zs.avail_in;
+        std::promise<Chunk> ready;
+        ready.set_value(std::move(chunk));
+        if (!chunks.push(ready.get_future()))
+            break;
+    }
+    inflateEnd(&zs);
+
+    if (!error.empty())
+        fail(error);
+    else
+        chunks.close();
+}
+
+/**
+ * Inflates a group of complete BGZF blocks. Executed on the thread pool.
+ */
+GzipInputBuf::Chunk GzipInputBuf::inflateBgzfBlocks(std::vector<char> const & blocks, std::vector<size_t> const & blockEnds, uint64_t compressedEnd)
+{
+    Chunk chunk;
+    chunk.compressedEnd = compressedEnd;
+
+    unsigned char const * buf = reinterpret_cast<unsigned char const *>(blocks.data());
+    size_t total = 0;
+    for (size_t end : blockEnds)
+        total += _readLE32(buf + end - 4);
+    chunk.data.resize(total);
+
+    z_stream zs;
+    std::memset(&zs, 0, sizeof(zs));
+    if (inflateInit2(&zs, 15 + 16) != Z_OK)
+        throw std::string("Could not initialize zlib");
+
+    char dummy;
+    size_t begin = 0, out = 0;
+    for (size_t end : blockEnds) {
+        uint32_t isize = _readLE32(buf + end - 4);
+        zs.next_in   = const_cast<Bytef *>(buf + begin);
+        zs.avail_in  = end - begin;
+        zs.next_out  = reinterpret_cast<Bytef *>(isize > 0 ? &chunk.data[out] : &dummy);
+        zs.avail_out = isize;
+        int ret = inflate(&zs, Z_FINISH);
+        if (ret != Z_STREAM_END || zs.avail_out != 0) {
+            inflateEnd(&zs);
+            throw std::string("Corrupt BGZF block in compressed input");
+        }
+        inflateReset(&zs);
+        out += isize;
+        begin = end;
+    }
+    inflateEnd(&zs);
+    return chunk;
+}
+
+/**
+ * Reader thread for BGZF files. Reads groups of blocks and hands them to the
+ * thread pool for inflation.
+ */
+void GzipInputBuf::readBgzfBlocks()
+{
+    uint64_t readBytes = 0;
+    bool inputDone = false;
+    try {
+        while (!inputDone) {
+            std::shared_ptr<std::vector<char> > blocks(new std::vector<char>());
+            std::shared_ptr<std::vector<size_t> > blockEnds(new std::vector<size_t>());
+            blocks->reserve(BGZF_GROUP_SIZE + (1 << 16));
+            while (blocks->size() < BGZF_GROUP_SIZE) {
+                // Fixed header part and extra field
+                size_t blockBegin = blocks->size();
+                blocks->resize(blockBegin + 12);
+                source.read(&(*blocks)[blockBegin], 12);
+                if (source.gcount() == 0 && !source.bad()) {
+                    blocks->resize(blockBegin);
+                    inputDone = true;
+                    break;
+                }
+                if (source.gcount() != 12)
+                    throw std::string("Unexpected end of BGZF compressed input file");
+                size_t xlen = _readLE16(reinterpret_cast<unsigned char *>(&(*blocks)[blockBegin + 10]));
+                blocks->resize(blockBegin + 12 + xlen);
+                source.read(&(*blocks)[blockBegin + 12], xlen);
+                uint32_t blockSize = 0;
+                if (static_cast<size_t>(source.gcount()) != xlen
+                        || !_parseBgzfHeader(reinterpret_cast<unsigned char *>(&(*blocks)[blockBegin]), 12 + xlen, blockSize)
+                        || blockSize < 12 + xlen + 8)
+                    throw std::string("Invalid block in BGZF compressed input file");
+                // Remainder of the block
+                size_t rest = blockSize - 12 - xlen;
+                blocks->resize(blockBegin + blockSize);
+                source.read(&(*blocks)[blockBegin + 12 + xlen], rest);
+                if (static_cast<size_t>(source.gcount()) != rest)
+                    throw std::string("Unexpected end of BGZF compressed input file");
+                blockEnds->push_back(blocks->size());
+                readBytes += blockSize;
+            }
+            if (blockEnds->empty())
+                break;
+            uint64_t compressedEnd = readBytes;
+            std::future<Chunk> chunk = pool->enqueue<Chunk>([blocks, blockEnds, compressedEnd]() {
+                return inflateBgzfBlocks(*blocks, *blockEnds, compressedEnd);
+            });
+            if (!chunks.push(std::move(chunk)))
+                return;
+        }
+    } catch (std::string const & message) {
+        fail(message);
+        return;
+    }
+    chunks.close();
+}
+
+#endif // Multi-threading enabled
+
+// ============================================================================
+// InputFile
+// ============================================================================
+
+InputFile::InputFile() : threads(1), pool(NULL) {}
+
+InputFile::~InputFile()
+{
+    close();
+}
+
+/**
+ * Opens a file and, if it is gzip compressed, sets up the decompression.
+ * Returns false if the file could not be opened.
+ */
+bool InputFile::open(std::string const & _path, unsigned _threads, ThreadPool * _pool)
+{
+    close();
+    path = _path;
+    threads = _threads;
+    pool = _pool;
+    if (mapping.open(path))
+        return true;
+    file.clear();
+    file.open(path.c_str(), std::ios::in | std::ios::binary);
+    if (!file.good())
+        return false;
+#ifdef __WITHCDR3THREADS__
+    unsigned char header[18];
+    file.read(reinterpret_cast<char *>(header), sizeof(header));
+    size_t headerLen = file.gcount();
+    file.clear();
+    file.seekg(0);
+    if (headerLen >= 2 && header[0] == 0x1f && header[1] == 0x8b) {
+        uint32_t blockSize;
+        bool bgzf = _parseBgzfHeader(header, headerLen, blockSize);
+        gzipBuf.reset(new GzipInputBuf(file, bgzf, threads, pool));
+        gzipStream.reset(new std::istream(gzipBuf.get()));
+        gzipStream->exceptions(std::ios::badbit);
+    }
+#endif
+    return file.good();
+}
+
+/**
+ * Re-opens the file to read it again from the beginning
+ */
+bool InputFile::reopen()
+{
+    std::string _path = path;
+    return open(_path, threads, pool);
+}
+
+void InputFile::close()
+{
+#ifdef __WITHCDR3THREADS__
+    gzipStream.reset();
+    gzipBuf.reset();
+#endif
+    mapping.close();
+    if (file.is_open())
+        file.close();
+}
+
+/**
+ * The stream to parse, delivering the uncompressed contents of gzip
+ * compressed files if they are decompressed by a GzipInputBuf.
+ */
+std::istream & InputFile::stream()
+{
+#ifdef __WITHCDR3THREADS__
+    if (gzipStream)
+        return *gzipStream;
+#endif
+    return file;
+}
+
+/**
+ * The reader to use for memory mapped FASTQ files, NULL for other files
+ */
+FastqMmapReader * InputFile::mappedFastq()
+{
+    return mapping.isOpen() ? &mapping : NULL;
+}
+
+FastqMmapReader const * InputFile::mappedFastq() const
+{
+    return mapping.isOpen() ? &mapping : NULL;
+}
+
+/**
+ * Returns the number of bytes of the file on disk consumed by the parser
+ */
+uint64_t InputFile::position()
+{
+    if (mapping.isOpen())
+        return mapping.position();
+#ifdef __WITHCDR3THREADS__
+    if (gzipBuf)
+        return gzipBuf->compressedPosition();
+#endif
+    std::streampos pos = file.rdbuf()->pubseekoff(0, std::ios_base::cur, std::ios_base::in);
+    if (pos == std::streampos(-1))
+        return 0;
+    return static_cast<uint64_t>(pos);
+}
@@ -0,0 +1,141 @@
+// ============================================================================
+// IMSEQ - An immunogenetic sequence analysis tool
+// (C) Charite, Universitaetsmedizin Berlin
+// Author: Leon Kuchenbecker
+// ============================================================================
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License version 2 as published by
+// the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+// ============================================================================
+
+// ============================================================================
+// HEADER FILE DESCRIPTION
+// ============================================================================
+// Decompression of gzip compressed input files ahead of the FASTQ parser.
+//
+// BGZF (blocked gzip) files consist of independent gzip members of at most
+// 64kb. Their blocks are read in groups by a reader thread and inflated in
+// parallel on a thread pool. Other gzip files, including multi-member files,
+// are inflated by a dedicated thread into a read-ahead buffer. In both cases
+// the parser only consumes inflated chunks in file order.
+//
+// Uncompressed FASTQ files are memory mapped and read by a FastqMmapReader
+// instead, see fastq_mmap.h. Without multi-threading support, InputFile
+// simply exposes the file stream of other files and decompression is left to
+// SeqAn.
+// ============================================================================
+
+#ifndef IMSEQ_GZIP_INPUT_H
+#define IMSEQ_GZIP_INPUT_H
+
+#include "thread_check.h"
+
+#include <fstream>
+#include <istream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "fixed_size_types.h"
+#include "fastq_mmap.h"
+#include "thread_pool.h"
+
+#ifdef __WITHCDR3THREADS__
+
+#include <atomic>
+#include <future>
+#include <streambuf>
+#include <thread>
+
+#include "bounded_queue.h"
+
+// ============================================================================
+// Tags, Classes, Enums
+// ============================================================================
+
+/**
+ * A stream buffer delivering the inflated contents of a gzip compressed
+ * source stream. Inflation runs ahead of the consumer in separate threads.
+ * BGZF blocks are inflated on the passed pool, or on an own pool with the
+ * given number of threads if none is passed. Errors are reported as
+ * std::string exceptions upon reading.
+ */
+class GzipInputBuf : public std::streambuf {
+
+    public:
+        GzipInputBuf(std::istream & source, bool bgzf, unsigned threads, ThreadPool * sharedPool = NULL);
+        ~GzipInputBuf();
+        uint64_t compressedPosition() const;
+
+    protected:
+        int_type underflow();
+
+    private:
+        // A piece of inflated data and the offset in the compressed source
+        // right behind the compressed data it stems from
+        struct Chunk {
+            std::vector<char> data;
+            uint64_t compressedEnd;
+            Chunk() : compressedEnd(0) {}
+        };
+
+        void inflateMembers();
+        void readBgzfBlocks();
+        static Chunk inflateBgzfBlocks(std::vector<char> const & blocks, std::vector<size_t> const & blockEnds, uint64_t compressedEnd);
+        void fail(std::string const & message);
+
+        std::istream & source;
+        BoundedQueue<std::future<Chunk> > chunks;
+        std::unique_ptr<ThreadPool> ownPool;
+        ThreadPool * pool;
+        std::thread reader;
+        Chunk current;
+        std::atomic<uint64_t> consumedCompressed;
+};
+
+#endif // Multi-threading enabled
+
+/**
+ * An input file opened for parsing. Uncompressed FASTQ files are memory
+ * mapped, mappedFastq() then returns the reader to use instead of stream().
+ * Gzip compressed files are inflated by a GzipInputBuf if multi-threading is
+ * enabled, stream() then delivers the uncompressed contents. position()
+ * returns the number of bytes of the file on disk consumed so far.
+ */
+class InputFile {
+
+    public:
+        InputFile();
+        ~InputFile();
+        bool open(std::string const & path, unsigned threads, ThreadPool * pool = NULL);
+        bool reopen();
+        void close();
+        std::istream & stream();
+        FastqMmapReader * mappedFastq();
+        FastqMmapReader const * mappedFastq() const;
+        uint64_t position();
+
+    private:
+        std::string path;
+        unsigned threads;
+        ThreadPool * pool;
+        std::ifstream file;
+        FastqMmapReader mapping;
+#ifdef __WITHCDR3THREADS__
+        std::unique_ptr<GzipInputBuf> gzipBuf;
+        std::unique_ptr<std::istream> gzipStream;
+#endif
+};
+
+#endif
@@ -64,9 +64,46 @@ bool checkSameSegment(String<SegmentMeta> const & meta, unsigned i, unsigned j)
     return (meta[i].segId == meta[j].segId);
 }
 
+/**
+ * Entry point of the 'imseq index' mode. Prepares the references and writes
+ * them to a reference index file.
+ */
+int main_index(int argc, char const ** argv)
+{
+    CdrOptions options;
+    CdrReferences references;
+    CharString indexPath;
+
+    parseIndexCommandLine(options, indexPath, argc, argv);
+
+    std::cerr << "===== Building reference index\n";
+    loadReferences(references, options);
+    std::cerr << "  |-- Read " << length(references.leftSegs) << " reference V segments." << std::endl;
+    std::cerr << "  |-- Read " << length(references.rightSegs) << " reference J segments." << std::endl;
+
+    buildRightSCFs(references, options.jSCFOffset, options.jSCFLength);
+    if (options.vSCFLength != AUTO_TUNE)
+        buildLeftSCFs(references, 3 - static_cast<int>(options.vSCFLength) + options.vSCFOffset, options.vSCFLength);
+    else
+        std::cerr << "  |-- No V SCF length specified, V SCFs will be built at analysis time" << std::endl;
+
+    if (!writeReferenceIndex(indexPath, references))
+        return 1;
+
+    std::cerr << "===== Reference index written to " << indexPath << std::endl;
+    return 0;
+}
+
 // Program entry point
 int main(int argc, char ** argv)
 {
+    // ============================================================================
+    // Dispatch the 'imseq index' mode
+    // ============================================================================
+
+    if (argc > 1 && std::string(argv[1]) == "index")
+        return main_index(argc - 1, const_cast<char const **>(argv + 1));
+
     // ============================================================================
     // Parse the command line options
     // ============================================================================
@@ -95,28 +132,43 @@ int main(int argc, char ** argv)
 
     try
     {
+        // One worker pool shared by all stages
+#ifdef __WITHCDR3THREADS__
+        ThreadPool threadPool(options.jobs, options.pinThreads);
+        ThreadPool * sharedPool = &threadPool;
+#else
+        ThreadPool * sharedPool = NULL;
+#endif
         if (options.pairedEnd)
         {
             SeqInputStreams<PairedEnd> is(
                     inFilePaths[0],
                     inFilePaths[1],
-                    computeFileSize(inFilePaths[0]) + computeFileSize(inFilePaths[1]));
+                    options.jobs,
+                    sharedPool);
+            if (options.inputPreScan)
+                preScanInputSize(is);
             CdrGlobalData<PairedEnd> global(
                     options,
                     references,
                     is,
-                    outFiles
+                    outFiles,
+                    sharedPool
                     );
             return main_generic(global, options, references);
         } else {
             SeqInputStreams<SingleEnd> is(
                     inFilePaths[0],
-                    computeFileSize(inFilePaths[0]));
+                    options.jobs,
+                    sharedPool);
+            if (options.inputPreScan)
+                preScanInputSize(is);
             CdrGlobalData<SingleEnd> global(
                     options,
                     references,
                     is,
-                    outFiles
+                    outFiles,
+                    sharedPool
                     );
             return main_generic(global, options, references);
         }
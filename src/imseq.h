@@ -31,6 +31,8 @@
 #include <iomanip>
 #include <algorithm>
 #include <limits>
+#include <atomic>
+#include <chrono>
 
 #include <seqan/basic.h>
 #include <seqan/sequence.h>
@@ -50,6 +52,7 @@
 #include "clone.h"
 #include "cluster_log.h"
 #include "vjMatching.h"
+#include "block_arena.h"
 #include "overlap_specs.h"
 #include "referencePreparation.h"
 #include "timeFormat.h"
@@ -90,15 +93,6 @@ void PressEnterToContinue()
 }
 
 
-// ============================================================================
-// Locks
-// ============================================================================
-
-#ifdef __WITHCDR3THREADS__
-std::mutex MUTEX_ofstream_rejectlog;
-std::mutex STDCOUT_LOCK;
-#endif
-
 // ============================================================================
 // Forwards
 // ============================================================================
@@ -198,6 +192,9 @@ std::mutex CACHE_STORE_MUTEX;
 typedef std::map<Clone<Dna5>, ClusterResult>     TCloneStore;
 typedef std::vector<Dna5CloneStore::value_type*> TCloneStorePtrs;
 
+/// Number of clonotypes per parallelFor() task in runClonotypeClustering()
+static size_t const CLONOTYPE_CLUSTERING_GRAIN = 16;
+
 /**
  * Transforms a String<T> into a String<char>, making use of convert() and
  * using specified characters for element separation as well as begin / end
@@ -342,15 +339,12 @@ seqan::SeqFileIn & getInfoStream(SeqInputStreams<PairedEnd> & input) {
 }
 
 void resetStreams(SeqInputStreams<SingleEnd> & input) {
-    close(input.stream);
-    open(input.stream, input.path.c_str());
+    reopenOrExit(input.stream, input.rawStream, input.path);
 }
 
 void resetStreams(SeqInputStreams<PairedEnd> & input) {
-    close(input.fwStream);
-    close(input.revStream);
-    open(input.fwStream, input.fwPath.c_str());
-    open(input.revStream, input.revPath.c_str());
+    reopenOrExit(input.fwStream, input.fwRawStream, input.fwPath);
+    reopenOrExit(input.revStream, input.revRawStream, input.revPath);
 }
 
 
@@ -1045,33 +1039,24 @@ inline void runClonotypeClustering(TCdrGlobalData & global, Dna5CloneStore & clo
 
     // -!- ==========================================================================
     // -!- Multithreading dependent code - if compiled with multi-threading support,
-    // -!- a ThreadPool is created and handles one task for every for-loop
-    // -!- iteration.  Otherwise, the for-loop does not enqueue tasks in the thread
-    // -!- pool but actually executes the function.
+    // -!- the shared ThreadPool processes the clonotypes in parallel ranges.
+    // -!- Otherwise, the for-loop actually executes the function.
     // -!- ==========================================================================
     std::clock_t clockBeforeClustAlign = std::clock();
     {
-
-#ifdef __WITHCDR3THREADS__
-        ThreadPool threadPool(global.options.jobs);
-#endif
-
-        unsigned __cnt = 0;
-        for (TCloneStorePtrs::const_iterator cluster1 = clonePtrsBySize.begin(); cluster1 != clonePtrsBySize.end(); ++cluster1, ++__cnt) {
-            TCloneStorePtrs::const_iterator cluster2 = cluster1;
-            ++cluster2;
-#ifdef __WITHCDR3THREADS__
-            threadPool.enqueue<void>([cluster1, cluster2, &clonePtrsBySize, &global, &lqPositionStore, &clusterPairsByMinor, &clusterStats, &progBar]()
-                    {
-#endif
-                    findClusterMates(*cluster1, cluster2, clonePtrsBySize.end(), global, lqPositionStore, clusterPairsByMinor, clusterStats, progBar);
+        auto findMates = [&clonePtrsBySize, &global, &lqPositionStore, &clusterPairsByMinor, &clusterStats, &progBar](size_t i)
+        {
+            TCloneStorePtrs::const_iterator cluster1 = clonePtrsBySize.begin() + i;
+            findClusterMates(*cluster1, cluster1 + 1, clonePtrsBySize.end(), global, lqPositionStore, clusterPairsByMinor, clusterStats, progBar);
+        };
 #ifdef __WITHCDR3THREADS__
-                    }
-                    );
+        // Only waits for the clustering, not for other tasks on the pool
+        global.threadPool->parallelFor(0, clonePtrsBySize.size(), CLONOTYPE_CLUSTERING_GRAIN, findMates)->wait();
+#else
+        for (size_t i = 0; i < clonePtrsBySize.size(); ++i)
+            findMates(i);
 #endif
-
-        }
-    } // Destructs ThreadPool, joins all threads
+    }
 
 
     progBar.clear();
@@ -1794,8 +1779,8 @@ inline void truncateRead(FastqRecord<PairedEnd> & fqRecord, unsigned len, unsign
 
 inline bool inStreamsAtEnd(SeqInputStreams<PairedEnd> const & inStreams) 
 {
-    bool s1End = atEnd(inStreams.fwStream);
-    bool s2End = atEnd(inStreams.revStream);
+    bool s1End = inputAtEnd(inStreams.fwStream, inStreams.fwRawStream);
+    bool s2End = inputAtEnd(inStreams.revStream, inStreams.revRawStream);
 
     if (s1End && s2End)
         return true;
@@ -1808,7 +1793,7 @@ inline bool inStreamsAtEnd(SeqInputStreams<PairedEnd> const & inStreams)
 
 inline bool inStreamsAtEnd(SeqInputStreams<SingleEnd> const & inStreams) 
 {
-    return atEnd(inStreams.stream);
+    return inputAtEnd(inStreams.stream, inStreams.rawStream);
 }
 
 inline CharString getTabSepSequences(QueryData<SingleEnd> const & qData, unsigned idx)
@@ -1824,10 +1809,6 @@ inline CharString getTabSepSequences(QueryData<PairedEnd> const & qData, unsigne
     return joined;
 }
 
-#ifdef __WITHCDR3THREADS__
-std::mutex MUTEX_processReads;
-std::mutex PCR_ERR_STAT_MUTEX;
-#endif
 template <typename TSequencingSpec, typename TGlobal>
 String<AnalysisResult> analyseReads(
         QueryData<TSequencingSpec>& queryData,       // [IN]  The query data with the reads to analyse
@@ -1839,7 +1820,7 @@ String<AnalysisResult> analyseReads(
 
     typedef typename QueryData<TSequencingSpec>::TSequence                      TSequence;
     typedef String<AnalysisResult>                              TResults;
-    typedef typename Infix<TSequence>::Type                     TInfix;
+    typedef typename Infix<TSequence const>::Type               TInfix;
     typedef SegmentMatch<typename Infix<TSequence const>::Type> TSegmentMatch;
 
     // ============================================================================
@@ -1925,13 +1906,11 @@ String<AnalysisResult> analyseReads(
             continue;
         }
 
-        TSequence modSeq = getVDJReadSequences(queryData)[i];
-
         // ============================================================================
         // Try to identify the CDR3 region and reject the read if that fails
         // ============================================================================
 
-        TInfix cdrInfix(modSeq);
+        TInfix cdrInfix(getVDJReadSequences(queryData)[i]);
         {
             RejectReason reject = findCDR3Region(cdrInfix, leftMatches[i], rightMatches[i], global);
             if (reject) {
@@ -2086,19 +2065,6 @@ String<AnalysisResult> analyseReads(
 
     }
 
-    // ============================================================================
-    // Write the detailed results for each read to a file if requested. Store the
-    // new results in the cache store.
-    // THREADS: *Not* safe. Alters the global clusterStore, writes to a global
-    //          file.
-    // ============================================================================
-
-#ifdef __WITHCDR3THREADS__
-    std::lock_guard<std::mutex> guard(MUTEX_processReads);
-    std::lock_guard<std::mutex> guard2(MUTEX_ofstream_rejectlog);
-    std::unique_lock<std::mutex> lock(CACHE_STORE_MUTEX);
-#endif
-
     return results;
 }
 
@@ -2135,74 +2101,145 @@ String<AnalysisResult> analyseReads(
     return res;
 }
 
-#ifdef __WITHCDR3THREADS__
-std::mutex MUTEX_take_from_multicollection;
-std::mutex MUTEX_write_global_results;
-#endif
+/**
+ * Per task statistics of processReads(). Time spent waiting for locks is
+ * reported relative to the total time spent in processReads().
+ */
+struct ProcessReadsStats {
+    uint64_t nBlocks;
+    uint64_t nRecords;
+    size_t   minBlockSize;
+    size_t   maxBlockSize;
+    double   totalSeconds;
+    double   lockWaitSeconds;
+    uint64_t nArenaAllocations;     // Allocations served by the block arena
+    uint64_t nArenaChunks;          // Heap allocations made by the block arena
+
+    ProcessReadsStats() : nBlocks(0), nRecords(0), minBlockSize(std::numeric_limits<size_t>::max()),
+        maxBlockSize(0), totalSeconds(0), lockWaitSeconds(0), nArenaAllocations(0), nArenaChunks(0) {}
+};
+
+/// Analysis time per block processReads() aims for
+static double const ANALYSIS_BLOCK_TARGET_SECONDS = 0.05;
+/// Bounds of the analysis block size
+static size_t const ANALYSIS_MIN_BLOCK_SIZE = 16;
+static size_t const ANALYSIS_MAX_BLOCK_SIZE = 100000;
+
+/**
+ * Chooses the size of the blocks claimed by one processReads() task. After
+ * each block, the size is scaled towards the number of records that can be
+ * analysed in ANALYSIS_BLOCK_TARGET_SECONDS by this task, changing at most by
+ * a factor of two per block. Close to the end of the record list, blocks are
+ * limited to a share of the remaining records such that all tasks finish at
+ * about the same time.
+ */
+class AnalysisBlockSizer {
+    size_t size;
+
+public:
+    explicit AnalysisBlockSizer(size_t initialSize)
+        : size(std::min(ANALYSIS_MAX_BLOCK_SIZE, std::max(ANALYSIS_MIN_BLOCK_SIZE, initialSize))) {}
+
+    /**
+     * Returns the size of the next block given the number of records not yet
+     * claimed and the number of tasks competing for them.
+     */
+    size_t next(size_t const remaining, size_t const nTasks) const
+    {
+        size_t const tailShare = (remaining + 2 * nTasks - 1) / (2 * nTasks);
+        return std::max(ANALYSIS_MIN_BLOCK_SIZE, std::min(size, tailShare));
+    }
+
+    /**
+     * Reports the analysis time of a block of the given size.
+     */
+    void update(size_t const blockSize, double const seconds)
+    {
+        double scaled = 2.0 * size;
+        if (seconds > 0)
+            scaled = std::max(0.5 * size, std::min(scaled, ANALYSIS_BLOCK_TARGET_SECONDS * blockSize / seconds));
+        size = std::min(ANALYSIS_MAX_BLOCK_SIZE, std::max(ANALYSIS_MIN_BLOCK_SIZE, static_cast<size_t>(scaled)));
+    }
+};
+
+inline double secondsSince(std::chrono::steady_clock::time_point const & start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
 template<typename TSeqSpec>
 void processReads(
-        typename Iterator<String<AnalysisResult>, Rooted>::Type & resultIt,  // OUT: The map of clone counts to insert the results into
-        ProgressBar& progBar,       //  IN: The ProgressBar object to report to
-        typename FastqMultiRecordCollection<TSeqSpec>::TRecListIt & beginIt,
-        typename FastqMultiRecordCollection<TSeqSpec>::TRecListIt & endIt,
-        CdrGlobalData<TSeqSpec> & global)           //  IN: The user specified parameters
+        String<AnalysisResult> & results,                   // OUT: One pre-sized slot per record
+        ProgressBar& progBar,                               //  IN: The ProgressBar object to report to
+        std::atomic<size_t> & nextBlockBegin,               //  IN: The first record not claimed by any task
+        typename FastqMultiRecordCollection<TSeqSpec>::TRecList const & records,
+        CdrGlobalData<TSeqSpec> & global,                   //  IN: The user specified parameters
+        size_t const nTasks,                                //  IN: The number of tasks running processReads()
+        ProcessReadsStats & stats)                          // OUT: Statistics of this task
 {
     typedef QueryDataCollection<TSeqSpec>  TQueryDataCollection;
-    while (true) { // Breaks when no more reads can be read from the input streams
+    std::chrono::steady_clock::time_point const start = std::chrono::steady_clock::now();
+    AnalysisBlockSizer blockSizer(global.options.maxBlockSize);
+    BlockArena & arena = threadBlockArena();
+    uint64_t const arenaAllocations = arena.nAllocations;
+    uint64_t const arenaChunks = arena.nChunks;
+    // Scratch space reused for all blocks of this task
+    String<FastqMultiRecord<TSeqSpec> const *> todo;
+    TQueryDataCollection qdataColl;
+    while (true) { // Breaks when all records were claimed
 
         // ============================================================================
-        // Extract block of records for analysis
+        // Claim a block of records for analysis. The blocks are disjoint, so are
+        // the result slots written below.
         // ============================================================================
 
-        String<FastqMultiRecord<TSeqSpec> const *> todo;
-        TQueryDataCollection qdataColl;
-        typename Iterator<String<AnalysisResult>, Rooted>::Type localResultIt;
-        { // Scope for lock
-#ifdef __WITHCDR3THREADS__
-            std::unique_lock<std::mutex> lock(MUTEX_take_from_multicollection);
-#endif
-            localResultIt = resultIt;
-            uint64_t n_items = 0;
-            for (; beginIt != endIt && n_items < global.options.maxBlockSize; ++beginIt, ++resultIt)
-            {
-                appendValue(todo, &(*beginIt));
-                ++n_items;
-            }
-
-            // Break loop if we are finished
-            if (n_items == 0)
-                break;
+        size_t const claimed = nextBlockBegin.load();
+        size_t const blockSize = blockSizer.next(records.size() - std::min(claimed, records.size()), nTasks);
+        size_t const blockBegin = nextBlockBegin.fetch_add(blockSize);
+        if (blockBegin >= records.size())
+            break;
+        size_t const blockEnd = std::min(blockBegin + blockSize, records.size());
+        std::chrono::steady_clock::time_point const blockStart = std::chrono::steady_clock::now();
 
-            qdataColl = buildQDCollection(todo);
-        } // END MUTEX_take_from_multicollection
+        resize(todo, blockEnd - blockBegin);
+        for (size_t i = blockBegin; i < blockEnd; ++i)
+            todo[i - blockBegin] = &records[i];
+        buildQDCollection(qdataColl, todo);
 
         // ============================================================================
         // Perform the actual analysis
         // ============================================================================
 
         String<AnalysisResult> results_block = analyseReads(qdataColl, global);
+        blockSizer.update(blockEnd - blockBegin, secondsSince(blockStart));
+        // The temporaries of the block analysis are gone
+        arena.reset();
+
+        std::chrono::steady_clock::time_point const beforeLock = std::chrono::steady_clock::now();
         progBar.updateAndPrint(length(todo));
+        stats.lockWaitSeconds += secondsSince(beforeLock);
 
         // ============================================================================
         // Process Analysis results
         // ============================================================================
 
+        if (length(results_block) != blockEnd - blockBegin)
+            throw std::runtime_error("processReads(...)[E001]");
+        for (size_t i = blockBegin; i < blockEnd; ++i)
         {
-#ifdef __WITHCDR3THREADS__
-            std::unique_lock<std::mutex> lock(MUTEX_write_global_results);
-#endif
-            for (AnalysisResult const & ar : results_block)
-            {
-                if (localResultIt->reject != NONE  // We are overwriting prev data
-                        || ! empty(localResultIt->fullOutSuffix)  // We are overwriting prev data
-                        || atEnd(localResultIt)) throw std::runtime_error("Unknown error"); // Our iterator is where it shouldn't be
-                *localResultIt = ar;
-                ++localResultIt;
-            }
-        } // END MUTEX_write_global_results
-
-
+            if (results[i].reject != NONE  // We are overwriting prev data
+                    || ! empty(results[i].fullOutSuffix))  // We are overwriting prev data
+                throw std::runtime_error("processReads(...)[E002]");
+            results[i] = results_block[i - blockBegin];
+        }
+        ++stats.nBlocks;
+        stats.nRecords += blockEnd - blockBegin;
+        stats.minBlockSize = std::min(stats.minBlockSize, blockEnd - blockBegin);
+        stats.maxBlockSize = std::max(stats.maxBlockSize, blockEnd - blockBegin);
     }
+    stats.totalSeconds = secondsSince(start);
+    stats.nArenaAllocations = arena.nAllocations - arenaAllocations;
+    stats.nArenaChunks = arena.nChunks - arenaChunks;
 }
 
 template <typename TSequencingSpec>
@@ -2210,7 +2247,8 @@ void splitAnalysisResults(
         std::map<Clone<Dna5>, ClusterResult> & nucCloneStore,
         String<RejectEvent> & rejectEvents,
         String<AnalysisResult> const & results,
-        std::list<FastqMultiRecord<TSequencingSpec> > const & recList
+        std::vector<FastqMultiRecord<TSequencingSpec> > const & recList,
+        ReadIdStore const & readIds
         )
 {
     auto recIt = recList.begin();
@@ -2224,8 +2262,8 @@ void splitAnalysisResults(
             // Increase the counter for this clone
             countNewClone(nucCloneStore, ar.clone, ar.cdrQualities, record.ids.size(), record.bcSeqHistory);
         } else {
-            for (CharString const & id : record.ids)
-                appendValue(rejectEvents, RejectEvent(id, ar.reject));
+            for (TReadId const readId : sortedByReadId(readIds, record.ids))
+                appendValue(rejectEvents, RejectEvent(readId, ar.reject));
         }
     }
 }
@@ -2234,7 +2272,8 @@ template <typename TSequencingSpec>
 void writeRDTFile(
         CdrGlobalData<TSequencingSpec> & global,
         String<AnalysisResult> const & results,
-        std::list<FastqMultiRecord<TSequencingSpec> > const & recList
+        std::vector<FastqMultiRecord<TSequencingSpec> > const & recList,
+        ReadIdStore const & readIds
         )
 {
     auto recIt = recList.begin();
@@ -2243,8 +2282,9 @@ void writeRDTFile(
         if (ar.reject)
             continue;
         FastqMultiRecord<TSequencingSpec> const & rec = *recIt;
-        for (CharString const & id : rec.ids) {
-            *global.outFiles._fullOutStream << id << ar.fullOutSuffix;
+        for (TReadId const readId : sortedByReadId(readIds, rec.ids)) {
+            writeReadId(*global.outFiles._fullOutStream, readIds, readId);
+            *global.outFiles._fullOutStream << ar.fullOutSuffix;
         }
     }
 }
@@ -2266,10 +2306,6 @@ String<AnalysisResult> runCDR3Analysis(
         CdrGlobalData<TSequencingSpec> & global                   //  IN: The user specified parameters
         )
 {
-    typedef FastqMultiRecordCollection<TSequencingSpec> TColl;
-    typedef typename TColl::TRecList TRecList;
-    typedef typename TRecList::const_iterator TRecListIt;
-
     // ============================================================================
     // Status message
     // ============================================================================
@@ -2286,40 +2322,67 @@ String<AnalysisResult> runCDR3Analysis(
 
     // ============================================================================
     // Launch the analysis. processReads() reads a block of reads and analyses it.
-    // If supported and requested by the user, multiple threads call
-    // processReads(), the function and therefore each thread terminates when the
-    // SequenceStream is exhausted, i.e. no more reads are available.
+    // If supported and requested by the user, one task per job on the shared
+    // thread pool calls processReads(), the function and therefore each task
+    // terminates when all records were claimed.
     // ============================================================================
 
-    TRecListIt nextBegin = collection.multiRecords.begin();
-    TRecListIt endIt = collection.multiRecords.end();
+    std::atomic<size_t> nextBlockBegin(0);
     String<AnalysisResult> results;
     resize(results, collection.multiRecords.size());
-    Iterator<String<AnalysisResult>, Rooted>::Type resultsIt = begin(results);
+    std::vector<ProcessReadsStats> taskStats(std::max(1, global.options.jobs));
 #ifdef __WITHCDR3THREADS__
-    std::vector<std::thread> threads;
-    for (int w=0; w < global.options.jobs; ++w)
-        threads.push_back(std::thread(
-                [&]() {
+    std::shared_ptr<TaskGroup> analysis = global.threadPool->parallelFor(0, taskStats.size(), 1,
+            [&](size_t task) {
+#else
+            size_t const task = 0;
 #endif
-                processReads(resultsIt , progBar, nextBegin, endIt, global);
+            processReads(results, progBar, nextBlockBegin, collection.multiRecords, global, taskStats.size(), taskStats[task]);
 #ifdef __WITHCDR3THREADS__
-                }
-                ));
-    for (std::thread & t : threads)
-        t.join();
+            });
+    analysis->wait();
 #endif
     progBar.clear();
 
+    // ============================================================================
+    // Report the chosen block sizes and the share of time the tasks spent waiting
+    // for locks
+    // ============================================================================
+
+    uint64_t nBlocks = 0, nArenaAllocations = 0, nArenaChunks = 0;
+    size_t minBlockSize = std::numeric_limits<size_t>::max(), maxBlockSize = 0;
+    double totalSeconds = 0, lockWaitSeconds = 0, maxLockWaitShare = 0;
+    for (ProcessReadsStats const & stats : taskStats)
+    {
+        nBlocks += stats.nBlocks;
+        nArenaAllocations += stats.nArenaAllocations;
+        nArenaChunks += stats.nArenaChunks;
+        minBlockSize = std::min(minBlockSize, stats.minBlockSize);
+        maxBlockSize = std::max(maxBlockSize, stats.maxBlockSize);
+        totalSeconds += stats.totalSeconds;
+        lockWaitSeconds += stats.lockWaitSeconds;
+        if (stats.totalSeconds > 0)
+            maxLockWaitShare = std::max(maxLockWaitShare, stats.lockWaitSeconds / stats.totalSeconds);
+    }
+    if (nBlocks > 0)
+        std::cerr << "  |-- Analysed " << nBlocks << " blocks of " << minBlockSize << " to " << maxBlockSize
+            << " records (mean " << length(results) / nBlocks << ")" << std::endl;
+    std::cerr << "  |-- Block arena: " << nArenaAllocations << " allocations served from " << nArenaChunks
+        << " heap chunks" << std::endl;
+    std::cerr << "  |-- Lock wait time: " << std::setprecision(2) << std::fixed
+        << (totalSeconds > 0 ? 100.0 * lockWaitSeconds / totalSeconds : 0.0) << "% of the analysis time ("
+        << 100.0 * maxLockWaitShare << "% in the slowest of " << taskStats.size() << " tasks)" << std::endl;
+
     return results;
 }
 
 template <typename TStream>
-void writeRejectLog(TStream & stream, String<RejectEvent> const & rejectEvents)
+void writeRejectLog(TStream & stream, String<RejectEvent> const & rejectEvents, ReadIdStore const & readIds)
 {
     for (RejectEvent const & rejectEvent : rejectEvents)
     {
-        stream << rejectEvent.id << '\t' << _CDRREJECTS[rejectEvent.reason] << '\n';
+        writeReadId(stream, readIds, rejectEvent.readId);
+        stream << '\t' << _CDRREJECTS[rejectEvent.reason] << '\n';
     }
     stream << std::flush;
 }
@@ -2378,7 +2441,7 @@ int runAnalysis(CdrGlobalData<TSequencingSpec> & global,
     typedef std::map<Clone<Dna5>, ClusterResult> TNucCloneStore;
     TNucCloneStore nucCloneStore;
     String<RejectEvent> newRejectEvents;
-    splitAnalysisResults(nucCloneStore, newRejectEvents, results, collection.multiRecords);
+    splitAnalysisResults(nucCloneStore, newRejectEvents, results, collection.multiRecords, collection.readIds);
     append(rejectEvents, newRejectEvents);
 
     // ============================================================================
@@ -2390,18 +2453,29 @@ int runAnalysis(CdrGlobalData<TSequencingSpec> & global,
     std::cerr << "  |-- " << cloneCount << " " << s << " could be identified." << std::endl;
 
     // ============================================================================
-    // Write detailed per read output file if requested
-    // ============================================================================
-
-    if (global.outFiles._fullOutStream != NULL)
-        writeRDTFile(global, results, collection.multiRecords);
-
-    // ============================================================================
-    // Write reject information if requested
+    // Write detailed per read output file and reject information if requested.
+    // With multi-threading support, this runs on the shared thread pool while
+    // the clonotypes are post processed below.
     // ============================================================================
 
-    if (__rejectLog != NULL)
-        writeRejectLog(*__rejectLog, rejectEvents);
+    auto writeReadOutput = [&global, &results, &collection, &rejectEvents]()
+    {
+        if (global.outFiles._fullOutStream != NULL)
+            writeRDTFile(global, results, collection.multiRecords, collection.readIds);
+        if (__rejectLog != NULL)
+            writeRejectLog(*__rejectLog, rejectEvents, collection.readIds);
+    };
+#ifdef __WITHCDR3THREADS__
+    std::future<void> readOutputWritten = global.threadPool->enqueue<void>(writeReadOutput);
+    // The task refers to the local objects above. Join it on every exit path,
+    // an exception below must not leave it running on destroyed objects.
+    struct JoinGuard {
+        std::future<void> & task;
+        ~JoinGuard() { if (task.valid()) task.wait(); }
+    } readOutputGuard{readOutputWritten};
+#else
+    writeReadOutput();
+#endif
 
     // ============================================================================
     // Drop allele information if requested so
@@ -2457,6 +2531,9 @@ int runAnalysis(CdrGlobalData<TSequencingSpec> & global,
 
     nucCloneStore.clear();
 
+#ifdef __WITHCDR3THREADS__
+    readOutputWritten.get();
+#endif
     closeOfStream(__rejectLog);
     closeOfStream(global.outFiles._fullOutStream);
 
@@ -2562,6 +2639,8 @@ int main_generic(CdrGlobalData<TSequencingSpec> & global, CdrOptions & options,
         std::cerr << "  |-- Max J SCF errors: " << options.maxJCoreErrors << '\n';
     }
 
+    buildSCFIndices(references, options);
+
     std::cerr << "  |-- Read " << length(global.references.leftSegs) << " reference V segments." << std::endl;
     std::cerr << "  |-- Read " << length(global.references.rightSegs) << " reference J segments." << std::endl;
 
@@ -2573,7 +2652,7 @@ int main_generic(CdrGlobalData<TSequencingSpec> & global, CdrOptions & options,
         // ============================================================================
 
         std::cerr << "  |-- Performing barcode correction" << std::endl;
-        barcodeCorrection(collection, options);
+        barcodeCorrection(collection, options, global.threadPool);
         stats = getBarcodeStats(collection);
         std::cerr <<
             "  |   ........... Number of reads: " << stats.nTotalReads << '\n' <<
@@ -2585,14 +2664,18 @@ int main_generic(CdrGlobalData<TSequencingSpec> & global, CdrOptions & options,
         // ============================================================================
 
         FastqMultiRecordCollection<TSequencingSpec> noBcCollection;
+        // The read ID indices and the packed sequences remain valid
+        noBcCollection.seqStore = std::move(collection.seqStore);
+        noBcCollection.readIds = std::move(collection.readIds);
+        noBcCollection.repeatedReadIds = collection.repeatedReadIds;
 
         for (FastqMultiRecord<TSequencingSpec> const & rec : collection.multiRecords)
         {
             if (rec.ids.empty())
                 continue;
             FastqMultiRecord<TSequencingSpec> recCopy = rec;
-            recCopy.bcSeqHistory.insert(recCopy.bcSeq);
-            recCopy.bcSeq = "";
+            recCopy.bcSeqHistory.insert(unpack(recCopy.bcSeq));
+            clear(recCopy.bcSeq);
             mergeRecord(noBcCollection, recCopy);
         }
 
@@ -2602,7 +2685,7 @@ int main_generic(CdrGlobalData<TSequencingSpec> & global, CdrOptions & options,
             "  |   ........... Number of reads: " << stats.nTotalReads << '\n' <<
             "  |   .... Number of unique reads: " << stats.nTotalUniqueReads << '\n';
 
-        collection = noBcCollection;
+        collection = std::move(noBcCollection);
 
     }
 
@@ -0,0 +1,349 @@
+// ============================================================================
+// IMSEQ - An immunogenetic sequence analysis tool
+// (C) Charite, Universitaetsmedizin Berlin
+// Author: Leon Kuchenbecker
+// ============================================================================
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License version 2 as published by
+// the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+// ============================================================================
+
+// ============================================================================
+// HEADER FILE DESCRIPTION
+// ============================================================================
+// A compact representation of Dna5 sequences using two bits per base. The
+// rare N bases are stored as 'A' in the packed words and additionally listed
+// in a sorted exception list. The words and exception lists of many sequences
+// share the chunks of one PackedSequenceStore, the sequences only refer to
+// them.
+// ============================================================================
+
+#ifndef IMSEQ_PACKED_SEQUENCE_H
+#define IMSEQ_PACKED_SEQUENCE_H
+
+#include <vector>
+#include <memory>
+#include <ostream>
+#include <algorithm>
+#include <iterator>
+
+#include <seqan/basic.h>
+#include <seqan/sequence.h>
+
+#include "fixed_size_types.h"
+#include "sequence_kernels.h"
+
+using namespace seqan;
+
+// ============================================================================
+// Tags, Classes, Enums
+// ============================================================================
+
+/**
+ * Append-only storage for packed sequences. The words are allocated from
+ * chunks that are neither moved nor freed before the store is cleared or
+ * destroyed, such that sequences can point into them. Moving the store keeps
+ * these pointers valid, copying is not supported. The chunk size grows from
+ * MIN_CHUNK_WORDS to MAX_CHUNK_WORDS, such that short lived stores stay
+ * small.
+ */
+class PackedSequenceStore {
+public:
+    static size_t const MIN_CHUNK_WORDS = 64;
+    static size_t const MAX_CHUNK_WORDS = 1 << 16;
+
+    // A position in the store to rewind to, see rewind()
+    struct Mark {
+        size_t chunk;
+        size_t offset;
+    };
+
+    PackedSequenceStore() : current(0), offset(0) {}
+
+    PackedSequenceStore(PackedSequenceStore const &) = delete;
+    PackedSequenceStore & operator=(PackedSequenceStore const &) = delete;
+    PackedSequenceStore(PackedSequenceStore &&) = default;
+    PackedSequenceStore & operator=(PackedSequenceStore &&) = default;
+
+    uint64_t * allocate(size_t const nWords)
+    {
+        for (; current < chunks.size(); ++current, offset = 0)
+        {
+            if (offset + nWords <= chunkSizes[current])
+            {
+                offset += nWords;
+                return chunks[current].get() + offset - nWords;
+            }
+        }
+        // No retained chunk left that is large enough
+        size_t chunkSize = MIN_CHUNK_WORDS;
+        if (!chunkSizes.empty())
+            chunkSize = 2 * chunkSizes.back() < MAX_CHUNK_WORDS ? 2 * chunkSizes.back() : MAX_CHUNK_WORDS;
+        if (chunkSize < nWords)
+            chunkSize = nWords;
+        chunks.push_back(std::unique_ptr<uint64_t[]>(new uint64_t[chunkSize]));
+        chunkSizes.push_back(chunkSize);
+        current = chunks.size() - 1;
+        offset = nWords;
+        return chunks[current].get();
+    }
+
+    Mark mark() const
+    {
+        Mark m;
+        m.chunk = current;
+        m.offset = offset;
+        return m;
+    }
+
+    /**
+     * Releases the words allocated after a mark() for reuse. Sequences
+     * pointing to them must not be used anymore.
+     */
+    void rewind(Mark const & m)
+    {
+        current = m.chunk;
+        offset = m.offset;
+    }
+
+    void clear()
+    {
+        chunks.clear();
+        chunkSizes.clear();
+        current = 0;
+        offset = 0;
+    }
+
+private:
+    std::vector<std::unique_ptr<uint64_t[]> > chunks;
+    std::vector<size_t> chunkSizes;
+    size_t current;             // The chunk allocations are currently served from
+    size_t offset;              // The first unused word in the current chunk
+};
+
+/**
+ * A Dna5 sequence packed into 64 bit words, 32 bases per word. The packed
+ * words are followed by the N positions, one per word. Unused bits of the
+ * last packed word are always zero, such that two sequences are identical if
+ * their lengths and their words are. The words are owned by the
+ * PackedSequenceStore passed to assignPacked(), copies of a sequence refer
+ * to the same words.
+ */
+struct PackedDna5String {
+    static unsigned const BASES_PER_WORD = 32;
+
+    uint64_t const *      data;
+    uint32_t              len;
+    uint32_t              nCount;   // The number of N positions
+
+    PackedDna5String() : data(nullptr), len(0), nCount(0) {}
+};
+
+// ============================================================================
+// Functions
+// ============================================================================
+
+inline void clear(PackedSequenceStore & store)
+{
+    store.clear();
+}
+
+inline size_t length(PackedDna5String const & seq)
+{
+    return seq.len;
+}
+
+inline bool empty(PackedDna5String const & seq)
+{
+    return seq.len == 0;
+}
+
+/**
+ * Resets a sequence to the empty sequence. The words remain in the store.
+ */
+inline void clear(PackedDna5String & seq)
+{
+    seq.data = nullptr;
+    seq.len = 0;
+    seq.nCount = 0;
+}
+
+inline size_t packedWordCount(PackedDna5String const & seq)
+{
+    return (seq.len + PackedDna5String::BASES_PER_WORD - 1) / PackedDna5String::BASES_PER_WORD;
+}
+
+inline uint64_t const * packedWords(PackedDna5String const & seq)
+{
+    return seq.data;
+}
+
+inline uint64_t const * nPositionsBegin(PackedDna5String const & seq)
+{
+    return seq.data + packedWordCount(seq);
+}
+
+inline uint64_t const * nPositionsEnd(PackedDna5String const & seq)
+{
+    return seq.data + packedWordCount(seq) + seq.nCount;
+}
+
+/**
+ * Packs a sequence of Dna5 (or Dna5Q) values into words allocated from a
+ * store
+ */
+template <typename TSequence>
+void assignPacked(PackedDna5String & target, TSequence const & source, PackedSequenceStore & store)
+{
+    size_t const len = length(source);
+    size_t nCount = 0;
+    for (size_t i = 0; i < len; ++i)
+        nCount += ordValue(Dna5(source[i])) == 4;
+
+    target.len = len;
+    target.nCount = nCount;
+    size_t const nWords = packedWordCount(target);
+    if (nWords + nCount == 0) {
+        target.data = nullptr;
+        return;
+    }
+    uint64_t * words = store.allocate(nWords + nCount);
+    std::fill(words, words + nWords, 0);
+    uint64_t * nPositions = words + nWords;
+    for (size_t i = 0; i < len; ++i) {
+        unsigned ord = ordValue(Dna5(source[i]));
+        if (ord == 4) {
+            *nPositions++ = i;
+            continue;
+        }
+        words[i / PackedDna5String::BASES_PER_WORD] |= static_cast<uint64_t>(ord) << (2 * (i % PackedDna5String::BASES_PER_WORD));
+    }
+    target.data = words;
+}
+
+/**
+ * Returns the base at a given position
+ */
+inline Dna5 value(PackedDna5String const & seq, size_t const pos)
+{
+    if (seq.nCount != 0 && std::binary_search(nPositionsBegin(seq), nPositionsEnd(seq), static_cast<uint64_t>(pos)))
+        return Dna5('N');
+    return Dna5(static_cast<unsigned>((seq.data[pos / PackedDna5String::BASES_PER_WORD] >> (2 * (pos % PackedDna5String::BASES_PER_WORD))) & 3));
+}
+
+/**
+ * Unpacks a sequence into a String<Dna5>
+ */
+inline void unpack(String<Dna5> & target, PackedDna5String const & source)
+{
+    resize(target, source.len);
+    for (size_t i = 0; i < source.len; ++i)
+        target[i] = Dna5(static_cast<unsigned>((source.data[i / PackedDna5String::BASES_PER_WORD] >> (2 * (i % PackedDna5String::BASES_PER_WORD))) & 3));
+    for (uint64_t const * pos = nPositionsBegin(source); pos != nPositionsEnd(source); ++pos)
+        target[*pos] = Dna5('N');
+}
+
+inline String<Dna5> unpack(PackedDna5String const & source)
+{
+    String<Dna5> target;
+    unpack(target, source);
+    return target;
+}
+
+/**
+ * Word-wise sequence identity
+ */
+inline bool operator==(PackedDna5String const & a, PackedDna5String const & b)
+{
+    return a.len == b.len && a.nCount == b.nCount && std::equal(a.data, nPositionsEnd(a), b.data);
+}
+
+inline bool operator!=(PackedDna5String const & a, PackedDna5String const & b)
+{
+    return !(a == b);
+}
+
+inline std::ostream & operator<<(std::ostream & os, PackedDna5String const & seq)
+{
+    return os << unpack(seq);
+}
+
+/**
+ * Multiplies two 64 bit values and folds the 128 bit product into 64 bits
+ */
+inline uint64_t _hashMix(uint64_t const a, uint64_t const b)
+{
+    __uint128_t const product = static_cast<__uint128_t>(a) * b;
+    return static_cast<uint64_t>(product) ^ static_cast<uint64_t>(product >> 64);
+}
+
+/**
+ * Hash value of a packed sequence. Processes the packed words, i.e. 32 bases
+ * at a time, with a multiply-fold mixing step per word. Every input bit
+ * affects all bits of the result, such that similar sequences (e.g. reads
+ * of an amplicon library sharing long prefixes) are spread evenly over the
+ * low bits used for addressing hash tables. The seed allows for chaining
+ * the hash values of multiple sequences.
+ */
+inline size_t hashPacked(PackedDna5String const & seq, size_t const seed = 0)
+{
+    static uint64_t const SECRET0 = 0xa0761d6478bd642fULL;
+    static uint64_t const SECRET1 = 0xe7037ed1a0b428dbULL;
+    static uint64_t const SECRET2 = 0x8ebc6af09c88c6e3ULL;
+    static uint64_t const SECRET3 = 0x589965cc75374cc3ULL;
+
+    uint64_t h = _hashMix(seed ^ SECRET0, seq.len ^ SECRET1);
+    for (uint64_t const * word = packedWords(seq); word != nPositionsBegin(seq); ++word)
+        h = _hashMix(*word ^ SECRET1, h ^ SECRET2);
+    for (uint64_t const * pos = nPositionsBegin(seq); pos != nPositionsEnd(seq); ++pos)
+        h = _hashMix(*pos ^ SECRET3, h ^ SECRET2);
+    return _hashMix(h ^ SECRET0, seq.nCount ^ SECRET3);
+}
+
+struct PackedDna5StringHash {
+    size_t operator()(PackedDna5String const & seq) const
+    {
+        return hashPacked(seq);
+    }
+};
+
+/**
+ * Checks whether the Hamming distance of two sequences of the same length is
+ * at most maxDist. Sequences of different lengths are never within the
+ * distance.
+ */
+inline bool hammingDistAtMost(PackedDna5String const & seqA, PackedDna5String const & seqB, unsigned maxDist)
+{
+    if (seqA.len != seqB.len)
+        return false;
+    // Mismatching 2 bit lanes of the packed words. The N correction below
+    // can only add mismatches, so we can stop here if maxDist is exceeded.
+    size_t nErrors = packedLaneMismatches(packedWords(seqA), packedWords(seqB), packedWordCount(seqA), maxDist);
+    if (nErrors > maxDist)
+        return false;
+    // Correct for the N positions, which are stored as 'A' in the words
+    if (seqA.nCount != 0 || seqB.nCount != 0) {
+        std::vector<uint64_t> nUnion;
+        std::set_union(nPositionsBegin(seqA), nPositionsEnd(seqA), nPositionsBegin(seqB), nPositionsEnd(seqB), std::back_inserter(nUnion));
+        for (uint64_t pos : nUnion) {
+            bool packedMismatch = ((seqA.data[pos / PackedDna5String::BASES_PER_WORD] ^ seqB.data[pos / PackedDna5String::BASES_PER_WORD])
+                    >> (2 * (pos % PackedDna5String::BASES_PER_WORD))) & 3;
+            bool mismatch = value(seqA, pos) != value(seqB, pos);
+            nErrors = nErrors + mismatch - packedMismatch;
+        }
+    }
+    return nErrors <= maxDist;
+}
+
+#endif
@@ -0,0 +1,228 @@
+// ============================================================================
+// IMSEQ - An immunogenetic sequence analysis tool
+// (C) Charite, Universitaetsmedizin Berlin
+// Author: Leon Kuchenbecker
+// ============================================================================
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License version 2 as published by
+// the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+// ============================================================================
+
+
+// ============================================================================
+// HEADER FILE DESCRIPTION
+// ============================================================================
+// Storage for the FASTQ read IDs. The IDs of all input reads are appended to a
+// single character buffer and referred to by their index in the store. Reads
+// inserted into a collection with an ID seen before reuse its index.
+// ============================================================================
+
+#ifndef IMSEQ_READ_ID_STORE_H
+#define IMSEQ_READ_ID_STORE_H
+
+#include <vector>
+#include <ostream>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+#include <seqan/basic.h>
+#include <seqan/sequence.h>
+
+#include "fixed_size_types.h"
+
+using namespace seqan;
+
+// ============================================================================
+// Tags, Classes, Enums
+// ============================================================================
+
+typedef uint32_t TReadId;
+
+/**
+ * Append-only store of read IDs. ends[i] is the end offset of the i-th ID in
+ * chars, it starts where the previous one ends.
+ */
+struct ReadIdStore {
+    std::vector<char>     chars;
+    std::vector<uint64_t> ends;
+};
+
+// ============================================================================
+// Functions
+// ============================================================================
+
+inline size_t length(ReadIdStore const & store)
+{
+    return store.ends.size();
+}
+
+inline void clear(ReadIdStore & store)
+{
+    store.chars.clear();
+    store.ends.clear();
+}
+
+/**
+ * Appends a read ID to the store and returns its index
+ */
+inline TReadId appendReadId(ReadIdStore & store, CharString const & id)
+{
+    if (store.ends.size() >= std::numeric_limits<TReadId>::max())
+        throw std::runtime_error("appendReadId(...)[E001]");
+    store.chars.insert(store.chars.end(), begin(id, Standard()), end(id, Standard()));
+    store.ends.push_back(store.chars.size());
+    return store.ends.size() - 1;
+}
+
+inline char const * readIdBegin(ReadIdStore const & store, TReadId const id)
+{
+    return store.chars.data() + (id == 0 ? 0 : store.ends[id - 1]);
+}
+
+inline size_t readIdLength(ReadIdStore const & store, TReadId const id)
+{
+    return store.ends[id] - (id == 0 ? 0 : store.ends[id - 1]);
+}
+
+/**
+ * Returns a copy of a read ID
+ */
+inline CharString readId(ReadIdStore const & store, TReadId const id)
+{
+    CharString res;
+    resize(res, readIdLength(store, id));
+    std::copy(readIdBegin(store, id), readIdBegin(store, id) + length(res), begin(res, Standard()));
+    return res;
+}
+
+inline void writeReadId(std::ostream & stream, ReadIdStore const & store, TReadId const id)
+{
+    stream.write(readIdBegin(store, id), readIdLength(store, id));
+}
+
+/**
+ * Lexicographical comparison of two read IDs
+ */
+inline bool readIdLess(ReadIdStore const & store, TReadId const a, TReadId const b)
+{
+    size_t const lenA = readIdLength(store, a);
+    size_t const lenB = readIdLength(store, b);
+    size_t const lenMin = std::min(lenA, lenB);
+    int const cmp = lenMin == 0 ? 0 : std::memcmp(readIdBegin(store, a), readIdBegin(store, b), lenMin);
+    return cmp < 0 || (cmp == 0 && lenA < lenB);
+}
+
+/**
+ * Equality of a stored read ID and an ID string
+ */
+inline bool sameReadId(ReadIdStore const & store, TReadId const id, char const * chars, size_t const len)
+{
+    return readIdLength(store, id) == len && (len == 0 || std::memcmp(readIdBegin(store, id), chars, len) == 0);
+}
+
+/**
+ * Hash value of a read ID string (FNV-1a)
+ */
+inline uint64_t hashReadId(char const * chars, size_t const len)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < len; ++i)
+        hash = (hash ^ static_cast<unsigned char>(chars[i])) * 1099511628211ull;
+    return hash;
+}
+
+/**
+ * Returns the read IDs ordered lexicographically by the ID strings
+ */
+inline std::vector<TReadId> sortedByReadId(ReadIdStore const & store, std::vector<TReadId> const & ids)
+{
+    std::vector<TReadId> sorted(ids);
+    std::sort(sorted.begin(), sorted.end(), [&store](TReadId a, TReadId b) -> bool { return readIdLess(store, a, b); });
+    return sorted;
+}
+
+// ============================================================================
+// ReadIdTable
+// ============================================================================
+
+/**
+ * Open addressing hash table over read IDs of a ReadIdStore, used to find
+ * repeated read IDs while the input is read. The slots hold ID indices,
+ * equal IDs occupy separate slots. The load factor is kept at or below 3/4.
+ */
+struct ReadIdTable {
+    static TReadId const EMPTY = std::numeric_limits<TReadId>::max();
+
+    std::vector<TReadId> slots;
+    size_t nIds;
+
+    ReadIdTable() : nIds(0) {}
+};
+
+/**
+ * Releases the memory held by a ReadIdTable
+ */
+inline void clear(ReadIdTable & table)
+{
+    std::vector<TReadId>().swap(table.slots);
+    table.nIds = 0;
+}
+
+inline void _insertReadIdSlot(std::vector<TReadId> & slots, ReadIdStore const & store, TReadId const id)
+{
+    size_t const mask = slots.size() - 1;
+    size_t slot = hashReadId(readIdBegin(store, id), readIdLength(store, id)) & mask;
+    while (slots[slot] != ReadIdTable::EMPTY)
+        slot = (slot + 1) & mask;
+    slots[slot] = id;
+}
+
+/**
+ * Adds a stored read ID to the table
+ */
+inline void insertReadId(ReadIdTable & table, ReadIdStore const & store, TReadId const id)
+{
+    if ((table.nIds + 1) * 4 > table.slots.size() * 3)
+    {
+        TReadId const empty = ReadIdTable::EMPTY;
+        std::vector<TReadId> slots(std::max<size_t>(16, 2 * table.slots.size()), empty);
+        for (TReadId const other : table.slots)
+            if (other != ReadIdTable::EMPTY)
+                _insertReadIdSlot(slots, store, other);
+        table.slots.swap(slots);
+    }
+    _insertReadIdSlot(table.slots, store, id);
+    ++table.nIds;
+}
+
+/**
+ * Calls fun(id) for every ID index in the table whose ID equals the given
+ * string
+ */
+template <typename TFun>
+void forEachEqualReadId(ReadIdTable const & table, ReadIdStore const & store, CharString const & id, TFun && fun)
+{
+    if (table.slots.empty())
+        return;
+    char const * chars = begin(id, Standard());
+    size_t const len = length(id);
+    size_t const mask = table.slots.size() - 1;
+    for (size_t slot = hashReadId(chars, len) & mask; table.slots[slot] != ReadIdTable::EMPTY; slot = (slot + 1) & mask)
+        if (sameReadId(store, table.slots[slot], chars, len))
+            fun(table.slots[slot]);
+}
+
+#endif
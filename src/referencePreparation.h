@@ -27,6 +27,7 @@
 #include <seqan/index.h>
 #include "segment_meta.h"
 #include "globalData.h"
+#include "reference_index.h"
 
 template<typename TSequence>
 void computeIdentOffsets(
@@ -79,10 +80,10 @@ template <typename TSequence>
 bool loadSegmentFiles(
         StringSet<TSequence>& vSegSequences,             // Output: The segment sequences
         String<SegmentMeta> & vSegMetaInfo,              // Output: The segment meta information
-        StringSet<String<unsigned> > vIdentOffsets,      // Output: The identity offsets
+        StringSet<String<unsigned> > & vIdentOffsets,    // Output: The identity offsets
         StringSet<TSequence>& jSegSequences,             // Output: The segment sequences
         String<SegmentMeta> & jSegMetaInfo,              // Output: The segment meta information
-        StringSet<String<unsigned> > jIdentOffsets,      // Output: The identity offsets
+        StringSet<String<unsigned> > & jIdentOffsets,    // Output: The identity offsets
         CharString const & path)                         // Input: Path to the fasta file
 {
     typedef StringSet<CharString>               TIDSeqSet;
@@ -170,11 +171,20 @@ void buildToFirstAllelMap(String<SegmentMeta> const & meta, String<unsigned> & t
     }
 }
 
-void readAndPreprocessReferences(CdrReferences & references, CdrOptions & options, unsigned autoTuneMinReadLen) {
-
-    // ============================================================================
-    // Read the segment file
-    // ============================================================================
+/**
+ * Loads the segment references, either from the FASTA file or from a
+ * precompiled reference index file if one was specified. Exits on failure.
+ */
+inline void loadReferences(CdrReferences & references, CdrOptions const & options)
+{
+    if (!empty(options.refIndexPath))
+    {
+        if (!loadReferenceIndex(references, options.refIndexPath)) {
+            std::cerr << "Reading the reference index failed!" << std::endl;
+            exit(1);
+        }
+        return;
+    }
 
     if (!loadSegmentFiles(references.leftSegs,
                 references.leftMeta,
@@ -187,6 +197,68 @@ void readAndPreprocessReferences(CdrReferences & references, CdrOptions & option
         exit(1);
     }
 
+    buildToFirstAllelMap(references.rightMeta, references.rightToFirstAllel);
+    buildToFirstAllelMap(references.leftMeta, references.leftToFirstAllel);
+}
+
+/**
+ * Builds the J segment core fragments unless SCFs with the same parameters
+ * were already loaded from a reference index. Exits on failure.
+ */
+inline void buildRightSCFs(CdrReferences & references, int const start, unsigned const scfLength)
+{
+    if (references.rightSCFLength == scfLength && references.rightSCFStart == start)
+        return;
+
+    unsigned val = buildSegmentCoreFragments(references.rightSCFs,
+            references.rightSCFToSegIds,
+            references.rightSegToScfId,
+            references.rightSCFPos,
+            references.rightSegs,
+            references.rightMeta,
+            start,
+            scfLength);
+    if (BUILD_SEGMENT_CORE_FRAGMENTS_GOOD != val) {
+        std::cerr << "Failed to build core fragment for '" << getDescriptor(references.rightMeta[val]) << "'. Boundaries violated.\n";
+        exit(1);
+    }
+    references.rightSCFStart = start;
+    references.rightSCFLength = scfLength;
+}
+
+/**
+ * Builds the V segment core fragments unless SCFs with the same parameters
+ * were already loaded from a reference index. Exits on failure.
+ */
+inline void buildLeftSCFs(CdrReferences & references, int const start, unsigned const scfLength)
+{
+    if (references.leftSCFLength == scfLength && references.leftSCFStart == start)
+        return;
+
+    unsigned val = buildSegmentCoreFragments(references.leftSCFs,
+            references.leftSCFToSegIds,
+            references.leftSegToScfId,
+            references.leftSCFPos,
+            references.leftSegs,
+            references.leftMeta,
+            start,
+            scfLength);
+    if (BUILD_SEGMENT_CORE_FRAGMENTS_GOOD != val) {
+        std::cerr << "Failed to build core fragment for '" << getDescriptor(references.leftMeta[val]) << "'. Boundaries violated.\n";
+        exit(1);
+    }
+    references.leftSCFStart = start;
+    references.leftSCFLength = scfLength;
+}
+
+void readAndPreprocessReferences(CdrReferences & references, CdrOptions & options, unsigned autoTuneMinReadLen) {
+
+    // ============================================================================
+    // Read the segment file or the reference index
+    // ============================================================================
+
+    loadReferences(references, options);
+
     if (options.vSCFLength == AUTO_TUNE)
     {
         // Compute the maximum V segment length based on the read V segments.
@@ -214,39 +286,149 @@ void readAndPreprocessReferences(CdrReferences & references, CdrOptions & option
     // PROCESS J-SEGMENTS
     // ============================================================================
 
-    unsigned val = buildSegmentCoreFragments(references.rightSCFs,
-            references.rightSCFToSegIds,
-            references.rightSegToScfId,
-            references.rightSCFPos,
-            references.rightSegs,
-            references.rightMeta,
-            options.jSCFOffset,
-            options.jSCFLength);
-    if (BUILD_SEGMENT_CORE_FRAGMENTS_GOOD != val) {
-        std::cerr << "Failed to build core fragment for '" << getDescriptor(references.rightMeta[val]) << "'. Boundaries violated.\n";
-        exit(1);
-    }
-
-    buildToFirstAllelMap(references.rightMeta, references.rightToFirstAllel);
+    buildRightSCFs(references, options.jSCFOffset, options.jSCFLength);
 
     // ============================================================================
     // PROCESS V-SEGMENTS
     // ============================================================================
 
-    val = buildSegmentCoreFragments(references.leftSCFs,
-            references.leftSCFToSegIds,
-            references.leftSegToScfId,
-            references.leftSCFPos,
-            references.leftSegs,
-            references.leftMeta,
-            3 - static_cast<int>(options.vSCFLength) + options.vSCFOffset,
-            options.vSCFLength);
-    if (BUILD_SEGMENT_CORE_FRAGMENTS_GOOD != val) {
-        std::cerr << "Failed to build core fragment for '" << getDescriptor(references.leftMeta[val]) << "'. Boundaries violated.\n";
-        exit(1);
+    buildLeftSCFs(references, 3 - static_cast<int>(options.vSCFLength) + options.vSCFOffset, options.vSCFLength);
+
+}
+
+/**
+ * Length of the common part of two alignment windows, counted from the SCF
+ * side. The SCF lies at the end of the V windows.
+ *
+ * @special Left overlap
+ */
+template <typename TSegment>
+unsigned _sharedWindowLength(TSegment const & windowA, TSegment const & windowB, LeftOverlap const)
+{
+    unsigned const len = std::min(length(windowA), length(windowB));
+    unsigned shared = 0;
+    while (shared < len && windowA[length(windowA) - shared - 1] == windowB[length(windowB) - shared - 1])
+        ++shared;
+    return shared;
+}
+
+/**
+ * @special Right overlap. The SCF lies at the beginning of the J windows.
+ */
+template <typename TSegment>
+unsigned _sharedWindowLength(TSegment const & windowA, TSegment const & windowB, RightOverlap const)
+{
+    unsigned const len = std::min(length(windowA), length(windowB));
+    unsigned shared = 0;
+    while (shared < len && windowA[shared] == windowB[shared])
+        ++shared;
+    return shared;
+}
+
+/**
+ * Groups the segments of every SCF by the position of their alignment window.
+ * For each SCF and each of its segments, the first segment of the SCF whose
+ * window has the same position is stored, together with the length of the
+ * window part both segments share from the SCF side. Only this part is
+ * reached by the alignment band of most reads, findBestSCFs() aligns a read
+ * only once per group if the shared part covers the band.
+ */
+template <typename TOverlapDirection>
+void buildSCFWindowIds(
+        CdrReferences & references,         // [OUT] The references, SCFs have to be built already
+        int const shift,                    //  [IN] The SCF shift / offset
+        TOverlapDirection const)            // [TAG] The overlap direction
+{
+    typedef Infix<String<Dna5> const>::Type TWindow;
+
+    CdrReferences::TSegmentStringSet const & segs = getSegmentSequences(references, TOverlapDirection());
+    CdrReferences::TSCFToSegIds const & scfToSegIds = getSCFToSegIds(references, TOverlapDirection());
+    CdrReferences::TSCFToSegIds & windowIds = getSCFWindowIds(references, TOverlapDirection());
+    CdrReferences::TSCFToSegIds & windowShared = getSCFWindowShared(references, TOverlapDirection());
+
+    clear(windowIds);
+    clear(windowShared);
+    resize(windowIds, length(scfToSegIds));
+    resize(windowShared, length(scfToSegIds));
+    for (unsigned scfId = 0; scfId < length(scfToSegIds); ++scfId)
+    {
+        String<unsigned> const & segIds = scfToSegIds[scfId];
+        resize(windowIds[scfId], length(segIds));
+        resize(windowShared[scfId], length(segIds));
+        for (unsigned i = 0; i < length(segIds); ++i)
+        {
+            BeginEndPos<unsigned> const window = getAlignmentWindow(references, segIds[i], shift, TOverlapDirection());
+            windowIds[scfId][i] = segIds[i];
+            windowShared[scfId][i] = window.endPos - window.beginPos;
+            for (unsigned j = 0; j < i; ++j)
+            {
+                BeginEndPos<unsigned> const other = getAlignmentWindow(references, segIds[j], shift, TOverlapDirection());
+                if (window.beginPos == other.beginPos && window.endPos == other.endPos)
+                {
+                    windowIds[scfId][i] = segIds[j];
+                    windowShared[scfId][i] = _sharedWindowLength(
+                            TWindow(segs[segIds[i]], window.beginPos, window.endPos),
+                            TWindow(segs[segIds[j]], other.beginPos, other.endPos),
+                            TOverlapDirection());
+                    break;
+                }
+            }
+        }
     }
+}
 
-    buildToFirstAllelMap(references.leftMeta, references.leftToFirstAllel);
+/**
+ * Builds the q-gram index over the segment core fragments of one overlap
+ * direction. All fibres required by the SWIFT filter are created here, such
+ * that the index is only read from during the analysis. If requested, also
+ * builds the k-mer seed table used by '--scf-filter kmer'. Preprocesses
+ * the Myers bit masks of every SCF for the verification of the filter hits
+ * and groups the segments of every SCF by their alignment window.
+ * The index and the patterns depend on the SCF strings, the references must
+ * not be copied or moved afterwards.
+ */
+template <typename TOverlapDirection>
+void buildSCFIndex(
+        CdrReferences & references,         // [OUT] The references, SCFs have to be built already
+        unsigned const maxCoreErrors,       //  [IN] The maximum number of errors within a SCF match
+        int const shift,                    //  [IN] The SCF shift / offset
+        bool const seedTable,               //  [IN] Whether to build the k-mer seed table
+        TOverlapDirection const)            // [TAG] The overlap direction
+{
+    typedef CdrReferences::TQGramIndex TIndex;
+
+    CdrReferences::TSegCoreFragmentStringSet & scfs = getSCFs(references, TOverlapDirection());
+    TIndex & index = getSCFIndex(references, TOverlapDirection());
+
+    index = TIndex(scfs);
+    // The length of all SCFs is the same
+    resize(indexShape(index), length(scfs[0]) / (maxCoreErrors + 1));
+    indexRequire(index, QGramSADir());
+
+    CdrReferences::TSCFPatterns & patterns = getSCFPatterns(references, TOverlapDirection());
+    clear(patterns);
+    resize(patterns, length(scfs));
+    for (unsigned scfId = 0; scfId < length(scfs); ++scfId)
+        setHost(patterns[scfId], scfs[scfId]);
 
+    if (seedTable)
+        buildSCFSeedTable(getSCFSeedTable(references, TOverlapDirection()), scfs, maxCoreErrors);
+    else
+        getSCFSeedTable(references, TOverlapDirection()) = SCFSeedTable();
+
+    buildSCFWindowIds(references, shift, TOverlapDirection());
+}
+
+/**
+ * Builds the SCF q-gram indices for both overlap directions. Requires the
+ * maximum number of core errors to be resolved already.
+ */
+inline void buildSCFIndices(CdrReferences & references, CdrOptions const & options)
+{
+    buildSCFIndex(references, getMaxCoreSegErrors(options, LeftOverlap()), getSCFOffset(options, LeftOverlap()),
+            options.scfKmerFilter, LeftOverlap());
+    buildSCFIndex(references, getMaxCoreSegErrors(options, RightOverlap()), getSCFOffset(options, RightOverlap()),
+            options.scfKmerFilter, RightOverlap());
 }
+
 #endif
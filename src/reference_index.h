@@ -0,0 +1,341 @@
+// ============================================================================
+// IMSEQ - An immunogenetic sequence analysis tool
+// (C) Charite, Universitaetsmedizin Berlin
+// Author: Leon Kuchenbecker
+// ============================================================================
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License version 2 as published by
+// the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+// ============================================================================
+
+// ============================================================================
+// HEADER FILE DESCRIPTION
+// ============================================================================
+// Reading and writing of precompiled reference index files ('imseq index').
+//
+// A reference index file contains a fully prepared CdrReferences object, i.e.
+// the segment sequences, their meta information, the identity offsets, the
+// first-allel maps and, if they were built, the segment core fragments along
+// with the parameters used to build them. Integers are stored in host byte
+// order, the file is only meant to be used on the machine type it was
+// created on.
+//
+// The SCF q-gram indices, Myers patterns, seed tables and alignment window
+// groups are not stored. The indices depend on the number of core errors
+// which may be tuned per run, all of them are built in negligible time over
+// the few hundred SCFs by buildSCFIndices().
+// ============================================================================
+
+#ifndef IMSEQ_REFERENCE_INDEX_H
+#define IMSEQ_REFERENCE_INDEX_H
+
+#include <fstream>
+#include <iostream>
+#include <cstring>
+
+#include <seqan/sequence.h>
+
+#include "fixed_size_types.h"
+#include "segment_meta.h"
+#include "globalData.h"
+
+using namespace seqan;
+
+// ============================================================================
+// Constants
+// ============================================================================
+
+static char const REFERENCE_INDEX_MAGIC[8] = { 'I', 'M', 'S', 'Q', 'R', 'I', 'D', 'X' };
+static uint32_t const REFERENCE_INDEX_VERSION = 1;
+
+// ============================================================================
+// Writing
+// ============================================================================
+
+inline void _writeIndexValue(std::ostream & os, uint64_t const val)
+{
+    os.write(reinterpret_cast<char const *>(&val), sizeof(val));
+}
+
+inline void _writeIndexValue(std::ostream & os, CharString const & str)
+{
+    _writeIndexValue(os, static_cast<uint64_t>(length(str)));
+    if (!empty(str))
+        os.write(&str[0], length(str));
+}
+
+inline void _writeIndexValue(std::ostream & os, String<Dna5> const & seq)
+{
+    CharString str = seq;
+    _writeIndexValue(os, str);
+}
+
+inline void _writeIndexValue(std::ostream & os, String<unsigned> const & values)
+{
+    _writeIndexValue(os, static_cast<uint64_t>(length(values)));
+    for (unsigned const val : values)
+        _writeIndexValue(os, static_cast<uint64_t>(val));
+}
+
+inline void _writeIndexValue(std::ostream & os, SegmentMeta const & meta)
+{
+    _writeIndexValue(os, meta.geneName);
+    _writeIndexValue(os, meta.segType);
+    _writeIndexValue(os, meta.segId);
+    _writeIndexValue(os, meta.allel);
+    _writeIndexValue(os, static_cast<uint64_t>(meta.motifPos));
+}
+
+inline void _writeIndexValue(std::ostream & os, BeginEndPos<unsigned> const & pos)
+{
+    _writeIndexValue(os, static_cast<uint64_t>(pos.beginPos));
+    _writeIndexValue(os, static_cast<uint64_t>(pos.endPos));
+}
+
+template <typename TValue, typename TSpec>
+void _writeIndexValue(std::ostream & os, String<TValue, TSpec> const & values)
+{
+    _writeIndexValue(os, static_cast<uint64_t>(length(values)));
+    for (TValue const & val : values)
+        _writeIndexValue(os, val);
+}
+
+template <typename TString>
+void _writeIndexValue(std::ostream & os, StringSet<TString> const & strings)
+{
+    _writeIndexValue(os, static_cast<uint64_t>(length(strings)));
+    for (unsigned i = 0; i < length(strings); ++i)
+        _writeIndexValue(os, strings[i]);
+}
+
+/**
+ * Writes the segment core fragment related part of one overlap direction.
+ * SCFs that were not built (length 0) are only recorded as missing.
+ */
+inline void _writeIndexSCFs(
+        std::ostream & os,
+        int const scfStart,
+        unsigned const scfLength,
+        CdrReferences::TSegCoreFragmentStringSet const & scfs,
+        CdrReferences::TSCFToSegIds const & scfToSegIds,
+        String<unsigned> const & segToScfId,
+        CdrReferences::TSCFPos const & scfPos)
+{
+    _writeIndexValue(os, static_cast<uint64_t>(scfLength));
+    if (scfLength == 0)
+        return;
+    _writeIndexValue(os, static_cast<uint64_t>(static_cast<int64_t>(scfStart)));
+    _writeIndexValue(os, scfs);
+    _writeIndexValue(os, scfToSegIds);
+    _writeIndexValue(os, segToScfId);
+    _writeIndexValue(os, scfPos);
+}
+
+/**
+ * Serializes prepared references to a reference index file. Returns false if
+ * the file could not be written.
+ */
+inline bool writeReferenceIndex(CharString const & path, CdrReferences const & references)
+{
+    std::ofstream ofs(toCString(path), std::ios::out | std::ios::binary);
+    if (!ofs.good())
+    {
+        std::cerr << "Could not open '" << path << "' for writing!" << std::endl;
+        return false;
+    }
+
+    ofs.write(REFERENCE_INDEX_MAGIC, sizeof(REFERENCE_INDEX_MAGIC));
+    _writeIndexValue(ofs, static_cast<uint64_t>(REFERENCE_INDEX_VERSION));
+
+    // Left (V) segments
+    _writeIndexValue(ofs, references.leftSegs);
+    _writeIndexValue(ofs, references.leftMeta);
+    _writeIndexValue(ofs, references.leftIdentOffsets);
+    _writeIndexValue(ofs, references.leftToFirstAllel);
+    _writeIndexSCFs(ofs, references.leftSCFStart, references.leftSCFLength, references.leftSCFs,
+            references.leftSCFToSegIds, references.leftSegToScfId, references.leftSCFPos);
+
+    // Right (J) segments
+    _writeIndexValue(ofs, references.rightSegs);
+    _writeIndexValue(ofs, references.rightMeta);
+    _writeIndexValue(ofs, references.rightIdentOffsets);
+    _writeIndexValue(ofs, references.rightToFirstAllel);
+    _writeIndexSCFs(ofs, references.rightSCFStart, references.rightSCFLength, references.rightSCFs,
+            references.rightSCFToSegIds, references.rightSegToScfId, references.rightSCFPos);
+
+    ofs.close();
+    if (!ofs)
+    {
+        std::cerr << "An I/O error occurred while writing '" << path << "'!" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// ============================================================================
+// Reading
+// ============================================================================
+
+inline bool _readIndexValue(std::istream & is, uint64_t & val)
+{
+    is.read(reinterpret_cast<char *>(&val), sizeof(val));
+    return is.good();
+}
+
+inline bool _readIndexValue(std::istream & is, unsigned & val)
+{
+    uint64_t tmp;
+    if (!_readIndexValue(is, tmp))
+        return false;
+    val = static_cast<unsigned>(tmp);
+    return true;
+}
+
+inline bool _readIndexValue(std::istream & is, CharString & str)
+{
+    uint64_t len;
+    if (!_readIndexValue(is, len))
+        return false;
+    resize(str, len);
+    if (len > 0)
+        is.read(&str[0], len);
+    return is.good();
+}
+
+inline bool _readIndexValue(std::istream & is, String<Dna5> & seq)
+{
+    CharString str;
+    if (!_readIndexValue(is, str))
+        return false;
+    seq = str;
+    return true;
+}
+
+inline bool _readIndexValue(std::istream & is, SegmentMeta & meta)
+{
+    return _readIndexValue(is, meta.geneName)
+        && _readIndexValue(is, meta.segType)
+        && _readIndexValue(is, meta.segId)
+        && _readIndexValue(is, meta.allel)
+        && _readIndexValue(is, meta.motifPos);
+}
+
+inline bool _readIndexValue(std::istream & is, BeginEndPos<unsigned> & pos)
+{
+    return _readIndexValue(is, pos.beginPos) && _readIndexValue(is, pos.endPos);
+}
+
+template <typename TValue, typename TSpec>
+bool _readIndexValue(std::istream & is, String<TValue, TSpec> & values)
+{
+    uint64_t len;
+    if (!_readIndexValue(is, len))
+        return false;
+    clear(values);
+    resize(values, len);
+    for (uint64_t i = 0; i < len; ++i)
+        if (!_readIndexValue(is, values[i]))
+            return false;
+    return true;
+}
+
+template <typename TString>
+bool _readIndexValue(std::istream & is, StringSet<TString> & strings)
+{
+    uint64_t len;
+    if (!_readIndexValue(is, len))
+        return false;
+    clear(strings);
+    resize(strings, len);
+    for (uint64_t i = 0; i < len; ++i)
+        if (!_readIndexValue(is, strings[i]))
+            return false;
+    return true;
+}
+
+inline bool _readIndexSCFs(
+        std::istream & is,
+        int & scfStart,
+        unsigned & scfLength,
+        CdrReferences::TSegCoreFragmentStringSet & scfs,
+        CdrReferences::TSCFToSegIds & scfToSegIds,
+        String<unsigned> & segToScfId,
+        CdrReferences::TSCFPos & scfPos)
+{
+    if (!_readIndexValue(is, scfLength))
+        return false;
+    if (scfLength == 0)
+        return true;
+    uint64_t start;
+    if (!_readIndexValue(is, start))
+        return false;
+    scfStart = static_cast<int>(static_cast<int64_t>(start));
+    return _readIndexValue(is, scfs)
+        && _readIndexValue(is, scfToSegIds)
+        && _readIndexValue(is, segToScfId)
+        && _readIndexValue(is, scfPos);
+}
+
+/**
+ * Loads prepared references from a reference index file written by
+ * writeReferenceIndex(). Returns false if the file could not be read or was
+ * written by an incompatible version.
+ */
+inline bool loadReferenceIndex(CdrReferences & references, CharString const & path)
+{
+    std::ifstream ifs(toCString(path), std::ios::in | std::ios::binary);
+    if (!ifs.good())
+    {
+        std::cerr << "Error opening reference index file " << path << std::endl;
+        return false;
+    }
+
+    char magic[sizeof(REFERENCE_INDEX_MAGIC)];
+    uint64_t version = 0;
+    ifs.read(magic, sizeof(magic));
+    if (!ifs.good() || std::memcmp(magic, REFERENCE_INDEX_MAGIC, sizeof(magic)) != 0)
+    {
+        std::cerr << "'" << path << "' is not an IMSEQ reference index file." << std::endl;
+        return false;
+    }
+    if (!_readIndexValue(ifs, version) || version != REFERENCE_INDEX_VERSION)
+    {
+        std::cerr << "The reference index file '" << path << "' was created by an incompatible IMSEQ version (format "
+            << version << ", expected " << REFERENCE_INDEX_VERSION << "). Please re-create it using 'imseq index'." << std::endl;
+        return false;
+    }
+
+    bool good =
+        _readIndexValue(ifs, references.leftSegs) &&
+        _readIndexValue(ifs, references.leftMeta) &&
+        _readIndexValue(ifs, references.leftIdentOffsets) &&
+        _readIndexValue(ifs, references.leftToFirstAllel) &&
+        _readIndexSCFs(ifs, references.leftSCFStart, references.leftSCFLength, references.leftSCFs,
+                references.leftSCFToSegIds, references.leftSegToScfId, references.leftSCFPos) &&
+        _readIndexValue(ifs, references.rightSegs) &&
+        _readIndexValue(ifs, references.rightMeta) &&
+        _readIndexValue(ifs, references.rightIdentOffsets) &&
+        _readIndexValue(ifs, references.rightToFirstAllel) &&
+        _readIndexSCFs(ifs, references.rightSCFStart, references.rightSCFLength, references.rightSCFs,
+                references.rightSCFToSegIds, references.rightSegToScfId, references.rightSCFPos);
+
+    if (!good)
+    {
+        std::cerr << "The reference index file '" << path << "' is truncated or corrupt." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+#endif
@@ -25,6 +25,8 @@
 #include <seqan/basic.h>
 #include <seqan/sequence.h>
 
+#include "read_id_store.h"
+
 enum RejectReason {
     NONE                     = 0,
     AVERAGE_QUAL_FAIL        = 1,
@@ -42,10 +44,14 @@ enum RejectReason {
 
 const CharString _CDRREJECTS[] = {"NONE","AVERAGE_QUAL_FAIL","MOTIF_AMBIGUOUS","NONSENSE_IN_CDR3","OUT_OF_READING_FRAME","SEGMENT_MATCH_FAILED","BROKEN_CDR_BOUNDARIES","TOO_SHORT_FOR_BARCODE","LOW_QUALITY_BARCODE_BASE","N_IN_BARCODE","READ_TOO_SHORT","CDR3_TOO_SHORT"};
 
+/**
+ * A rejected read, identified by its index in the ReadIdStore of the
+ * FastqMultiRecordCollection it was read into
+ */
 struct RejectEvent {
-    CharString id;
+    TReadId readId;
     RejectReason reason;
-    RejectEvent(CharString _id, RejectReason _reason) : id(_id), reason(_reason) {}
+    RejectEvent(TReadId _readId, RejectReason _reason) : readId(_readId), reason(_reason) {}
 };
 
 #endif
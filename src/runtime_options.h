@@ -39,6 +39,7 @@
 
 struct CdrOptions {
     CharString refFasta ;
+    CharString refIndexPath;
     CharString rlogPath;
     std::string bstPath;
     CharString aminoOut;
@@ -91,8 +92,11 @@ struct CdrOptions {
     unsigned minCDR3Length;
     bool rdtWithSequence;
     bool sortOutputFiles;
+    bool inputPreScan;
+    bool pinThreads;
+    bool scfKmerFilter;
     
-    CdrOptions() : qmin(0), bcQmin(0), jobs(1), reverse(false), mergeAllels(false), cacheMatches(false), qualClustering(false), simpleClustering(false), mergeIdenticalCDRs(false), pairedEnd(false), bcRevRead(false), maxErrRateV(0), maxErrRateJ(0), maxVCoreErrors(0), maxJCoreErrors(0), vSCFLength(0), jSCFLength(0), vSCFOffset(-999), jSCFOffset(-999), vSCFLengthAuto(false), vReadCrop(0), barcodeLength(0), barcodeMaxError(0), barcodeVDJRead(false), bcClustMaxErrRate(0), bcClustMaxFreqRate(0), singleEndFallback(false), minReadLength(0), minCDR3Length(0), rdtWithSequence(false), sortOutputFiles(false) {}
+    CdrOptions() : qmin(0), bcQmin(0), jobs(1), reverse(false), mergeAllels(false), cacheMatches(false), qualClustering(false), simpleClustering(false), mergeIdenticalCDRs(false), pairedEnd(false), bcRevRead(false), maxErrRateV(0), maxErrRateJ(0), maxVCoreErrors(0), maxJCoreErrors(0), vSCFLength(0), jSCFLength(0), vSCFOffset(-999), jSCFOffset(-999), vSCFLengthAuto(false), vReadCrop(0), barcodeLength(0), barcodeMaxError(0), barcodeVDJRead(false), bcClustMaxErrRate(0), bcClustMaxFreqRate(0), singleEndFallback(false), minReadLength(0), minCDR3Length(0), rdtWithSequence(false), sortOutputFiles(false), inputPreScan(false), pinThreads(false), scfKmerFilter(false) {}
 };
 
 // ============================================================================
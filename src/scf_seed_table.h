@@ -0,0 +1,160 @@
+// ============================================================================
+// IMSEQ - An immunogenetic sequence analysis tool
+// (C) Charite, Universitaetsmedizin Berlin
+// Author: Leon Kuchenbecker
+// ============================================================================
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License version 2 as published by
+// the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+// ============================================================================
+
+// ============================================================================
+// HEADER FILE DESCRIPTION
+// ============================================================================
+// A direct-addressed k-mer seed table over the segment core fragments (SCFs),
+// an alternative to the SWIFT filter for finding the read windows that may
+// contain an SCF match.
+//
+// An SCF of length L matching with at most k errors contains at least one of
+// its k+1 non-overlapping parts of length L/(k+1) without errors (pigeonhole
+// principle). The table maps the first seedLength bases of every part to the
+// SCF id and the part offset. Every read k-mer is looked up once, a hit at
+// read position p for an offset o yields the diagonal p - o. The SCF match
+// implied by the hit lies within [p - o - k, p - o + L + k).
+// ============================================================================
+
+#ifndef IMSEQ_SCF_SEED_TABLE_H
+#define IMSEQ_SCF_SEED_TABLE_H
+
+#include <vector>
+#include <algorithm>
+
+#include <seqan/basic.h>
+#include <seqan/sequence.h>
+
+#include "fixed_size_types.h"
+
+using namespace seqan;
+
+/**
+ * One occurrence of a seed within the SCFs
+ */
+struct SCFSeed {
+    uint32_t scfId;
+    uint32_t offset;    // Position of the seed within the SCF
+
+    SCFSeed() : scfId(0), offset(0) {}
+    SCFSeed(uint32_t _scfId, uint32_t _offset) : scfId(_scfId), offset(_offset) {}
+};
+
+struct SCFSeedTable {
+    /// Seeds are truncated to this length to bound the table size (4^10 buckets)
+    static unsigned const MAX_SEED_LENGTH = 10;
+
+    unsigned seedLength;                    // 0 if the parts are empty, i.e. k >= L
+    unsigned scfLength;                     // L
+    unsigned maxErrors;                     // k
+    std::vector<uint32_t> bucketBegins;     // For every seed code the first entry in 'seeds'
+    std::vector<SCFSeed> seeds;             // Seed occurrences ordered by seed code
+    std::vector<uint32_t> unseededSCFs;     // SCFs with an N in a part, they are candidates for every read
+
+    SCFSeedTable() : seedLength(0), scfLength(0), maxErrors(0) {}
+};
+
+/**
+ * Builds the seed table over a set of SCFs of equal length allowing for
+ * maxErrors errors per SCF match.
+ */
+template <typename TStringSet>
+void buildSCFSeedTable(SCFSeedTable & table, TStringSet const & scfs, unsigned const maxErrors)
+{
+    table = SCFSeedTable();
+    table.maxErrors = maxErrors;
+    if (empty(scfs))
+        return;
+    table.scfLength = length(scfs[0]);
+    unsigned const partLength = table.scfLength / (maxErrors + 1);
+    table.seedLength = partLength < SCFSeedTable::MAX_SEED_LENGTH ? partLength : SCFSeedTable::MAX_SEED_LENGTH;
+    if (table.seedLength == 0)
+    {
+        for (uint32_t scfId = 0; scfId < length(scfs); ++scfId)
+            table.unseededSCFs.push_back(scfId);
+        return;
+    }
+
+    // Collect the (code, seed) pairs
+    std::vector<std::pair<uint32_t, SCFSeed> > codedSeeds;
+    for (uint32_t scfId = 0; scfId < length(scfs); ++scfId)
+    {
+        std::vector<std::pair<uint32_t, SCFSeed> > scfSeeds;
+        for (unsigned part = 0; part <= maxErrors; ++part)
+        {
+            uint32_t const offset = part * partLength;
+            uint32_t code = 0;
+            unsigned pos = 0;
+            for (; pos < table.seedLength && ordValue(scfs[scfId][offset + pos]) < 4; ++pos)
+                code = (code << 2) | ordValue(scfs[scfId][offset + pos]);
+            if (pos < table.seedLength)
+                break;
+            scfSeeds.push_back(std::make_pair(code, SCFSeed(scfId, offset)));
+        }
+        if (scfSeeds.size() == maxErrors + 1)
+            codedSeeds.insert(codedSeeds.end(), scfSeeds.begin(), scfSeeds.end());
+        else
+            table.unseededSCFs.push_back(scfId);
+    }
+
+    // Counting sort by code
+    table.bucketBegins.assign((size_t(1) << (2 * table.seedLength)) + 1, 0);
+    for (std::pair<uint32_t, SCFSeed> const & cs : codedSeeds)
+        ++table.bucketBegins[cs.first + 1];
+    for (size_t i = 1; i < table.bucketBegins.size(); ++i)
+        table.bucketBegins[i] += table.bucketBegins[i - 1];
+    table.seeds.resize(codedSeeds.size());
+    std::vector<uint32_t> fill(table.bucketBegins.begin(), table.bucketBegins.end() - 1);
+    for (std::pair<uint32_t, SCFSeed> const & cs : codedSeeds)
+        table.seeds[fill[cs.first]++] = cs.second;
+}
+
+/**
+ * Calls f(scfId, diagonal) for every seed hit within the read. Reads k-mers
+ * containing an N are skipped, the SCFs listed in unseededSCFs are not
+ * reported.
+ */
+template <typename TSequence, typename TFunctor>
+void forEachSCFSeedHit(TSequence const & readSeq, SCFSeedTable const & table, TFunctor && f)
+{
+    if (table.seedLength == 0)
+        return;
+    uint32_t const mask = (uint32_t(1) << (2 * table.seedLength)) - 1;
+    uint32_t code = 0;
+    unsigned valid = 0;
+    for (size_t i = 0; i < length(readSeq); ++i)
+    {
+        unsigned const c = ordValue(readSeq[i]);
+        if (c > 3)
+        {
+            valid = 0;
+            continue;
+        }
+        code = ((code << 2) | c) & mask;
+        if (++valid < table.seedLength)
+            continue;
+        long long const seedPos = static_cast<long long>(i + 1 - table.seedLength);
+        for (uint32_t s = table.bucketBegins[code]; s < table.bucketBegins[code + 1]; ++s)
+            f(table.seeds[s].scfId, seedPos - static_cast<long long>(table.seeds[s].offset));
+    }
+}
+
+#endif
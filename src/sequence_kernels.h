@@ -0,0 +1,322 @@
+// ============================================================================
+// IMSEQ - An immunogenetic sequence analysis tool
+// (C) Charite, Universitaetsmedizin Berlin
+// Author: Leon Kuchenbecker
+// ============================================================================
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License version 2 as published by
+// the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+// ============================================================================
+
+// ============================================================================
+// HEADER FILE DESCRIPTION
+// ============================================================================
+// Low level sequence comparison kernels used in the barcode correction:
+//
+// packedLaneMismatches() counts the mismatching 2 bit lanes of two packed
+// sequences. On x86-64, AVX2 and SSE4.1 variants are selected at runtime
+// based on the CPU, otherwise a portable implementation is used.
+//
+// boundedEditDistance() computes the global Levenshtein distance of two
+// sequences up to a maximum number of errors using Myers' bit vector
+// algorithm. Only the blocks within the Ukkonen band are computed and the
+// computation stops as soon as the maximum number of errors is exceeded.
+// ============================================================================
+
+#ifndef IMSEQ_SEQUENCE_KERNELS_H
+#define IMSEQ_SEQUENCE_KERNELS_H
+
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+
+#include <seqan/basic.h>
+
+#include "fixed_size_types.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define IMSEQ_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+using namespace seqan;
+
+// ============================================================================
+// Packed Hamming distance
+// ============================================================================
+
+typedef size_t (*TLaneMismatchKernel)(uint64_t const *, uint64_t const *, size_t, size_t);
+
+/**
+ * Reduces the XOR of two packed words to one bit per mismatching 2 bit lane
+ */
+inline uint64_t _laneMismatchBits(uint64_t const diff)
+{
+    return (diff | (diff >> 1)) & 0x5555555555555555ULL;
+}
+
+/**
+ * Portable implementation of packedLaneMismatches()
+ */
+inline size_t _packedLaneMismatchesPortable(uint64_t const * wordsA, uint64_t const * wordsB, size_t const nWords, size_t const maxDist)
+{
+    size_t nErrors = 0;
+    for (size_t w = 0; w < nWords && nErrors <= maxDist; ++w)
+        nErrors += __builtin_popcountll(_laneMismatchBits(wordsA[w] ^ wordsB[w]));
+    return nErrors;
+}
+
+#ifdef IMSEQ_X86_KERNELS
+
+/**
+ * SSE4.1 implementation of packedLaneMismatches(), two words per step
+ */
+__attribute__((target("sse4.1,popcnt")))
+inline size_t _packedLaneMismatchesSSE41(uint64_t const * wordsA, uint64_t const * wordsB, size_t const nWords, size_t const maxDist)
+{
+    __m128i const laneMask = _mm_set1_epi64x(0x5555555555555555LL);
+    size_t nErrors = 0;
+    size_t w = 0;
+    for (; w + 2 <= nWords && nErrors <= maxDist; w += 2)
+    {
+        __m128i diff = _mm_xor_si128(
+                _mm_loadu_si128(reinterpret_cast<__m128i const *>(wordsA + w)),
+                _mm_loadu_si128(reinterpret_cast<__m128i const *>(wordsB + w)));
+        diff = _mm_and_si128(_mm_or_si128(diff, _mm_srli_epi64(diff, 1)), laneMask);
+        nErrors += _mm_popcnt_u64(_mm_extract_epi64(diff, 0)) + _mm_popcnt_u64(_mm_extract_epi64(diff, 1));
+    }
+    for (; w < nWords; ++w)
+        nErrors += _mm_popcnt_u64(_laneMismatchBits(wordsA[w] ^ wordsB[w]));
+    return nErrors;
+}
+
+/**
+ * AVX2 implementation of packedLaneMismatches(), four words per step. The
+ * lane bits are counted using a nibble lookup table.
+ */
+__attribute__((target("avx2,popcnt")))
+inline size_t _packedLaneMismatchesAVX2(uint64_t const * wordsA, uint64_t const * wordsB, size_t const nWords, size_t const maxDist)
+{
+    __m256i const laneMask   = _mm256_set1_epi64x(0x5555555555555555LL);
+    __m256i const nibbleMask = _mm256_set1_epi8(0x0F);
+    __m256i const nibbleCnt  = _mm256_setr_epi8(
+            0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+            0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    size_t nErrors = 0;
+    size_t w = 0;
+    for (; w + 4 <= nWords && nErrors <= maxDist; w += 4)
+    {
+        __m256i diff = _mm256_xor_si256(
+                _mm256_loadu_si256(reinterpret_cast<__m256i const *>(wordsA + w)),
+                _mm256_loadu_si256(reinterpret_cast<__m256i const *>(wordsB + w)));
+        diff = _mm256_and_si256(_mm256_or_si256(diff, _mm256_srli_epi64(diff, 1)), laneMask);
+        __m256i cnt = _mm256_add_epi8(
+                _mm256_shuffle_epi8(nibbleCnt, _mm256_and_si256(diff, nibbleMask)),
+                _mm256_shuffle_epi8(nibbleCnt, _mm256_and_si256(_mm256_srli_epi16(diff, 4), nibbleMask)));
+        cnt = _mm256_sad_epu8(cnt, _mm256_setzero_si256());
+        nErrors += _mm256_extract_epi64(cnt, 0) + _mm256_extract_epi64(cnt, 1)
+            + _mm256_extract_epi64(cnt, 2) + _mm256_extract_epi64(cnt, 3);
+    }
+    for (; w < nWords; ++w)
+        nErrors += _mm_popcnt_u64(_laneMismatchBits(wordsA[w] ^ wordsB[w]));
+    return nErrors;
+}
+
+/**
+ * Picks the best packedLaneMismatches() implementation supported by the CPU
+ */
+inline TLaneMismatchKernel _selectLaneMismatchKernel()
+{
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt"))
+        return &_packedLaneMismatchesAVX2;
+    if (__builtin_cpu_supports("sse4.1") && __builtin_cpu_supports("popcnt"))
+        return &_packedLaneMismatchesSSE41;
+    return &_packedLaneMismatchesPortable;
+}
+
+#else
+
+inline TLaneMismatchKernel _selectLaneMismatchKernel()
+{
+    return &_packedLaneMismatchesPortable;
+}
+
+#endif
+
+/**
+ * Counts the mismatching 2 bit lanes of two arrays of packed words. The
+ * counting may stop early once more than maxDist mismatches were found, the
+ * returned count is then larger than maxDist but not necessarily exact.
+ */
+inline size_t packedLaneMismatches(uint64_t const * wordsA, uint64_t const * wordsB, size_t const nWords, size_t const maxDist)
+{
+    static TLaneMismatchKernel const kernel = _selectLaneMismatchKernel();
+    // Barcodes usually fit into a single word, which is not worth a dispatch
+    if (nWords == 1)
+        return __builtin_popcountll(_laneMismatchBits(wordsA[0] ^ wordsB[0]));
+    return kernel(wordsA, wordsB, nWords, maxDist);
+}
+
+// ============================================================================
+// Banded bit vector edit distance
+// ============================================================================
+
+/**
+ * Bit vector state of one 64 row block of the current DP matrix column.
+ * score holds the DP value of the last row of the block.
+ */
+struct MyersBlock {
+    uint64_t pv;
+    uint64_t mv;
+    int      score;
+};
+
+/**
+ * Advances one block by one column, given the match mask of the column
+ * character and the horizontal delta entering the block from above. Returns
+ * the horizontal delta leaving the block at the bottom.
+ */
+inline int _myersBlockStep(MyersBlock & block, uint64_t eq, int const hin)
+{
+    uint64_t const pv = block.pv;
+    uint64_t const mv = block.mv;
+    uint64_t const xv = eq | mv;
+    if (hin < 0)
+        eq |= 1;
+    uint64_t const xh = (((eq & pv) + pv) ^ pv) | eq;
+    uint64_t ph = mv | ~(xh | pv);
+    uint64_t mh = pv & xh;
+
+    int hout = 0;
+    if (ph >> 63)
+        hout = 1;
+    else if (mh >> 63)
+        hout = -1;
+
+    ph <<= 1;
+    mh <<= 1;
+    if (hin < 0)
+        mh |= 1;
+    else if (hin > 0)
+        ph |= 1;
+    block.pv = mh | ~(xv | ph);
+    block.mv = ph & xv;
+    return hout;
+}
+
+/**
+ * Computes the global Levenshtein distance of two Dna5 sequences if it is at
+ * most maxErrors, otherwise returns maxErrors + 1. The first sequence is
+ * encoded as bit vectors in 64 row blocks, the second one is streamed
+ * column by column. Blocks whose cells can no longer be part of an alignment
+ * with at most maxErrors errors are not computed.
+ */
+template<typename TSequenceA, typename TSequenceB>
+unsigned boundedEditDistance(TSequenceA const & seqA, TSequenceB const & seqB, unsigned const maxErrors)
+{
+    int const m = length(seqA);
+    int const n = length(seqB);
+    int const k = maxErrors;
+    if (std::abs(m - n) > k)
+        return maxErrors + 1;
+    if (m == 0 || n == 0)
+        return std::max(m, n);
+
+    int const nBlocks = (m + 63) / 64;
+    int const padding = nBlocks * 64 - m;
+
+    // Match masks per block and Dna5 character, padding rows never match
+    static thread_local std::vector<uint64_t> peq;
+    static thread_local std::vector<MyersBlock> blocks;
+    peq.assign(nBlocks * 5, 0);
+    for (int i = 0; i < m; ++i)
+        peq[(i / 64) * 5 + ordValue(value(seqA, i))] |= 1ULL << (i % 64);
+
+    // The first column of the DP matrix increases by one per row
+    blocks.resize(nBlocks);
+    int firstBlock = 0;
+    int lastBlock  = std::min(nBlocks - 1, k / 64);
+    for (int b = 0; b <= lastBlock; ++b)
+    {
+        blocks[b].pv    = ~0ULL;
+        blocks[b].mv    = 0;
+        blocks[b].score = (b + 1) * 64;
+    }
+
+    for (int j = 1; j <= n; ++j)
+    {
+        unsigned const c = ordValue(value(seqB, j - 1));
+
+        // Rows above firstBlock are assumed to increase by one per column,
+        // which overestimates them and leaves the band unaffected
+        int hout = 1;
+        for (int b = firstBlock; b <= lastBlock; ++b)
+        {
+            hout = _myersBlockStep(blocks[b], peq[b * 5 + c], hout);
+            blocks[b].score += hout;
+        }
+
+        // Activate the next block if its first row can reach at most k. The
+        // first block is activated below the first row of the matrix.
+        while (lastBlock + 1 < nBlocks)
+        {
+            int const aboveScore = lastBlock >= 0 ? blocks[lastBlock].score : j;
+            if (aboveScore - hout > k && aboveScore >= k)
+                break;
+            MyersBlock & next = blocks[++lastBlock];
+            next.pv    = ~0ULL;
+            next.mv    = 0;
+            next.score = aboveScore - hout + 64;
+            hout = _myersBlockStep(next, peq[lastBlock * 5 + c], hout);
+            next.score += hout;
+        }
+
+        // Deactivate the last block if none of its cells is within the band
+        while (lastBlock >= firstBlock)
+        {
+            int const top   = lastBlock * 64 + 1;
+            int const score = blocks[lastBlock].score;
+            if (score - 63 <= k && score - 64 * (lastBlock + 1) + 2 * top - m + n - j <= k)
+                break;
+            --lastBlock;
+        }
+
+        // Deactivate the first block if all of its cells lie above the band
+        // for good
+        while (firstBlock <= lastBlock
+                && blocks[firstBlock].score - 64 * (firstBlock + 1) + m - n + j > k)
+            ++firstBlock;
+
+        // Stop if no active cell is left, unless the first row of the matrix
+        // can still be part of an alignment within the band
+        if (firstBlock > lastBlock && (firstBlock > 0 || j + std::abs(m - n + j) > k))
+            return maxErrors + 1;
+    }
+
+    if (lastBlock != nBlocks - 1)
+        return maxErrors + 1;
+
+    // Remove the vertical deltas of the padding rows from the last block score
+    MyersBlock const & last = blocks[nBlocks - 1];
+    int dist = last.score;
+    if (padding > 0)
+    {
+        uint64_t const paddingMask = ~0ULL << (64 - padding);
+        dist -= __builtin_popcountll(last.pv & paddingMask) - __builtin_popcountll(last.mv & paddingMask);
+    }
+    return dist <= k ? dist : maxErrors + 1;
+}
+
+#endif
@@ -23,40 +23,140 @@
 
 #ifdef __WITHCDR3THREADS__
 
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace {
+// the pool and the index of the worker running on the current thread
+thread_local ThreadPool * currentPool = NULL;
+thread_local size_t currentIndex = 0;
+}
+
 unsigned ThreadPool::nWorkers() {
     return workers.size();
 }
  
 void Worker::operator()()
 {
+    currentPool = &pool;
+    currentIndex = index;
+    std::function<void()> task;
     while(true)
     {
-        std::unique_lock<std::mutex> lock(pool.queue_mutex); /////
-        while(!pool.stop && pool.tasks.empty())                 //
-            pool.condition.wait(lock);                          //
-        if(pool.stop && pool.tasks.empty())                     // queue_mutex locked
-            return;                                             //
-        std::function<void()> task(pool.tasks.front());         //
-        pool.tasks.pop();                                       //
-        lock.unlock(); ///////////////////////////////////////////
-        task();
+        if (pool.pop(index, task)) {
+            task();
+            task = nullptr;
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(pool.queue_mutex);
+        while(!pool.stop && pool.queued == 0)
+            pool.condition.wait(lock);
+        if(pool.stop && pool.queued == 0)
+            return;
     }
 }
- 
-// the constructor just launches some amount of workers
-ThreadPool::ThreadPool(size_t threads)
-    :   stop(false) 
+
+// workers push to their own deque, other threads round robin
+void ThreadPool::push(std::function<void()> task)
+{
+    size_t index = currentPool == this ? currentIndex : nextQueue++ % queues.size();
+    {
+        std::unique_lock<std::mutex> lock(queues[index]->mutex);
+        queues[index]->tasks.push_back(std::move(task));
+        ++queued;
+    }
+    // synchronize with workers about to sleep
+    { std::unique_lock<std::mutex> lock(queue_mutex); }
+    condition.notify_one();
+}
+
+// takes a task from the back of the own deque or steals one from the front
+// of another worker's deque
+bool ThreadPool::pop(size_t index, std::function<void()> & task)
+{
+    for (size_t k = 0; k < queues.size(); ++k) {
+        WorkerQueue & queue = *queues[(index + k) % queues.size()];
+        std::unique_lock<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty())
+            continue;
+        if (k == 0) {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        } else {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+        --queued;
+        return true;
+    }
+    return false;
+}
+
+void TaskGroup::finish()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    if (--pending == 0)
+        condition.notify_all();
+}
+
+void TaskGroup::fail(std::exception_ptr e)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    if (!error)
+        error = e;
+}
+
+// waits until all ranges of the parallelFor() call are finished and rethrows
+// the first exception thrown by its body
+void TaskGroup::wait()
 {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (pending != 0)
+        condition.wait(lock);
+    if (error) {
+        std::exception_ptr e = error;
+        error = nullptr;
+        std::rethrow_exception(e);
+    }
+}
+
+// the constructor just launches some amount of workers. If requested, the
+// workers are pinned to the CPUs round robin (Linux only).
+ThreadPool::ThreadPool(size_t threads, bool pinThreads)
+    :   nextQueue(0), queued(0), stop(false) 
+{
+    if (threads == 0)
+        threads = 1;
+    for(size_t i = 0;i<threads;++i)
+        queues.push_back(std::unique_ptr<WorkerQueue>(new WorkerQueue()));
     for(size_t i = 0;i<threads;++i)
-        workers.push_back(std::thread(Worker(*this)));
+        workers.push_back(std::thread(Worker(*this, i)));
+#ifdef __linux__
+    unsigned const nCpus = std::thread::hardware_concurrency();
+    if (pinThreads && nCpus > 0) {
+        for(size_t i = 0;i<workers.size();++i) {
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(i % nCpus, &cpus);
+            pthread_setaffinity_np(workers[i].native_handle(), sizeof(cpus), &cpus);
+        }
+    }
+#else
+    (void)pinThreads;
+#endif
 }
 
 
- 
+
 // the destructor joins all threads
 ThreadPool::~ThreadPool()
 {
-    stop = true;
+    {
+        std::unique_lock<std::mutex> lock(queue_mutex);
+        stop = true;
+    }
     condition.notify_all();
     for(size_t i = 0;i<workers.size();++i)
         workers[i].join();
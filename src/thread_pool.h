@@ -24,48 +24,95 @@
 
 #include "thread_check.h"
 
+// declared in any case, such that stages can pass a pool pointer around
+class ThreadPool;
+
 #ifdef __WITHCDR3THREADS__
 
 #include <vector>
-#include <queue>
+#include <deque>
 #include <memory>
 #include <thread>
 #include <mutex>
+#include <atomic>
 #include <condition_variable>
 #include <future>
 #include <functional>
 #include <stdexcept>
-
-class ThreadPool;
+#include <exception>
 
 // our worker thread objects
 class Worker {
 public:
-    Worker(ThreadPool &s) : pool(s) { }
+    Worker(ThreadPool &s, size_t i) : pool(s), index(i) { }
     void operator()();
 private:
     ThreadPool &pool;
+    size_t index;
+};
+
+// the task deque of one worker. The owner takes tasks from the back, idle
+// workers steal from the front.
+struct WorkerQueue {
+    std::mutex mutex;
+    std::deque< std::function<void()> > tasks;
+};
+
+// the completion handle of one parallelFor() call. Other tasks on the pool
+// are not waited for.
+class TaskGroup {
+public:
+    TaskGroup() : pending(0) { }
+    void wait();
+private:
+    friend class ThreadPool;
+
+    void finish();
+    void fail(std::exception_ptr error);
+
+    // number of unfinished ranges
+    size_t pending;
+    // first exception thrown by the parallelFor() body
+    std::exception_ptr error;
+
+    std::mutex mutex;
+    std::condition_variable condition;
 };
 
-// the actual thread pool
+// the actual thread pool, a work-stealing scheduler
 class ThreadPool {
 public:
-    ThreadPool(size_t);
+    ThreadPool(size_t, bool pinThreads = false);
     template<class T, class F>
     std::future<T> enqueue(F f);
+    template<class F>
+    std::shared_ptr<TaskGroup> parallelFor(size_t begin, size_t end, size_t grain, F f);
     unsigned nWorkers();
     ~ThreadPool();
 private:
     friend class Worker;
-    
+
+    void push(std::function<void()> task);
+    bool pop(size_t index, std::function<void()> & task);
+    template<class F>
+    void pushRange(size_t begin, size_t end, size_t grain, std::shared_ptr<F> const & body,
+            std::shared_ptr<TaskGroup> const & group);
+    template<class F>
+    void runRange(size_t begin, size_t end, size_t grain, std::shared_ptr<F> const & body,
+            std::shared_ptr<TaskGroup> const & group);
+
     // need to keep track of threads so we can join them
     std::vector< std::thread > workers;
-    // the task queue
-    std::queue< std::function<void()> > tasks;
-    
+    // one task deque per worker
+    std::vector< std::unique_ptr<WorkerQueue> > queues;
+    // tasks submitted from outside the pool are distributed round robin
+    std::atomic<size_t> nextQueue;
+    // number of queued tasks
+    std::atomic<size_t> queued;
+
     // synchronization
-    std::mutex queue_mutex, wait_mutex;
-    std::condition_variable condition, wait_condition;
+    std::mutex queue_mutex;
+    std::condition_variable condition;
     bool stop;
 };
 
@@ -78,15 +125,58 @@ std::future<T> ThreadPool::enqueue(F f)
         throw std::runtime_error("ThreadPool::enqueue()[E001]");
 
     auto task = std::make_shared< std::packaged_task<T()> >(f);
-    std::future<T> res = task->get_future();    
-    { ////////////////////////////////////////////////////////////
-        std::unique_lock<std::mutex> lock(queue_mutex);         // 
-        tasks.push([task](){ (*task)(); });                     // queue mutex locked
-    } ////////////////////////////////////////////////////////////
-    condition.notify_one();
+    std::future<T> res = task->get_future();
+    push([task](){ (*task)(); });
     return res;
 }
 
+// calls f(i) for every i in [begin, end). The range is submitted as a single
+// task which is split in halves by the workers until at most grain indices
+// are left. Use wait() of the returned TaskGroup to wait for completion.
+template<class F>
+std::shared_ptr<TaskGroup> ThreadPool::parallelFor(size_t begin, size_t end, size_t grain, F f)
+{
+    if(stop)
+        throw std::runtime_error("ThreadPool::parallelFor()[E001]");
+    auto group = std::make_shared<TaskGroup>();
+    pushRange(begin, end, grain > 0 ? grain : 1, std::make_shared<F>(std::move(f)), group);
+    return group;
+}
+
+// the group is joined before the range is pushed, such that it cannot
+// complete while a split range is still queued
+template<class F>
+void ThreadPool::pushRange(size_t begin, size_t end, size_t grain, std::shared_ptr<F> const & body,
+        std::shared_ptr<TaskGroup> const & group)
+{
+    if (begin < end) {
+        {
+            std::unique_lock<std::mutex> lock(group->mutex);
+            ++group->pending;
+        }
+        push([this, begin, end, grain, body, group](){ runRange(begin, end, grain, body, group); });
+    }
+}
+
+template<class F>
+void ThreadPool::runRange(size_t begin, size_t end, size_t grain, std::shared_ptr<F> const & body,
+        std::shared_ptr<TaskGroup> const & group)
+{
+    // leave the upper halves to be stolen by idle workers
+    while (end - begin > grain) {
+        size_t mid = begin + (end - begin) / 2;
+        pushRange(mid, end, grain, body, group);
+        end = mid;
+    }
+    try {
+        for (size_t i = begin; i < end; ++i)
+            (*body)(i);
+    } catch (...) {
+        group->fail(std::current_exception());
+    }
+    group->finish();
+}
+
 #endif // Multi-threading enabled
 
 #endif // Include guard
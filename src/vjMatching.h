@@ -31,6 +31,9 @@
 
 #include <cstdlib>
 #include <climits>
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
 #include <seqan/basic.h>
 #include <seqan/sequence.h>
 #include <seqan/align.h>
@@ -39,11 +42,16 @@
 #include "globalData.h"
 #include "overlap_specs.h"
 #include "extdir_oldir_conversion.h"
+#include "block_arena.h"
 
 /********************************************************************************
  * STRUCTS AND CLASSES
  *******************************************************************************/
 
+/// Read infixes to verify per SCF id, lives in the arena of the current thread
+typedef std::map<unsigned, BeginEndPos<long long>, std::less<unsigned>,
+        ArenaAllocator<std::pair<unsigned const, BeginEndPos<long long> > > > TSCFInfixPosMap;
+
 template<typename TSeq>
 struct RefMatch {
     typedef Align<TSeq> TAlign;
@@ -264,15 +272,21 @@ int semiglobalAlignmentScoreMyers(int & endPos, TText & text, TPattern & pattern
     return -minErrors;
 }
 
+/**
+ * Verifies the SCF filter hits within a read. scfPatterns holds the Myers
+ * patterns of all SCFs, the caller provides a copy of the ones prepared in
+ * CdrReferences which is reused for all reads of a block.
+ */
 template <typename TSequence>
 String<CandidateCoreSegmentMatch> verifySCFHits(
         TSequence const & readSeq,
-        StringSet<TSequence> const & scfSequences,
-        std::map<unsigned, BeginEndPos<long long> > scfInfixPositions,
+        CdrReferences::TSCFPatterns & scfPatterns,
+        TSCFInfixPosMap const & scfInfixPositions,
         int const maxErrors)
 {
-    typedef std::map<unsigned, BeginEndPos<long long> > TInfixPosMap;
+    typedef TSCFInfixPosMap TInfixPosMap;
     typedef typename Infix<TSequence const>::Type       TInfix;
+    typedef Value<CdrReferences::TSCFPatterns>::Type    TMyersPattern;
 
     String<CandidateCoreSegmentMatch> ccsms;
 
@@ -285,11 +299,10 @@ String<CandidateCoreSegmentMatch> verifySCFHits(
         TBeginEndPos const & infixPos = scfInfixPosition->second;
         // Build the infix-SCF alignment
         TInfix readInfix(readSeq, infixPos.beginPos, infixPos.endPos);
-        // "Pseudoinfix" to maintain type equality
-        TInfix segInfix(scfSequences[coreSegId]);
 
-        // Use Myers finder to find all locations within constraints
-        Pattern<TInfix, Myers<> > myersPattern(segInfix);
+        // Use Myers finder to find all locations within constraints. The
+        // pattern state is reinitialized by the first find() on a new finder.
+        TMyersPattern & myersPattern = scfPatterns[coreSegId];
         Finder<TInfix> finder(readInfix);
 
         int bestScore = MinValue<int>::VALUE;
@@ -321,13 +334,13 @@ String<CandidateCoreSegmentMatch> verifySCFHits(
 }
 
 template <typename TSequence, typename TSegmentPattern>
-std::map<unsigned, BeginEndPos<long long> > filterSCFs(
+TSCFInfixPosMap filterSCFs(
         TSequence & readSeq,
         TSegmentPattern & segmentPattern,
         double const errRate,
-        std::set<unsigned> const * scfIdLim = nullptr)
+        TArenaIdSet const * scfIdLim = nullptr)
 {
-    typedef std::map<unsigned, BeginEndPos<long long> >                 TInfixPosMap;
+    typedef TSCFInfixPosMap                                             TInfixPosMap;
     typedef Finder<TSequence, Swift<SwiftSemiGlobal> >                  TFinder;
 
     TInfixPosMap scfInfixPositions;
@@ -370,35 +383,81 @@ std::map<unsigned, BeginEndPos<long long> > filterSCFs(
     return scfInfixPositions;
 }
 
+/**
+ * Alternative to filterSCFs() using the k-mer seed table of the SCFs. Every
+ * SCF match with at most maxErrors errors lies within the returned window of
+ * its SCF, see scf_seed_table.h.
+ */
+template <typename TSequence>
+TSCFInfixPosMap filterSCFsBySeeds(
+        TSequence const & readSeq,
+        SCFSeedTable const & seedTable,
+        TArenaIdSet const * scfIdLim = nullptr)
+{
+    typedef TSCFInfixPosMap TInfixPosMap;
+
+    TInfixPosMap scfInfixPositions;
+
+    // No legal SCFS? Return empty result
+    if (scfIdLim != nullptr && scfIdLim->empty())
+        return scfInfixPositions;
+
+    long long const readLength = length(readSeq);
+    auto addWindow = [&](unsigned const coreSegId, long long const beginPos, long long const endPos)
+    {
+        // Skip if a limited set was specified and the id is not in it
+        if (scfIdLim != nullptr && scfIdLim->find(coreSegId) == scfIdLim->end())
+            return;
+        if (endPos <= beginPos)
+            return;
+        // Merge with previous hits on the same segment
+        TInfixPosMap::iterator scfInfixPosition = scfInfixPositions.find(coreSegId);
+        if (scfInfixPosition != scfInfixPositions.end()) {
+            BeginEndPos<long long> & infixPos = scfInfixPosition->second;
+            infixPos.beginPos = std::min(infixPos.beginPos, beginPos);
+            infixPos.endPos   = std::max(infixPos.endPos, endPos);
+        } else {
+            scfInfixPositions[coreSegId] = BeginEndPos<long long>(beginPos, endPos);
+        }
+    };
+
+    // SCFs without seeds have to be verified against the whole read
+    for (uint32_t const coreSegId : seedTable.unseededSCFs)
+        addWindow(coreSegId, 0, readLength);
+    forEachSCFSeedHit(readSeq, seedTable, [&](unsigned const coreSegId, long long const diagonal)
+    {
+        addWindow(coreSegId,
+                std::max(0LL, diagonal - static_cast<long long>(seedTable.maxErrors)),
+                std::min(readLength, diagonal + seedTable.scfLength + seedTable.maxErrors));
+    });
+
+    return scfInfixPositions;
+}
 
-template <typename TStringSet>
+template <typename TStringSet, typename TIndex>
 void findCandidateCoreSegments(
         StringSet<String<CandidateCoreSegmentMatch> > & results,        // [OUT] One String of candidate SCFs for each input read sequence
         TStringSet const & readSequences,                               // [IN]  The input read sequences
         TStringSet const & scfSequences,                                // [IN]  The core fragments of the segment sequences
+        TIndex & scfIndex,                                              // [IN]  The prebuilt q-gram index over the core fragments
+        CdrReferences::TSCFPatterns const & scfPatterns,                // [IN]  The prebuilt Myers patterns of the core fragments
+        SCFSeedTable const * seedTable,                                 // [IN]  The k-mer seed table to filter with, SWIFT if NULL
         int const maxErrors                                             // [IN]  Maximum #errors for the core fragment alignment
         )
 {
     // Extract types from passed arguments
     typedef typename Value<TStringSet>::Type                            TSequence;
-    typedef typename Value<TSequence>::Type                             TAlphabet;
 
     // Types required for filtering
-    typedef Shape<TAlphabet, SimpleShape>                               TShape;
-    typedef Index<TStringSet, IndexQGram<TShape, OpenAddressing> >      TIndex;
     typedef Pattern<TIndex, Swift<SwiftSemiGlobal> >                    TPattern;
-    typedef typename Infix<TSequence const>::Type                       TInfix;
-    typedef Align<TInfix>                                               TAlign;
-    typedef std::map<unsigned, BeginEndPos<long long> >                 TInfixPosMap;
+    typedef TSCFInfixPosMap                                             TInfixPosMap;
 
-    // Constants
-    Score<int,Simple> const sc(1,-1,-1);
-
-    // Pattern is constructed over segment core fragments, Finder is called on read sequences
+    // Pattern is constructed over the shared segment core fragment index, it
+    // only holds the per-thread filter state. Finder is called on read sequences
     double const errRate = 1.0 * maxErrors / length(scfSequences[0]); // The length of all SCFs is the same
-    TIndex segmentIndex(scfSequences);
-    resize(indexShape(segmentIndex), length(scfSequences[0]) / (maxErrors+1));
-    TPattern segmentPattern(segmentIndex);
+    TPattern segmentPattern(scfIndex);
+    // Per-block copy of the verification patterns
+    CdrReferences::TSCFPatterns verifyPatterns = scfPatterns;
 
     clear(results);
     reserve(results, length(readSequences));
@@ -410,10 +469,12 @@ void findCandidateCoreSegments(
         TSequence & readSeq = const_cast<TSequence &>(*readIt);
 
         // Filter
-        TInfixPosMap scfInfixPositions = filterSCFs(readSeq, segmentPattern, errRate);
+        TInfixPosMap scfInfixPositions = seedTable != nullptr
+            ? filterSCFsBySeeds(readSeq, *seedTable)
+            : filterSCFs(readSeq, segmentPattern, errRate);
 
         // Verification
-        String<CandidateCoreSegmentMatch> ccsms = verifySCFHits(readSeq, scfSequences, scfInfixPositions, maxErrors);
+        String<CandidateCoreSegmentMatch> ccsms = verifySCFHits(readSeq, verifyPatterns, scfInfixPositions, maxErrors);
 
         appendValue(results, ccsms);
     }
@@ -466,6 +527,153 @@ void refineTerminalGaps(TAlign & align)
     _refineTerminalGaps(row(align, 1), row(align, 0));
 }
 
+typedef Segment<String<Dna5> const, InfixSegment> TOverlapSegment;
+
+/**
+ * The segment part and the band of the overlap alignment of a read with a
+ * gene segment, shared by extendToOverlapAlignment() and
+ * overlapAlignmentScore().
+ *
+ * @special Left overlap
+ */
+template <typename TReadSequence>
+TOverlapSegment _overlapAlignmentSetup(
+        int & lowerDiag,                        // [OUT] The lower diagonal of the band
+        int & upperDiag,                        // [OUT] The upper diagonal of the band
+        CandidateCoreSegmentMatch const & ccsm, // [IN]  The candidate core segment match
+        TReadSequence const &,
+        unsigned const segId,                   // [IN]  The gene segment ID
+        CdrReferences const & references,       // [IN]  The references
+        double const & maxErrRate,              // [IN]  The maximum error rate allowed
+        int shift,                              // [IN]  The SCF shift / offset
+        LeftOverlap const                       // [TAG] The overlap direction
+        )
+{
+    // Build the segment
+    BeginEndPos<unsigned> const window = getAlignmentWindow(references, segId, shift, LeftOverlap());
+    TOverlapSegment segSegment(references.leftSegs[segId], window.beginPos, window.endPos);
+
+    unsigned maxErrors = static_cast<unsigned>(std::ceil(1.0 * ccsm.readEndPos * maxErrRate));
+
+    int diag = - length(segSegment) + ccsm.readEndPos;
+    if (shift < 0)
+        diag += -shift;
+    if (diag > 0)
+        diag = 0;
+
+    lowerDiag = diag - maxErrors;
+    upperDiag = diag + maxErrors + 1;
+    return segSegment;
+}
+
+/**
+ * @special Right overlap
+ */
+template <typename TReadSequence>
+TOverlapSegment _overlapAlignmentSetup(
+        int & lowerDiag,                        // [OUT] The lower diagonal of the band
+        int & upperDiag,                        // [OUT] The upper diagonal of the band
+        CandidateCoreSegmentMatch const & ccsm, // [IN]  The candidate core segment match
+        TReadSequence const & readSeq,
+        unsigned const segId,                   // [IN]  The gene segment ID
+        CdrReferences const & references,       // [IN]  The references
+        double const &,                         // [IN]  The maximum error rate allowed
+        int shift,                              // [IN]  The SCF shift / offset
+        RightOverlap const                      // [TAG] The overlap direction
+        )
+{
+    // Build the segment
+    BeginEndPos<unsigned> const window = getAlignmentWindow(references, segId, shift, RightOverlap());
+    TOverlapSegment segSegment(references.rightSegs[segId], window.beginPos, window.endPos);
+
+    unsigned maxErrors = static_cast<unsigned>(length(readSeq) - ccsm.readBeginPos);
+
+    int diag = ccsm.readBeginPos;
+
+    lowerDiag = diag - maxErrors;
+    upperDiag = diag + maxErrors + 1;
+    return segSegment;
+}
+
+/**
+ * Number of alignment window positions, counted from the SCF side, that lie
+ * within the band. One position of margin is kept.
+ *
+ * @special Left overlap
+ */
+inline unsigned _bandedWindowLength(int const, int const upperDiag, unsigned const, unsigned const windowLength,
+        LeftOverlap const)
+{
+    long long const firstPos = std::max(0LL, -static_cast<long long>(upperDiag) - 1);
+    return firstPos >= windowLength ? 0 : windowLength - firstPos;
+}
+
+/**
+ * @special Right overlap
+ */
+inline unsigned _bandedWindowLength(int const lowerDiag, int const, unsigned const readLength, unsigned const windowLength,
+        RightOverlap const)
+{
+    long long const endPos = static_cast<long long>(readLength) - lowerDiag + 1;
+    return endPos <= 0 ? 0 : std::min<long long>(endPos, windowLength);
+}
+
+/**
+ * The length of the alignment window part, counted from the SCF side, that
+ * affects the overlap alignment of a read with a gene segment. The remaining
+ * window positions lie outside the band and are only aligned to free end
+ * gaps.
+ */
+template <typename TReadSequence, typename TOverlapDirection>
+unsigned bandedWindowLength(
+        CandidateCoreSegmentMatch const & ccsm, // [IN]  The candidate core segment match
+        TReadSequence const & readSeq,
+        unsigned const segId,                   // [IN]  The gene segment ID
+        CdrReferences const & references,       // [IN]  The references
+        double const & maxErrRate,              // [IN]  The maximum error rate allowed
+        int shift,                              // [IN]  The SCF shift / offset
+        TOverlapDirection const                 // [TAG] The overlap direction
+        )
+{
+    int lowerDiag, upperDiag;
+    TOverlapSegment segSegment = _overlapAlignmentSetup(lowerDiag, upperDiag, ccsm, readSeq, segId, references,
+            maxErrRate, shift, TOverlapDirection());
+    return _bandedWindowLength(lowerDiag, upperDiag, length(readSeq), length(segSegment), TOverlapDirection());
+}
+
+inline AlignConfig<true,true,false,true> _overlapAlignConfig(LeftOverlap const)
+{
+    return AlignConfig<true,true,false,true>();
+}
+
+inline AlignConfig<true,false,true,true> _overlapAlignConfig(RightOverlap const)
+{
+    return AlignConfig<true,false,true,true>();
+}
+
+/**
+ * Computes only the score of the overlap alignment built by
+ * extendToOverlapAlignment(), without traceback.
+ */
+template <typename TReadSequence, typename TOverlapDirection>
+int overlapAlignmentScore(
+        CandidateCoreSegmentMatch const & ccsm, // [IN]  The candidate core segment match
+        TReadSequence & readSeq,
+        unsigned const segId,                   // [IN]  The gene segment ID
+        CdrReferences const & references,       // [IN]  The references
+        double const & maxErrRate,              // [IN]  The maximum error rate allowed
+        int shift,                              // [IN]  The SCF shift / offset
+        TOverlapDirection const                 // [TAG] The overlap direction
+        )
+{
+    int lowerDiag, upperDiag;
+    TOverlapSegment segSegment = _overlapAlignmentSetup(lowerDiag, upperDiag, ccsm, readSeq, segId, references,
+            maxErrRate, shift, TOverlapDirection());
+    TOverlapSegment readSegment(readSeq);
+    return globalAlignmentScore(readSegment, segSegment, SimpleScore(1,-1,-1), _overlapAlignConfig(TOverlapDirection()),
+            lowerDiag, upperDiag);
+}
+
 template <typename TAlign, typename TReadSequence>
 int extendToOverlapAlignment(
         TAlign & align,                         // [OUT] The target alignment object
@@ -480,36 +688,22 @@ int extendToOverlapAlignment(
 {
     typedef typename Row<TAlign>::Type                          TRow;
     typedef typename Position<TRow>::Type                       TRowPos;
-    typedef typename Source<TRow>::Type                         TSource;
-    typedef typename Position<TSource>::Type                    TPos;
-    typedef Segment<String<Dna5> const, InfixSegment>           TSegment;
 
     // Prepare the target align object
     resize(rows(align), 2);
 
-    // The segment infix ends with the motif
-    TPos segmentEndPos = references.leftMeta[segId].motifPos + 3;
-    // If the SCF is shifted into the CDR3 region, extend
-    if (shift > 0)
-        segmentEndPos += shift;
     // Build the segments
-    TSegment segSegment(references.leftSegs[segId], 0, segmentEndPos);
-    TSegment readSegment(readSeq); // Dummy infix
-
-    unsigned maxErrors = static_cast<unsigned>(std::ceil(1.0 * ccsm.readEndPos * maxErrRate));
+    int lowerDiag, upperDiag;
+    TOverlapSegment segSegment = _overlapAlignmentSetup(lowerDiag, upperDiag, ccsm, readSeq, segId, references,
+            maxErrRate, shift, LeftOverlap());
+    TOverlapSegment readSegment(readSeq); // Dummy infix
 
     setSource(row(align, 0), readSegment);
     setSource(row(align, 1), segSegment);
     detach(align); // Copy infix but not data
 
-    int diag = - length(segSegment) + ccsm.readEndPos;
-    if (shift < 0)
-        diag += -shift;
-    if (diag > 0)
-        diag = 0;
-
     // Compute the overlap alignment - we allow extra read sequence here
-    int s = globalAlignment(align, SimpleScore(1,-1,-1), AlignConfig<true,true,false,true>(), diag - maxErrors, diag + maxErrors + 1);
+    int s = globalAlignment(align, SimpleScore(1,-1,-1), _overlapAlignConfig(LeftOverlap()), lowerDiag, upperDiag);
 
     // Remove trailing gaps in the read sequence and pull in mismatches
     // instead. The score is equivalent, but we don't expect gaps here.
@@ -542,32 +736,22 @@ int extendToOverlapAlignment(
 {
     typedef typename Row<TAlign>::Type                          TRow;
     typedef typename Position<TRow>::Type                       TRowPos;
-    typedef typename Source<TRow>::Type                         TSource;
-    typedef typename Position<TSource>::Type                    TPos;
-    typedef Segment<String<Dna5> const, InfixSegment>           TSegment;
 
     // Prepare the target align object
     resize(rows(align), 2);
 
-    // The segment infix begins with the motif
-    TPos segmentBeginPos = references.rightMeta[segId].motifPos;
-    // If the SCF is shifted into the CDR3 region, extend
-    if (shift < 0)
-        segmentBeginPos += shift;
     // Build the segments
-    TSegment segSegment(references.rightSegs[segId], segmentBeginPos, length(references.rightSegs[segId]));
-    TSegment readSegment(readSeq); // Dummy infix
-
-    unsigned maxErrors = static_cast<unsigned>(length(readSeq) - ccsm.readBeginPos);
+    int lowerDiag, upperDiag;
+    TOverlapSegment segSegment = _overlapAlignmentSetup(lowerDiag, upperDiag, ccsm, readSeq, segId, references,
+            maxErrRate, shift, RightOverlap());
+    TOverlapSegment readSegment(readSeq); // Dummy infix
 
     setSource(row(align, 0), readSegment);
     setSource(row(align, 1), segSegment);
     detach(align); // Copy infix but not data
 
-    int diag = ccsm.readBeginPos;
-
     // Compute the overlap alignment - we allow extra read sequence here
-    int s = globalAlignment(align, SimpleScore(1,-1,-1), AlignConfig<true,false,true,true>(), diag - maxErrors, diag + maxErrors + 1);
+    int s = globalAlignment(align, SimpleScore(1,-1,-1), _overlapAlignConfig(RightOverlap()), lowerDiag, upperDiag);
 
     // Remove trailing gaps in the read sequence and pull in mismatches
     // instead. The score is equivalent, but we don't expect gaps here.
@@ -593,9 +777,46 @@ inline double errRateFromScore(int score, unsigned length)
     return 1.0 * (length - score) / 2.0 / length;
 }
 
+/**
+ * A (candidate SCF match, gene segment) pair and its overlap alignment score.
+ * Candidates of the same SCF match with the same window id have identical
+ * alignment windows within the band and hence identical alignments.
+ */
+struct ScoredSegmentCandidate {
+    CandidateCoreSegmentMatch const * ccsm;
+    unsigned segmentId;
+    unsigned windowId;
+    int score;
+
+    ScoredSegmentCandidate(CandidateCoreSegmentMatch const * _ccsm, unsigned _segmentId, unsigned _windowId, int _score) :
+        ccsm(_ccsm), segmentId(_segmentId), windowId(_windowId), score(_score) {}
+};
+
+/**
+ * An alignment built by findBestSCFs() for one alignment window, the position
+ * of the resulting segment match or -1 if it exceeded the error rate.
+ */
+struct BuiltWindowAlignment {
+    CandidateCoreSegmentMatch const * ccsm;
+    unsigned windowId;
+    int matchPos;
+
+    BuiltWindowAlignment(CandidateCoreSegmentMatch const * _ccsm, unsigned _windowId, int _matchPos) :
+        ccsm(_ccsm), windowId(_windowId), matchPos(_matchPos) {}
+};
+
 /*
  * Identifies the best matching segment core fragment(s) among the provided
- * candidates
+ * candidates.
+ *
+ * The result are the candidates with the best score among those within the
+ * error rate. The error rate depends on the length of the clipped alignment,
+ * hence on the traceback. The scores of all candidates are computed first
+ * without traceback, the alignments are then built in descending order of
+ * score until a score yields at least one candidate within the error rate.
+ * Segments of an SCF whose alignment windows have the same position and are
+ * identical within the band, see buildSCFWindowIds(), are scored and aligned
+ * only once.
  */
 template <typename TSegmentMatchesSet, typename TSequenceSet, typename TOverlapDirection>
 void findBestSCFs(
@@ -604,7 +825,7 @@ void findBestSCFs(
         TSequenceSet const & readSeqs,                                          // [IN]  The read sequences
         CdrReferences const & references,                                       // [IN]  The segment reference data
         CdrOptions const & options,                                             // [IN]  Runtime options
-        std::vector<std::set<unsigned> > const * limSegmentIDs,                 // [IN]  Reduced sets of segment IDs to take into account
+        std::vector<TArenaIdSet> const * limSegmentIDs,                         // [IN]  Reduced sets of segment IDs to take into account
         TOverlapDirection const &                                               // [TAG] Indicating the overlap direction
         )
 {
@@ -619,6 +840,8 @@ void findBestSCFs(
 
     TSequenceSet const & segSeqs = getSegmentSequences(references, TOverlapDirection());
     StringSet<String<unsigned> > const & scfToSegIds = getSCFToSegIds(references, TOverlapDirection());
+    CdrReferences::TSCFToSegIds const & scfWindowIds = getSCFWindowIds(references, TOverlapDirection());
+    CdrReferences::TSCFToSegIds const & scfWindowShared = getSCFWindowShared(references, TOverlapDirection());
     CdrReferences::TSCFPos const & scfBeginEndPos = getSCFPos(references, TOverlapDirection());
 
     // Clear output data
@@ -626,6 +849,10 @@ void findBestSCFs(
     resize(segMatchSet, length(readSeqs));
 
     double maxErrRate = getMaxErrRate(options, TOverlapDirection());
+    int const shift = getSCFOffset(options, TOverlapDirection());
+
+    std::vector<ScoredSegmentCandidate, ArenaAllocator<ScoredSegmentCandidate> > scored;
+    std::vector<BuiltWindowAlignment, ArenaAllocator<BuiltWindowAlignment> > built;
 
     // Iterate through the reads
     for (typename Iterator<TSequenceSet const, Rooted>::Type readIt = begin(readSeqs); !atEnd(readIt); goNext(readIt)) {
@@ -633,36 +860,90 @@ void findBestSCFs(
         unsigned readId         = position(readIt);
 
         TSegmentMatches & segMatches = segMatchSet[readId];
-        int maxScore = 0;
-        // Iterate through the candidate matches and find the best one
+
+        // Score all candidate segments
+        scored.clear();
         for (CandidateCoreSegmentMatch const & ccsm : candidateMatches[readId])
         {
-            for (unsigned const segmentId : scfToSegIds[ccsm.coreSegId])
+            String<unsigned> const & segIds = scfToSegIds[ccsm.coreSegId];
+            String<unsigned> const & windowIds = scfWindowIds[ccsm.coreSegId];
+            String<unsigned> const & windowShared = scfWindowShared[ccsm.coreSegId];
+            size_t const ccsmBegin = scored.size();
+            for (unsigned k = 0; k < length(segIds); ++k)
             {
+                unsigned const segmentId = segIds[k];
+
                 // Skip if we have a limiting set of ids and this one is not listed
                 if (limSegmentIDs != nullptr && (*limSegmentIDs)[readId].find(segmentId) == (*limSegmentIDs)[readId].end())
                     continue;
 
+                // Reuse the score of the first segment with the same window
+                // position if both windows are identical within the band
+                size_t j = scored.size();
+                if (windowIds[k] != segmentId)
+                {
+                    j = ccsmBegin;
+                    while (j < scored.size() && scored[j].segmentId != windowIds[k])
+                        ++j;
+                    if (j < scored.size() && windowShared[k]
+                            < bandedWindowLength(ccsm, readSeq, segmentId, references, maxErrRate, shift, TOverlapDirection()))
+                        j = scored.size();
+                }
+                if (j < scored.size())
+                    scored.push_back(ScoredSegmentCandidate(&ccsm, segmentId, scored[j].windowId, scored[j].score));
+                else
+                    scored.push_back(ScoredSegmentCandidate(&ccsm, segmentId, segmentId,
+                                overlapAlignmentScore(ccsm, readSeq, segmentId, references, maxErrRate, shift, TOverlapDirection())));
+            }
+        }
+        // Within one score, the candidates keep their order
+        std::stable_sort(scored.begin(), scored.end(),
+                [](ScoredSegmentCandidate const & a, ScoredSegmentCandidate const & b) { return a.score > b.score; });
+
+        // Build the alignments of the best scoring candidates
+        for (size_t i = 0; i < scored.size() && empty(segMatches); )
+        {
+            size_t groupEnd = i;
+            built.clear();
+            for (; groupEnd < scored.size() && scored[groupEnd].score == scored[i].score; ++groupEnd)
+            {
+                ScoredSegmentCandidate const & candidate = scored[groupEnd];
+
+                // Reuse the alignment of a segment with the same window id. Only
+                // the segment sequence outside the band is replaced.
+                size_t j = 0;
+                while (j < built.size() && (built[j].ccsm != candidate.ccsm || built[j].windowId != candidate.windowId))
+                    ++j;
+                if (j < built.size())
+                {
+                    if (built[j].matchPos >= 0)
+                    {
+                        appendValue(segMatches, TSegmentMatch(candidate.segmentId, candidate.score,
+                                    segMatches[built[j].matchPos].align));
+                        setHost(source(row(back(segMatches).align, 1)), segSeqs[candidate.segmentId]);
+                    }
+                    continue;
+                }
+
                 TAlign align;
 
                 // Global overlap alignment computation
-                int score = extendToOverlapAlignment(align, ccsm, readSeq, segmentId, references, maxErrRate, 
-                        getSCFOffset(options, TOverlapDirection()), TOverlapDirection());
+                int score = extendToOverlapAlignment(align, *candidate.ccsm, readSeq, candidate.segmentId, references,
+                        maxErrRate, shift, TOverlapDirection());
+                if (score != candidate.score)
+                    throw std::runtime_error("findBestSCFs(...)[E001]");
 
                 double errRate = errRateFromScore(score, length(row(align, 0)));
                 if (errRate > maxErrRate)
+                {
+                    built.push_back(BuiltWindowAlignment(candidate.ccsm, candidate.windowId, -1));
                     continue;
-
-                // Store the result if there was no result before or if the
-                // segment alignment is at least as good as the previous one(s)
-                if (empty(segMatches) || maxScore <= score) {
-                    if (!empty(segMatches) && maxScore < score) {
-                        clear(segMatches);
-                    }
-                    maxScore = score;
-                    appendValue(segMatches, TSegmentMatch(segmentId, score, align));
                 }
+
+                built.push_back(BuiltWindowAlignment(candidate.ccsm, candidate.windowId, length(segMatches)));
+                appendValue(segMatches, TSegmentMatch(candidate.segmentId, score, align));
             }
+            i = groupEnd;
         }
     }
 }
@@ -700,9 +981,12 @@ void findBestSegmentMatch(
 
     StringSet<TQueryDataSequence> const & seqs = getReadSequences(queryData, TOverlapSpec());
 
-    CdrReferences::TSegCoreFragmentStringSet scfs = getSCFs(references, TOverlapSpec());
+    CdrReferences::TSegCoreFragmentStringSet const & scfs = getSCFs(references, TOverlapSpec());
 
-    findCandidateCoreSegments(candidateMatches, seqs, scfs, getMaxCoreSegErrors(global.options, TOverlapSpec()));
+    findCandidateCoreSegments(candidateMatches, seqs, scfs, getSCFIndex(references, TOverlapSpec()),
+            getSCFPatterns(references, TOverlapSpec()),
+            global.options.scfKmerFilter ? &getSCFSeedTable(references, TOverlapSpec()) : nullptr,
+            getMaxCoreSegErrors(global.options, TOverlapSpec()));
 
     findBestSCFs(
             matches,
@@ -726,9 +1010,12 @@ void findBestSegmentMatch(
 
     StringSet<TQueryDataSequence>  const & seqs = getReadSequences(queryData, RightOverlap());
 
-    CdrReferences::TSegCoreFragmentStringSet scfs = getSCFs(references, RightOverlap());
+    CdrReferences::TSegCoreFragmentStringSet const & scfs = getSCFs(references, RightOverlap());
 
-    findCandidateCoreSegments(candidateMatches, seqs, scfs, getMaxCoreSegErrors(global.options, RightOverlap()));
+    findCandidateCoreSegments(candidateMatches, seqs, scfs, getSCFIndex(references, RightOverlap()),
+            getSCFPatterns(references, RightOverlap()),
+            global.options.scfKmerFilter ? &getSCFSeedTable(references, RightOverlap()) : nullptr,
+            getMaxCoreSegErrors(global.options, RightOverlap()));
 
     findBestSCFs(
             matches,
@@ -741,7 +1028,7 @@ void findBestSegmentMatch(
 
 template <typename TSequence, typename TGlobalData>
 void findBestVSegment(
-        std::vector<std::set<unsigned> > & dbMatches, // [OUT] For every read, the best matching V refs
+        std::vector<TArenaIdSet> & dbMatches,         // [OUT] For every read, the best matching V refs
         StringSet<TSequence> const & vReadSeqs,       //  [IN] V read sequences
         TGlobalData const & global)                   //  [IN] The segment references
 {
@@ -780,7 +1067,7 @@ void findBestVSegment(
     resize(indexShape(readsIndex), static_cast<int>(std::floor(1.0/maxErrRate)));
 
     // Here we store the potentially matching reads per segments
-    String<std::set<unsigned> > readCandidates;
+    String<TArenaIdSet> readCandidates;
     resize(readCandidates, length(segmentSequences));
 
     for (typename Iterator<StringSet<TSequence> const, Rooted>::Type segSeqIt = begin(segmentSequences); !atEnd(segSeqIt); goNext(segSeqIt))
@@ -802,14 +1089,14 @@ void findBestVSegment(
 
     String<int> bestScores;
     resize(bestScores, length(vReadSeqs), MinValue<int>::VALUE);
-    for (Iterator<String<std::set<unsigned> >, Rooted>::Type reCaIt = begin(readCandidates); !atEnd(reCaIt); goNext(reCaIt))
+    for (Iterator<String<TArenaIdSet>, Rooted>::Type reCaIt = begin(readCandidates); !atEnd(reCaIt); goNext(reCaIt))
     {
         if (empty(*reCaIt))
             continue;
 
         unsigned const segId = position(reCaIt);
         
-        for (std::set<unsigned>::const_iterator readIdIt = reCaIt->cbegin(); readIdIt != reCaIt->cend(); ++readIdIt)
+        for (TArenaIdSet::const_iterator readIdIt = reCaIt->cbegin(); readIdIt != reCaIt->cend(); ++readIdIt)
         {
 
             unsigned vReadId = *readIdIt;
@@ -839,7 +1126,7 @@ void findBestVSegment(
                 continue;
             } 
 
-            std::set<unsigned> & bestDBs = dbMatches[vReadId];
+            TArenaIdSet & bestDBs = dbMatches[vReadId];
 
             if (segBestScore > bestScores[vReadId]) {
                 bestDBs.clear();
@@ -865,26 +1152,20 @@ void findBestSegmentMatch(
     typedef Segment<TSequence const, InfixSegment>      TSegment;
     typedef Align<TSegment>                             TAlign;
 
-    typedef CdrReferences::TSegCoreFragmentStringSet                    TStringSet;
-    typedef Value<TStringSet>::Type                                     TRefSequence;
-    typedef typename Value<TRefSequence>::Type                          TAlphabet;
-    typedef Shape<TAlphabet, SimpleShape>                               TShape;
-    typedef Index<TStringSet, IndexQGram<TShape, OpenAddressing> >      TIndex;
+    typedef CdrReferences::TQGramIndex                                  TIndex;
     typedef Pattern<TIndex, Swift<SwiftSemiGlobal> >                    TPattern;
-    typedef Finder<TSequence, Swift<SwiftSemiGlobal> >                  TFinder;
-    typedef std::map<unsigned, BeginEndPos<long long> >                 TInfixPosMap;
+    typedef TSCFInfixPosMap                                             TInfixPosMap;
 
     CdrReferences const & references = global.references;
 
     // Find V segments
-    std::vector<std::set<unsigned> > vSegments;
+    std::vector<TArenaIdSet> vSegments;
     findBestVSegment(vSegments, queryData.fwSeqs, global);
 
-    // Build index for SCF filtering
-    unsigned maxSCFErrors = getMaxCoreSegErrors(global.options, LeftOverlap());
-    TIndex scfIndex(references.leftSCFs);
-    resize(indexShape(scfIndex), length(references.leftSCFs[0]) / (maxSCFErrors+1));
-    TPattern segmentPattern(scfIndex);
+    // SCF filtering pattern over the shared, prebuilt index
+    TPattern segmentPattern(getSCFIndex(references, LeftOverlap()));
+    // Per-block copy of the verification patterns
+    CdrReferences::TSCFPatterns verifyPatterns = getSCFPatterns(references, LeftOverlap());
 
     StringSet<TSequence> const & vSegSequences = references.leftSegs;
 
@@ -897,8 +1178,8 @@ void findBestSegmentMatch(
     {
         TSequence & readSeq = const_cast<TSequence &>(queryData.revSeqs[readId]);
 
-        std::set<unsigned> limScfIds;
-        std::set<unsigned> const & limSegIds = vSegments[readId];
+        TArenaIdSet limScfIds;
+        TArenaIdSet const & limSegIds = vSegments[readId];
 
         if (limSegIds.empty())
         {
@@ -910,11 +1191,13 @@ void findBestSegmentMatch(
                 limScfIds.insert(references.leftSegToScfId[segId]);
 
             // Filter
-            TInfixPosMap scfInfixPositions = filterSCFs(readSeq, segmentPattern, errRate, &limScfIds);
+            TInfixPosMap scfInfixPositions = global.options.scfKmerFilter
+                ? filterSCFsBySeeds(readSeq, getSCFSeedTable(references, LeftOverlap()), &limScfIds)
+                : filterSCFs(readSeq, segmentPattern, errRate, &limScfIds);
 
             // Verification
             String<CandidateCoreSegmentMatch> ccsms = verifySCFHits(readSeq,
-                    references.leftSCFs,
+                    verifyPatterns,
                     scfInfixPositions,
                     global.options.maxVCoreErrors);
 
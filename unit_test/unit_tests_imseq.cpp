@@ -29,6 +29,12 @@
 #include "unit_tests_imseq_fastq_io.h"
 #include "unit_tests_imseq_qc_basics.h"
 #include "unit_tests_imseq_fastq_multi_record.h"
+#include "unit_tests_imseq_packed_sequence.h"
+#include "unit_tests_imseq_sequence_kernels.h"
+#include "unit_tests_imseq_block_arena.h"
+#include "unit_tests_imseq_scf_seed_table.h"
+#include "unit_tests_imseq_vj_matching.h"
+#include "unit_tests_imseq_reference_preparation.h"
 
 SEQAN_BEGIN_TESTSUITE(unit_tests_imseq)
 {
@@ -36,6 +42,8 @@ SEQAN_BEGIN_TESTSUITE(unit_tests_imseq)
     SEQAN_CALL_TEST(unit_tests_imseq_barcode_correction_splitBarcodeSeq);
     SEQAN_CALL_TEST(unit_tests_imseq_barcode_correction_splitBarcodeSeq__FastqRecord);
     SEQAN_CALL_TEST(unit_tests_imseq_barcode_correction_withinClusteringSpecs);
+    SEQAN_CALL_TEST(unit_tests_imseq_barcode_correction_compareOneRead_allPairs);
+    SEQAN_CALL_TEST(unit_tests_imseq_barcode_correction_barcodeCorrection_sequential);
 
     // unit_tests_imseq_fastq_io.h
     SEQAN_CALL_TEST(unit_tests_imseq_fastq_io_qualityControl);
@@ -51,6 +59,35 @@ SEQAN_BEGIN_TESTSUITE(unit_tests_imseq)
     SEQAN_CALL_TEST(unit_tests_imseq_fastq_multi_record_findContainingMultiRecord_SingleEnd);
     SEQAN_CALL_TEST(unit_tests_imseq_fastq_multi_record_findContainingMultiRecord_PairedEnd);
     SEQAN_CALL_TEST(unit_tests_imseq_fastq_multi_record_collection_compact_PairedEnd);
+    SEQAN_CALL_TEST(unit_tests_imseq_fastq_multi_record_repeated_read_ids_SingleEnd);
+    SEQAN_CALL_TEST(unit_tests_imseq_fastq_multi_record_merge_qualities_SingleEnd);
+    SEQAN_CALL_TEST(unit_tests_imseq_fastq_multi_record_readRecords_pipelined_SingleEnd);
+
+    // unit_tests_imseq_packed_sequence.h
+    SEQAN_CALL_TEST(unit_tests_imseq_packed_sequence_assignPacked);
+    SEQAN_CALL_TEST(unit_tests_imseq_packed_sequence_hammingDistAtMost);
+    SEQAN_CALL_TEST(unit_tests_imseq_packed_sequence_store);
+
+    // unit_tests_imseq_sequence_kernels.h
+    SEQAN_CALL_TEST(unit_tests_imseq_sequence_kernels_packedLaneMismatches);
+    SEQAN_CALL_TEST(unit_tests_imseq_sequence_kernels_boundedEditDistance);
+
+    // unit_tests_imseq_block_arena.h
+    SEQAN_CALL_TEST(unit_tests_imseq_block_arena_allocate);
+    SEQAN_CALL_TEST(unit_tests_imseq_block_arena_containers);
+
+    // unit_tests_imseq_scf_seed_table.h
+    SEQAN_CALL_TEST(unit_tests_imseq_scf_seed_table_build);
+    SEQAN_CALL_TEST(unit_tests_imseq_scf_seed_table_forEachSCFSeedHit);
+
+    // unit_tests_imseq_vj_matching.h
+    SEQAN_CALL_TEST(unit_tests_imseq_vj_matching_filterSCFsBySeeds);
+    SEQAN_CALL_TEST(unit_tests_imseq_vj_matching_findCandidateCoreSegments_kmer_swift);
+
+    // unit_tests_imseq_reference_preparation.h
+    SEQAN_CALL_TEST(unit_tests_imseq_reference_preparation_buildSCFWindowIds);
+    SEQAN_CALL_TEST(unit_tests_imseq_reference_preparation_findBestSCFs_sharedWindows);
+    SEQAN_CALL_TEST(unit_tests_imseq_reference_preparation_referenceIndex_roundTrip);
 }
 
 SEQAN_END_TESTSUITE
@@ -25,8 +25,86 @@
 // Unit tests for barcode_correction.h
 // ============================================================================
 
+#include <sstream>
+
 #include "../src/barcode_correction.h"
 
+/**
+ * Fills a collection with reads around a few barcodes and sequences, with up
+ * to three barcode errors, sequence errors and varying abundances. If
+ * repeatedReadIds is set, a few read IDs are shared by many records.
+ */
+inline void _barcodeCorrectionTestCollection(FastqMultiRecordCollection<SingleEnd> & collection,
+        bool const repeatedReadIds = false)
+{
+    char const * const barcodes[] = {"ACGTTGCA", "GGATCCTA", "TTCAGGAC", "CATGACGT"};
+    char const * const seqs[] = {"ACGGTACCTGAGTCAAGCTT", "TGCATTGACCGTAGGCATCA", "GATTACAGGCTCAGTTACGA"};
+    char const bases[] = "ACGT";
+    uint32_t state = 17;
+    auto rnd = [&state](uint32_t const n) -> uint32_t {
+        state = state * 1103515245u + 12345u;
+        return (state >> 16) % n;
+    };
+    for (unsigned r = 0; r < 200; ++r) {
+        String<Dna5Q> bcSeq = barcodes[rnd(4)];
+        for (unsigned e = rnd(4); e > 0; --e)
+            bcSeq[rnd(length(bcSeq))] = bases[rnd(4)];
+        String<Dna5Q> seq = seqs[rnd(3)];
+        if (rnd(4) == 0)
+            seq[rnd(length(seq))] = bases[rnd(4)];
+        unsigned const abundance = 1 + rnd(3) * rnd(8);
+        for (unsigned k = 0; k < abundance; ++k) {
+            std::ostringstream id;
+            id << "READ_" << r << "_" << k;
+            findContainingMultiRecord(collection, FastqRecord<SingleEnd>(CharString(id.str()), seq, bcSeq), true);
+        }
+        if (repeatedReadIds) {
+            std::ostringstream id;
+            id << "SHARED_" << r % 5;
+            findContainingMultiRecord(collection, FastqRecord<SingleEnd>(CharString(id.str()), seq, bcSeq), true);
+        }
+    }
+}
+
+/**
+ * The records sorted from the least to the most abundant, see barcodeCorrection()
+ */
+template <typename TMRec>
+std::vector<TMRec*> _sortedByAbundance(std::vector<TMRec> & records)
+{
+    std::vector<TMRec*> sortedRecPtrs;
+    for (TMRec & rec : records)
+        sortedRecPtrs.push_back(&rec);
+    std::sort(sortedRecPtrs.begin(), sortedRecPtrs.end(),
+            [](TMRec const * a, TMRec const * b) -> bool { return a->ids.size() < b->ids.size(); });
+    return sortedRecPtrs;
+}
+
+/**
+ * Merge targets found by comparing every record to all more abundant ones,
+ * without a BarcodePartIndex
+ */
+template <typename TMRec>
+std::vector<size_t> _allPairsMergeTargets(std::vector<TMRec*> const & sortedRecPtrs, CdrOptions const & options)
+{
+    std::vector<size_t> mergeTargets(sortedRecPtrs.size(), NO_MERGE_TARGET);
+    for (size_t refIndex = 0; refIndex < sortedRecPtrs.size(); ++refIndex)
+        for (size_t tarIndex = sortedRecPtrs.size(); tarIndex-- > refIndex + 1;)
+        {
+            TMRec const & refRec = * sortedRecPtrs[refIndex];
+            TMRec const & tarRec = * sortedRecPtrs[tarIndex];
+            if (static_cast<double>(refRec.ids.size()) / tarRec.ids.size() > options.bcClustMaxFreqRate)
+                break;
+            if (hammingDistAtMost(refRec.bcSeq, tarRec.bcSeq, options.barcodeMaxError)
+                    && withinClusteringSpecs(refRec, tarRec, options.bcClustMaxErrRate))
+            {
+                mergeTargets[refIndex] = tarIndex;
+                break;
+            }
+        }
+    return mergeTargets;
+}
+
 SEQAN_DEFINE_TEST(unit_tests_imseq_barcode_correction_splitBarcodeSeq)
 {
 
@@ -112,3 +190,88 @@ SEQAN_DEFINE_TEST(unit_tests_imseq_barcode_correction_withinClusteringSpecs)
 
     }
 }
+
+SEQAN_DEFINE_TEST(unit_tests_imseq_barcode_correction_compareOneRead_allPairs)
+{
+    for (unsigned bcDelta = 1; bcDelta <= 2; ++bcDelta)
+    {
+        size_t nMerged[2];
+        double const maxRatios[2] = {0.3, 1.0};
+        for (unsigned r = 0; r < 2; ++r)
+        {
+            CdrOptions options;
+            options.barcodeMaxError = bcDelta;
+            options.bcClustMaxErrRate = 0.05;
+            options.bcClustMaxFreqRate = maxRatios[r];
+
+            FastqMultiRecordCollection<SingleEnd> collection;
+            _barcodeCorrectionTestCollection(collection);
+            std::vector<FastqMultiRecord<SingleEnd>*> sortedRecPtrs = _sortedByAbundance(collection.multiRecords);
+
+            BarcodePartIndex bcIndex;
+            buildBarcodePartIndex(bcIndex, sortedRecPtrs, bcDelta);
+            std::vector<size_t> mergeTargets(sortedRecPtrs.size(), NO_MERGE_TARGET);
+            for (size_t i = 0; i < sortedRecPtrs.size(); ++i)
+                compareOneRead(mergeTargets, sortedRecPtrs, bcIndex, i, bcDelta, options.bcClustMaxErrRate, options.bcClustMaxFreqRate);
+
+            SEQAN_ASSERT(mergeTargets == _allPairsMergeTargets(sortedRecPtrs, options));
+            nMerged[r] = std::count_if(mergeTargets.begin(), mergeTargets.end(), [](size_t t) { return t != NO_MERGE_TARGET; });
+        }
+        // The frequency ratio stops the search for some records
+        SEQAN_ASSERT_GT(nMerged[0], 0u);
+        SEQAN_ASSERT_LT(nMerged[0], nMerged[1]);
+    }
+}
+
+SEQAN_DEFINE_TEST(unit_tests_imseq_barcode_correction_barcodeCorrection_sequential)
+{
+    ThreadPool threadPool(4);
+    for (bool repeatedReadIds : {false, true})
+    {
+        CdrOptions options;
+        options.barcodeMaxError = 1;
+        options.bcClustMaxErrRate = 0.05;
+        options.bcClustMaxFreqRate = 1.0;
+
+        FastqMultiRecordCollection<SingleEnd> collection;
+        _barcodeCorrectionTestCollection(collection, repeatedReadIds);
+        SEQAN_ASSERT_EQ(collection.repeatedReadIds, repeatedReadIds);
+        size_t nIdsBefore = 0;
+        for (FastqMultiRecord<SingleEnd> const & rec : collection.multiRecords)
+            nIdsBefore += rec.ids.size();
+
+        // Merge the all pairs merge targets one by one in ascending order
+        std::vector<FastqMultiRecord<SingleEnd> > expected = collection.multiRecords;
+        std::vector<FastqMultiRecord<SingleEnd>*> sortedRecPtrs = _sortedByAbundance(expected);
+        std::vector<size_t> mergeTargets = _allPairsMergeTargets(sortedRecPtrs, options);
+        for (size_t i = 0; i < sortedRecPtrs.size(); ++i)
+            if (mergeTargets[i] != NO_MERGE_TARGET)
+            {
+                mergeReadIds(sortedRecPtrs[mergeTargets[i]]->ids, sortedRecPtrs[i]->ids);
+                sortedRecPtrs[i]->ids.clear();
+            }
+
+        // The merge trees are resolved and merged in parallel
+        barcodeCorrection(collection, options, &threadPool);
+
+        SEQAN_ASSERT_EQ(collection.multiRecords.size(), expected.size());
+        size_t nIdsAfter = 0;
+        for (size_t i = 0; i < expected.size(); ++i)
+        {
+            std::vector<TReadId> const & ids = collection.multiRecords[i].ids;
+            SEQAN_ASSERT(ids == expected[i].ids);
+            nIdsAfter += ids.size();
+            // Every read ID is contained once
+            std::vector<CharString> names;
+            for (TReadId const id : ids)
+                names.push_back(readId(collection.readIds, id));
+            std::sort(names.begin(), names.end());
+            SEQAN_ASSERT(std::adjacent_find(names.begin(), names.end()) == names.end());
+        }
+        // Read IDs shared by merged records are dropped
+        if (repeatedReadIds)
+            SEQAN_ASSERT_LT(nIdsAfter, nIdsBefore);
+        else
+            SEQAN_ASSERT_EQ(nIdsAfter, nIdsBefore);
+    }
+}
@@ -0,0 +1,70 @@
+// ============================================================================
+// IMSEQ - An immunogenetic sequence analysis tool
+// (C) Charite, Universitaetsmedizin Berlin
+// Author: Leon Kuchenbecker
+// ============================================================================
+// 
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License version 2 as published by
+// the Free Software Foundation.
+// 
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+// 
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+// ============================================================================
+
+
+#ifndef IMSEQ_UNIT_TESTS_IMSEQ_BLOCK_ARENA_H
+#define IMSEQ_UNIT_TESTS_IMSEQ_BLOCK_ARENA_H
+
+#include "../src/block_arena.h"
+
+SEQAN_DEFINE_TEST(unit_tests_imseq_block_arena_allocate)
+{
+    BlockArena arena;
+    char * a = static_cast<char *>(arena.allocate(3, 1));
+    uint64_t * b = static_cast<uint64_t *>(arena.allocate(sizeof(uint64_t), alignof(uint64_t)));
+    SEQAN_ASSERT_EQ(reinterpret_cast<uintptr_t>(b) % alignof(uint64_t), 0u);
+    SEQAN_ASSERT(reinterpret_cast<char *>(b) >= a + 3);
+    SEQAN_ASSERT_EQ(arena.nAllocations, 2u);
+    SEQAN_ASSERT_EQ(arena.nChunks, 1u);
+
+    // Larger than a chunk
+    arena.allocate(BlockArena::CHUNK_SIZE + 1, 1);
+    SEQAN_ASSERT_EQ(arena.nChunks, 2u);
+
+    // Chunks are reused after a reset
+    arena.reset();
+    SEQAN_ASSERT(static_cast<char *>(arena.allocate(3, 1)) == a);
+    arena.allocate(BlockArena::CHUNK_SIZE, 1);
+    SEQAN_ASSERT_EQ(arena.nChunks, 2u);
+    SEQAN_ASSERT_EQ(arena.nAllocations, 5u);
+}
+
+SEQAN_DEFINE_TEST(unit_tests_imseq_block_arena_containers)
+{
+    BlockArena & arena = threadBlockArena();
+    arena.reset();
+    uint64_t const nChunks = arena.nChunks;
+    for (unsigned round = 0; round < 3; ++round)
+    {
+        TArenaIdSet ids;
+        for (unsigned i = 0; i < 1000; ++i)
+            ids.insert(i * 7 % 1000);
+        SEQAN_ASSERT_EQ(ids.size(), 1000u);
+        SEQAN_ASSERT_EQ(*ids.begin(), 0u);
+        SEQAN_ASSERT_EQ(*ids.rbegin(), 999u);
+        TArenaIdSet copy = ids;
+        SEQAN_ASSERT(copy == ids);
+        arena.reset();
+    }
+    SEQAN_ASSERT_LEQ(arena.nChunks, nChunks + 1);
+}
+
+#endif
@@ -22,8 +22,22 @@
 #ifndef IMSEQ_UNIT_TESTS_IMSEQ_FASTQ_MULTI_RECORD_H
 #define IMSEQ_UNIT_TESTS_IMSEQ_FASTQ_MULTI_RECORD_H
 
+#include <cstdio>
+#include <fstream>
+
 #include "../src/fastq_multi_record.h"
 
+template <typename TSequencingSpec>
+bool _containsReadId(FastqMultiRecordCollection<TSequencingSpec> const & collection,
+        FastqMultiRecord<TSequencingSpec> const & rec,
+        CharString const & id)
+{
+    for (TReadId const idx : rec.ids)
+        if (readId(collection.readIds, idx) == id)
+            return true;
+    return false;
+}
+
 SEQAN_DEFINE_TEST(unit_tests_imseq_fastq_multi_record_collection_compact_PairedEnd)
 {
     {
@@ -35,40 +49,44 @@ SEQAN_DEFINE_TEST(unit_tests_imseq_fastq_multi_record_collection_compact_PairedE
         findContainingMultiRecord(collection, FastqRecord<PairedEnd>("READ_4", "ACTGTCATACG", "GGGGCAAGGCA", "CCAT"), true);
         // New barcode
         findContainingMultiRecord(collection, FastqRecord<PairedEnd>("READ_5", "ACTGTCATACG", "GGGGCAAGGCA", "CCTT"), true);
-        SEQAN_ASSERT_EQ(length(collection.multiRecordPtrs), 4u);
-        for (FastqMultiRecord<PairedEnd>* ptr : collection.multiRecordPtrs)
-            SEQAN_ASSERT(ptr != NULL);
+        SEQAN_ASSERT_EQ(collection.multiRecords.size(), 4u);
         // Now we merge READ_5 into READ_3+READ_4
-        FastqMultiRecord<PairedEnd> & target = *collection.multiRecordPtrs[2];
-        SEQAN_ASSERT_EQ(*target.ids.begin(), "READ_3");
-        FastqMultiRecord<PairedEnd> & source = *collection.multiRecordPtrs[3];
-        SEQAN_ASSERT_EQ(*source.ids.begin(), "READ_5");
-        target.ids.insert(source.ids.begin(), source.ids.end());
+        FastqMultiRecord<PairedEnd> & target = collection.multiRecords[2];
+        SEQAN_ASSERT_EQ(readId(collection.readIds, target.ids.front()), "READ_3");
+        FastqMultiRecord<PairedEnd> & source = collection.multiRecords[3];
+        SEQAN_ASSERT_EQ(readId(collection.readIds, source.ids.front()), "READ_5");
+        mergeReadIds(target.ids, source.ids);
         source.ids.clear();
         // Also READ_1 is merged into them
-        FastqMultiRecord<PairedEnd> & source2 = *collection.multiRecordPtrs[0];
-        SEQAN_ASSERT_EQ(*source2.ids.begin(), "READ_1");
-        target.ids.insert(source2.ids.begin(), source2.ids.end());
+        FastqMultiRecord<PairedEnd> & source2 = collection.multiRecords[0];
+        SEQAN_ASSERT_EQ(readId(collection.readIds, source2.ids.front()), "READ_1");
+        mergeReadIds(target.ids, source2.ids);
         source2.ids.clear();
         // Now we compact() the collection
         compact(collection);
-        SEQAN_ASSERT_EQ(length(collection.multiRecordPtrs), 2u);
+        SEQAN_ASSERT_EQ(collection.multiRecords.size(), 2u);
         FastqMultiRecord<PairedEnd> * x = NULL;
-        x = collection.multiRecordPtrs[collection.bcMap["CCAT"]["ACTGTCATACG"]["GGGGCAAGGCA"]];
-        SEQAN_ASSERT_EQ(x->bcSeq,  "CCAT");
-        SEQAN_ASSERT_EQ(x->fwSeq,  "ACTGTCATACG");
-        SEQAN_ASSERT_EQ(x->revSeq, "GGGGCAAGGCA");
+        x = getMultiRecordPtr(collection, FastqRecord<PairedEnd>("", "ACTGTCATACG", "GGGGCAAGGCA", "CCAT"));
+        SEQAN_ASSERT(x != NULL);
+        SEQAN_ASSERT_EQ(unpack(x->bcSeq),  "CCAT");
+        SEQAN_ASSERT_EQ(unpack(x->fwSeq),  "ACTGTCATACG");
+        SEQAN_ASSERT_EQ(unpack(x->revSeq), "GGGGCAAGGCA");
         SEQAN_ASSERT_EQ(x->ids.size(), 4u);
-        SEQAN_ASSERT(x->ids.find("READ_1") != x->ids.end());
-        SEQAN_ASSERT(x->ids.find("READ_3") != x->ids.end());
-        SEQAN_ASSERT(x->ids.find("READ_4") != x->ids.end());
-        SEQAN_ASSERT(x->ids.find("READ_5") != x->ids.end());
-        x = collection.multiRecordPtrs[collection.bcMap["CCAT"]["ACTGTCATACG"]["GGGGCAAAGCA"]];
-        SEQAN_ASSERT_EQ(x->bcSeq,  "CCAT");
-        SEQAN_ASSERT_EQ(x->fwSeq,  "ACTGTCATACG");
-        SEQAN_ASSERT_EQ(x->revSeq, "GGGGCAAAGCA");
+        SEQAN_ASSERT(std::is_sorted(x->ids.begin(), x->ids.end()));
+        SEQAN_ASSERT(_containsReadId(collection, *x, "READ_1"));
+        SEQAN_ASSERT(_containsReadId(collection, *x, "READ_3"));
+        SEQAN_ASSERT(_containsReadId(collection, *x, "READ_4"));
+        SEQAN_ASSERT(_containsReadId(collection, *x, "READ_5"));
+        x = getMultiRecordPtr(collection, FastqRecord<PairedEnd>("", "ACTGTCATACG", "GGGGCAAAGCA", "CCAT"));
+        SEQAN_ASSERT(x != NULL);
+        SEQAN_ASSERT_EQ(unpack(x->bcSeq),  "CCAT");
+        SEQAN_ASSERT_EQ(unpack(x->fwSeq),  "ACTGTCATACG");
+        SEQAN_ASSERT_EQ(unpack(x->revSeq), "GGGGCAAAGCA");
         SEQAN_ASSERT_EQ(x->ids.size(), 1u);
-        SEQAN_ASSERT(x->ids.find("READ_2") != x->ids.end());
+        SEQAN_ASSERT(_containsReadId(collection, *x, "READ_2"));
+        // Removed records are no longer found
+        SEQAN_ASSERT(NULL == getMultiRecordPtr(collection, FastqRecord<PairedEnd>("", "ACTGGCATACG", "GGGGCAAAGCA", "CCAT")));
+        SEQAN_ASSERT(NULL == getMultiRecordPtr(collection, FastqRecord<PairedEnd>("", "ACTGTCATACG", "GGGGCAAGGCA", "CCTT")));
     }
 }
 
@@ -76,25 +94,29 @@ SEQAN_DEFINE_TEST(unit_tests_imseq_fastq_multi_record_findContainingMultiRecord_
 {
     {
         FastqMultiRecordCollection<PairedEnd> collection;
-        SEQAN_ASSERT(empty(collection.multiRecordPtrs));
-        SEQAN_ASSERT(collection.bcMap.empty());
+        SEQAN_ASSERT(collection.multiRecords.empty());
         SEQAN_ASSERT(NULL == findContainingMultiRecord(collection, FastqRecord<PairedEnd>("READ_1", "ACTGGCATACG", "GGGGCAAAGCA", "CCAT"), false));
-        FastqMultiRecord<PairedEnd> * ptr = findContainingMultiRecord(collection, FastqRecord<PairedEnd>("READ_2", "ACTGGCATACG", "GGGGCAAAGCA", "CCAT"), true);
-        SEQAN_ASSERT(NULL != ptr);
-        SEQAN_ASSERT(ptr == findContainingMultiRecord(collection, FastqRecord<PairedEnd>("READ_3", "ACTGGCATACG", "GGGGCAAAGCA", "CCAT"), true));
-        SEQAN_ASSERT(ptr == findContainingMultiRecord(collection, FastqRecord<PairedEnd>("READ_4", "ACTGGCATACG", "GGGGCAAAGCA", "CCAT"), true));
-        SEQAN_ASSERT(ptr != findContainingMultiRecord(collection, FastqRecord<PairedEnd>("READ_5", "ACTGGCATACG", "GGGGCAAAGCA", "CGAT"), true));
-        SEQAN_ASSERT(ptr != findContainingMultiRecord(collection, FastqRecord<PairedEnd>("READ_6", "ACTGGCATACG", "GGGGCTAAGCA", "CGAT"), true));
-        SEQAN_ASSERT(ptr != findContainingMultiRecord(collection, FastqRecord<PairedEnd>("READ_7", "ACTGGGATACG", "GGGGCTAAGCA", "CGAT"), true));
-        SEQAN_ASSERT_EQ(ptr->ids.size(), 3u);
-        SEQAN_ASSERT(ptr->ids.find("READ_2") != ptr->ids.end());
-        SEQAN_ASSERT(ptr->ids.find("READ_3") != ptr->ids.end());
-        SEQAN_ASSERT(ptr->ids.find("READ_4") != ptr->ids.end());
-        SEQAN_ASSERT_EQ(collection.bcMap["CCAT"].size(), 1u);
-        SEQAN_ASSERT_EQ(collection.bcMap["CGAT"].size(), 2u);
-        SEQAN_ASSERT_EQ(collection.bcMap["CCAT"]["ACTGGCATACG"].size(), 1u);
-        SEQAN_ASSERT_EQ(collection.bcMap["CGAT"]["ACTGGCATACG"].size(), 2u);
-        SEQAN_ASSERT_EQ(collection.bcMap["CGAT"]["ACTGGGATACG"].size(), 1u);
+        FastqMultiRecord<PairedEnd> * ptr = NULL;
+        ptr = findContainingMultiRecord(collection, FastqRecord<PairedEnd>("READ_2", "ACTGGCATACG", "GGGGCAAAGCA", "CCAT"), true);
+        SEQAN_ASSERT(ptr == &collection.multiRecords[0]);
+        ptr = findContainingMultiRecord(collection, FastqRecord<PairedEnd>("READ_3", "ACTGGCATACG", "GGGGCAAAGCA", "CCAT"), true);
+        SEQAN_ASSERT(ptr == &collection.multiRecords[0]);
+        ptr = findContainingMultiRecord(collection, FastqRecord<PairedEnd>("READ_4", "ACTGGCATACG", "GGGGCAAAGCA", "CCAT"), true);
+        SEQAN_ASSERT(ptr == &collection.multiRecords[0]);
+        ptr = findContainingMultiRecord(collection, FastqRecord<PairedEnd>("READ_5", "ACTGGCATACG", "GGGGCAAAGCA", "CGAT"), true);
+        SEQAN_ASSERT(ptr == &collection.multiRecords[1]);
+        ptr = findContainingMultiRecord(collection, FastqRecord<PairedEnd>("READ_6", "ACTGGCATACG", "GGGGCTAAGCA", "CGAT"), true);
+        SEQAN_ASSERT(ptr == &collection.multiRecords[2]);
+        ptr = findContainingMultiRecord(collection, FastqRecord<PairedEnd>("READ_7", "ACTGGGATACG", "GGGGCTAAGCA", "CGAT"), true);
+        SEQAN_ASSERT(ptr == &collection.multiRecords[3]);
+        SEQAN_ASSERT_EQ(collection.multiRecords.size(), 4u);
+        FastqMultiRecord<PairedEnd> const & rec = collection.multiRecords[0];
+        SEQAN_ASSERT_EQ(rec.ids.size(), 3u);
+        SEQAN_ASSERT(_containsReadId(collection, rec, "READ_2"));
+        SEQAN_ASSERT(_containsReadId(collection, rec, "READ_3"));
+        SEQAN_ASSERT(_containsReadId(collection, rec, "READ_4"));
+        SEQAN_ASSERT_EQ(findMultiRecordId(collection, FastqRecord<PairedEnd>("", "ACTGGCATACG", "GGGGCTAAGCA", "CGAT")), 2u);
+        SEQAN_ASSERT(FastqMultiRecordCollection<PairedEnd>::NO_MATCH == findMultiRecordId(collection, FastqRecord<PairedEnd>("", "ACTGGCATACG", "GGGGCTAAGCA", "CCAT")));
     }
 }
 
@@ -102,24 +124,175 @@ SEQAN_DEFINE_TEST(unit_tests_imseq_fastq_multi_record_findContainingMultiRecord_
 {
     {
         FastqMultiRecordCollection<SingleEnd> collection;
-        SEQAN_ASSERT(empty(collection.multiRecordPtrs));
-        SEQAN_ASSERT(collection.bcMap.empty());
+        SEQAN_ASSERT(collection.multiRecords.empty());
         SEQAN_ASSERT(NULL == findContainingMultiRecord(collection, FastqRecord<SingleEnd>("READ_1", "ACTGGCATACG", "CCAT"), false));
-        FastqMultiRecord<SingleEnd> * ptr = findContainingMultiRecord(collection, FastqRecord<SingleEnd>("READ_2", "ACTGGCATACG", "CCAT"), true);
-        SEQAN_ASSERT(NULL != ptr);
-        SEQAN_ASSERT(ptr == findContainingMultiRecord(collection, FastqRecord<SingleEnd>("READ_3", "ACTGGCATACG", "CCAT"), true));
-        SEQAN_ASSERT(ptr == findContainingMultiRecord(collection, FastqRecord<SingleEnd>("READ_4", "ACTGGCATACG", "CCAT"), true));
-        SEQAN_ASSERT(ptr != findContainingMultiRecord(collection, FastqRecord<SingleEnd>("READ_5", "ACTGGCATACG", "CGAT"), true));
-        SEQAN_ASSERT(ptr != findContainingMultiRecord(collection, FastqRecord<SingleEnd>("READ_6", "ACTGGCATACG", "CGAT"), true));
-        SEQAN_ASSERT(ptr != findContainingMultiRecord(collection, FastqRecord<SingleEnd>("READ_7", "ACTGGGATACG", "CGAT"), true));
-        SEQAN_ASSERT_EQ(ptr->ids.size(), 3u);
-        SEQAN_ASSERT(ptr->ids.find("READ_2") != ptr->ids.end());
-        SEQAN_ASSERT(ptr->ids.find("READ_3") != ptr->ids.end());
-        SEQAN_ASSERT(ptr->ids.find("READ_4") != ptr->ids.end());
-        SEQAN_ASSERT_EQ(collection.bcMap["CCAT"].size(), 1u);
-        SEQAN_ASSERT_EQ(collection.bcMap["CGAT"].size(), 2u);
+        FastqMultiRecord<SingleEnd> * ptr = NULL;
+        ptr = findContainingMultiRecord(collection, FastqRecord<SingleEnd>("READ_2", "ACTGGCATACG", "CCAT"), true);
+        SEQAN_ASSERT(ptr == &collection.multiRecords[0]);
+        ptr = findContainingMultiRecord(collection, FastqRecord<SingleEnd>("READ_3", "ACTGGCATACG", "CCAT"), true);
+        SEQAN_ASSERT(ptr == &collection.multiRecords[0]);
+        ptr = findContainingMultiRecord(collection, FastqRecord<SingleEnd>("READ_4", "ACTGGCATACG", "CCAT"), true);
+        SEQAN_ASSERT(ptr == &collection.multiRecords[0]);
+        ptr = findContainingMultiRecord(collection, FastqRecord<SingleEnd>("READ_5", "ACTGGCATACG", "CGAT"), true);
+        SEQAN_ASSERT(ptr == &collection.multiRecords[1]);
+        ptr = findContainingMultiRecord(collection, FastqRecord<SingleEnd>("READ_6", "ACTGGCATACG", "CGAT"), true);
+        SEQAN_ASSERT(ptr == &collection.multiRecords[1]);
+        ptr = findContainingMultiRecord(collection, FastqRecord<SingleEnd>("READ_7", "ACTGGGATACG", "CGAT"), true);
+        SEQAN_ASSERT(ptr == &collection.multiRecords[2]);
+        SEQAN_ASSERT_EQ(collection.multiRecords.size(), 3u);
+        FastqMultiRecord<SingleEnd> const & rec = collection.multiRecords[0];
+        SEQAN_ASSERT_EQ(rec.ids.size(), 3u);
+        SEQAN_ASSERT(_containsReadId(collection, rec, "READ_2"));
+        SEQAN_ASSERT(_containsReadId(collection, rec, "READ_3"));
+        SEQAN_ASSERT(_containsReadId(collection, rec, "READ_4"));
+        SEQAN_ASSERT_EQ(collection.multiRecords[1].ids.size(), 2u);
     }
 }
 
+SEQAN_DEFINE_TEST(unit_tests_imseq_fastq_multi_record_repeated_read_ids_SingleEnd)
+{
+    {
+        FastqMultiRecordCollection<SingleEnd> collection;
+        findContainingMultiRecord(collection, FastqRecord<SingleEnd>("READ_1", "ACTGGCATACG", "CCAT"), true);
+        findContainingMultiRecord(collection, FastqRecord<SingleEnd>("READ_2", "ACTGGCATACG", "CCAT"), true);
+        // A repeated ID within a record is ignored
+        findContainingMultiRecord(collection, FastqRecord<SingleEnd>("READ_1", "ACTGGCATACG", "CCAT"), true);
+        SEQAN_ASSERT_EQ(collection.multiRecords[0].ids.size(), 2u);
+        SEQAN_ASSERT_EQ(length(collection.readIds), 2u);
+        SEQAN_ASSERT(!collection.repeatedReadIds);
+        // A repeated ID in another record is kept
+        findContainingMultiRecord(collection, FastqRecord<SingleEnd>("READ_2", "ACTGGCATACG", "CGAT"), true);
+        findContainingMultiRecord(collection, FastqRecord<SingleEnd>("READ_3", "ACTGGCATACG", "CGAT"), true);
+        SEQAN_ASSERT_EQ(collection.multiRecords[1].ids.size(), 2u);
+        SEQAN_ASSERT(collection.repeatedReadIds);
+        // The repeated ID shares its index
+        SEQAN_ASSERT_EQ(length(collection.readIds), 3u);
+        SEQAN_ASSERT_EQ(collection.multiRecords[1].ids[0], collection.multiRecords[0].ids[1]);
+        // A reused index is inserted in order
+        findContainingMultiRecord(collection, FastqRecord<SingleEnd>("READ_4", "ACTGGCATACG", "GGAT"), true);
+        findContainingMultiRecord(collection, FastqRecord<SingleEnd>("READ_1", "ACTGGCATACG", "GGAT"), true);
+        SEQAN_ASSERT_EQ(collection.multiRecords[2].ids.size(), 2u);
+        SEQAN_ASSERT(std::is_sorted(collection.multiRecords[2].ids.begin(), collection.multiRecords[2].ids.end()));
+        // Merging the records adds READ_2 only once
+        mergeReadIds(collection.multiRecords[0].ids, collection.multiRecords[1].ids);
+        FastqMultiRecord<SingleEnd> const & rec = collection.multiRecords[0];
+        SEQAN_ASSERT_EQ(rec.ids.size(), 3u);
+        SEQAN_ASSERT(std::is_sorted(rec.ids.begin(), rec.ids.end()));
+        SEQAN_ASSERT(_containsReadId(collection, rec, "READ_1"));
+        SEQAN_ASSERT(_containsReadId(collection, rec, "READ_2"));
+        SEQAN_ASSERT(_containsReadId(collection, rec, "READ_3"));
+    }
+}
+
+SEQAN_DEFINE_TEST(unit_tests_imseq_fastq_multi_record_merge_qualities_SingleEnd)
+{
+    FastqRecord<SingleEnd> first, second;
+    first.seq = "AC";
+    second.seq = "AC";
+    assignQualityValue(first.seq[0], 30);
+    assignQualityValue(first.seq[1], 30);
+    assignQualityValue(second.seq[0], 10);
+    assignQualityValue(second.seq[1], 20);
+    PackedSequenceStore store;
+    FastqMultiRecord<SingleEnd> target = newMultiRecord(first, 0, store);
+    FastqMultiRecord<SingleEnd> source = newMultiRecord(second, 1, store);
+    updateMultiRecord(target, first, 2);
+    mergeQualityValues(target, source);
+    SEQAN_ASSERT_EQ(target.nQualReads, 3u);
+    String<double> means = meanQualityValues(target.qualSums, target.nQualReads);
+    SEQAN_ASSERT_EQ(means[0], (2 * 30.0 + 10.0) / 3);
+    SEQAN_ASSERT_EQ(means[1], (2 * 30.0 + 20.0) / 3);
+
+    // The qualities are weighted by the reads they were taken from, not by
+    // read IDs added without qualities by the barcode correction
+    target = newMultiRecord(first, 0, store);
+    target.ids.push_back(3);
+    mergeQualityValues(target, source);
+    means = meanQualityValues(target.qualSums, target.nQualReads);
+    SEQAN_ASSERT_EQ(means[0], 20.0);
+    SEQAN_ASSERT_EQ(means[1], 25.0);
+
+    // Sums that could overflow are scaled down, keeping the means
+    uint32_t const maxQualReads = MAX_QUAL_READS;
+    target = newMultiRecord(first, 0, store);
+    target.nQualReads = MAX_QUAL_READS;
+    target.qualSums[0] = 30 * MAX_QUAL_READS;
+    target.qualSums[1] = 30 * MAX_QUAL_READS;
+    source.nQualReads = MAX_QUAL_READS;
+    source.qualSums[0] = 10 * MAX_QUAL_READS;
+    source.qualSums[1] = 20 * MAX_QUAL_READS;
+    mergeQualityValues(target, source);
+    SEQAN_ASSERT_LEQ(target.nQualReads, maxQualReads);
+    means = meanQualityValues(target.qualSums, target.nQualReads);
+    SEQAN_ASSERT_LT(std::abs(means[0] - 20.0), 1e-6);
+    SEQAN_ASSERT_LT(std::abs(means[1] - 25.0), 1e-6);
+}
+
+SEQAN_DEFINE_TEST(unit_tests_imseq_fastq_multi_record_readRecords_pipelined_SingleEnd)
+{
+    // Several input pipeline batches of reads with repeated sequences, some
+    // of them failing the quality control
+    std::string path = std::string(SEQAN_TEMP_FILENAME()) + ".fq";
+    {
+        std::ofstream out(path.c_str());
+        for (unsigned i = 0; i < 5000; ++i) {
+            uint32_t const h = (i % 211) * 2654435761u;
+            unsigned const len = i % 17 == 0 ? 10 : 30;
+            std::string seq, qual;
+            for (unsigned j = 0; j < len; ++j) {
+                seq += "ACGT"[(h >> (2 * (j % 16))) & 3];
+                qual += i % 13 == 0 ? '#' : 'I';
+            }
+            out << "@READ_" << i << "\n" << seq << "\n+\n" << qual << "\n";
+        }
+    }
+
+    CdrOptions options;
+    options.qmin = 20;
+    options.minReadLength = 20;
+    options.trunkReads = 0;
+
+    FastqMultiRecordCollection<SingleEnd> seqCollection, pipeCollection;
+    InputInformation seqII, pipeII;
+    String<RejectEvent> seqRejects, pipeRejects;
+    {
+        SeqInputStreams<SingleEnd> inStreams(path);
+        inStreams.totalInBytes = 0;     // No progress bar
+        options.jobs = 1;
+        readRecords(seqCollection, seqII, seqRejects, inStreams, options);
+    }
+    {
+        SeqInputStreams<SingleEnd> inStreams(path);
+        inStreams.totalInBytes = 0;
+        options.jobs = 4;
+        readRecords(pipeCollection, pipeII, pipeRejects, inStreams, options);
+    }
+    std::remove(path.c_str());
+
+    SEQAN_ASSERT_EQ(seqII.totalReadCount, 5000u);
+    SEQAN_ASSERT_EQ(pipeII.totalReadCount, seqII.totalReadCount);
+    SEQAN_ASSERT_EQ(pipeII.minReadLength, seqII.minReadLength);
+    SEQAN_ASSERT_EQ(pipeII.maxReadLength, seqII.maxReadLength);
+
+    SEQAN_ASSERT_GT(length(seqRejects), 0u);
+    SEQAN_ASSERT_EQ(length(pipeRejects), length(seqRejects));
+    for (size_t i = 0; i < length(seqRejects); ++i) {
+        SEQAN_ASSERT_EQ(pipeRejects[i].reason, seqRejects[i].reason);
+        SEQAN_ASSERT_EQ(readId(pipeCollection.readIds, pipeRejects[i].readId),
+                readId(seqCollection.readIds, seqRejects[i].readId));
+    }
+
+    SEQAN_ASSERT_EQ(pipeCollection.multiRecords.size(), seqCollection.multiRecords.size());
+    for (size_t i = 0; i < seqCollection.multiRecords.size(); ++i) {
+        FastqMultiRecord<SingleEnd> const & seqRec = seqCollection.multiRecords[i];
+        FastqMultiRecord<SingleEnd> const & pipeRec = pipeCollection.multiRecords[i];
+        SEQAN_ASSERT(pipeRec.seq == seqRec.seq);
+        SEQAN_ASSERT_EQ(pipeRec.nQualReads, seqRec.nQualReads);
+        SEQAN_ASSERT(pipeRec.qualSums == seqRec.qualSums);
+        SEQAN_ASSERT_EQ(pipeRec.ids.size(), seqRec.ids.size());
+        for (size_t j = 0; j < seqRec.ids.size(); ++j)
+            SEQAN_ASSERT_EQ(readId(pipeCollection.readIds, pipeRec.ids[j]), readId(seqCollection.readIds, seqRec.ids[j]));
+    }
+}
 
 #endif
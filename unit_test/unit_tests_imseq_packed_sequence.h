@@ -0,0 +1,115 @@
+// ============================================================================
+// IMSEQ - An immunogenetic sequence analysis tool
+// (C) Charite, Universitaetsmedizin Berlin
+// Author: Leon Kuchenbecker
+// ============================================================================
+// 
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License version 2 as published by
+// the Free Software Foundation.
+// 
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+// 
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+// ============================================================================
+
+
+#ifndef IMSEQ_UNIT_TESTS_IMSEQ_PACKED_SEQUENCE_H
+#define IMSEQ_UNIT_TESTS_IMSEQ_PACKED_SEQUENCE_H
+
+#include "../src/packed_sequence.h"
+
+SEQAN_DEFINE_TEST(unit_tests_imseq_packed_sequence_assignPacked)
+{
+    {
+        // Spans more than one word and contains N bases
+        String<Dna5> seq = "ACGTNACGTTGCANNGTACCATGACGTACGTAGCTAGCTAGCNNATCGATCGTAGCTAGN";
+        PackedSequenceStore store;
+        PackedDna5String packed;
+        assignPacked(packed, seq, store);
+        SEQAN_ASSERT_EQ(length(packed), length(seq));
+        SEQAN_ASSERT_EQ(unpack(packed), seq);
+        for (size_t i = 0; i < length(seq); ++i)
+            SEQAN_ASSERT_EQ(value(packed, i), seq[i]);
+
+        PackedDna5String other;
+        assignPacked(other, String<Dna5Q>(seq), store);
+        SEQAN_ASSERT(packed == other);
+        SEQAN_ASSERT_EQ(hashPacked(packed), hashPacked(other));
+
+        // 'A' and 'N' are stored identically in the packed words
+        seq[0] = 'N';
+        assignPacked(other, seq, store);
+        SEQAN_ASSERT(packed != other);
+
+        clear(other);
+        SEQAN_ASSERT(empty(other));
+    }
+}
+
+SEQAN_DEFINE_TEST(unit_tests_imseq_packed_sequence_hammingDistAtMost)
+{
+    {
+        PackedSequenceStore store;
+        PackedDna5String a, b;
+        assignPacked(a, String<Dna5>("ACGTACGTACGTACGTACGTACGTACGTACGTACGTAN"), store);
+        assignPacked(b, String<Dna5>("ACGTACGTACGTACGTACGTACGTACGTACGTACGTAN"), store);
+        SEQAN_ASSERT(hammingDistAtMost(a, b, 0));
+        assignPacked(b, String<Dna5>("NCGTACGTACGTACGTACGTACGTACGTACGTACCTAA"), store);
+        SEQAN_ASSERT(!hammingDistAtMost(a, b, 2));
+        SEQAN_ASSERT(hammingDistAtMost(a, b, 3));
+        assignPacked(b, String<Dna5>("ACGTACGTACGTACGTACGTACGTACGTACGTACGTA"), store);
+        SEQAN_ASSERT(!hammingDistAtMost(a, b, 10));
+    }
+}
+
+SEQAN_DEFINE_TEST(unit_tests_imseq_packed_sequence_store)
+{
+    {
+        // Sequences of different lengths, some spanning several chunks
+        std::vector<String<Dna5> > seqs;
+        for (unsigned i = 0; i < 300; ++i)
+        {
+            String<Dna5> seq;
+            for (unsigned j = 0; j < (i * 37) % 3000; ++j)
+                appendValue(seq, Dna5((i + j * j) % 5));
+            seqs.push_back(seq);
+        }
+
+        PackedSequenceStore store;
+        std::vector<PackedDna5String> packed(seqs.size());
+        for (unsigned i = 0; i < seqs.size(); ++i)
+            assignPacked(packed[i], seqs[i], store);
+
+        // The sequences remain valid when the store is moved
+        PackedSequenceStore moved(std::move(store));
+        for (unsigned i = 0; i < seqs.size(); ++i)
+            SEQAN_ASSERT_EQ(unpack(packed[i]), seqs[i]);
+
+        // Rewinding releases the words allocated after the mark only
+        PackedSequenceStore::Mark const mark = moved.mark();
+        PackedDna5String probe;
+        assignPacked(probe, seqs[1], moved);
+        SEQAN_ASSERT(probe == packed[1]);
+        moved.rewind(mark);
+        PackedDna5String next;
+        assignPacked(next, seqs[1], moved);
+        SEQAN_ASSERT(packedWords(next) == packedWords(probe));
+        for (unsigned i = 0; i < seqs.size(); ++i)
+            SEQAN_ASSERT_EQ(unpack(packed[i]), seqs[i]);
+
+        // The empty sequence does not use the store
+        PackedDna5String emptySeq;
+        assignPacked(emptySeq, String<Dna5>(), moved);
+        SEQAN_ASSERT(empty(emptySeq));
+        SEQAN_ASSERT(emptySeq == PackedDna5String());
+    }
+}
+
+#endif
@@ -0,0 +1,256 @@
+// ============================================================================
+// IMSEQ - An immunogenetic sequence analysis tool
+// (C) Charite, Universitaetsmedizin Berlin
+// Author: Leon Kuchenbecker
+// ============================================================================
+// 
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License version 2 as published by
+// the Free Software Foundation.
+// 
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+// 
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+// ============================================================================
+
+
+
+#ifndef IMSEQ_UNIT_TESTS_IMSEQ_REFERENCE_PREPARATION_H
+#define IMSEQ_UNIT_TESTS_IMSEQ_REFERENCE_PREPARATION_H
+
+#include <sstream>
+#include <fstream>
+#include <cstdio>
+
+#include "../src/vjMatching.h"
+#include "../src/referencePreparation.h"
+
+/**
+ * Four V segments with the same SCF. Segment 1 differs from segment 0 at the
+ * first window position, segment 2 close to the motif, segment 3 has its
+ * motif one position further downstream.
+ */
+inline void _windowTestReferences(CdrReferences & references)
+{
+    appendValue(references.leftSegs, "GGATCACAGTCTACACTGCTCACTCCAACCCCGGCCCCTGAGTCCGAGGAGAGGGTGCTTCAGAGTATGT");
+    appendValue(references.leftSegs, "TGATCACAGTCTACACTGCTCACTCCAACCCCGGCCCCTGAGTCCGAGGAGAGGGTGCTTCAGAGTATGT");
+    appendValue(references.leftSegs, "GGATCACAGTCTACACTGCTCACTCCAACCCCGGCCCCTGAGTCCGAGGATAGGGTGCTTCAGAGTATGT");
+    appendValue(references.leftSegs, "AGGATCACAGTCTACACTGCTCACTCCAACCCCGGCCCCTGAGTCCGAGGAGAGGGTGCTTCAGAGTATGT");
+    resize(references.leftMeta, 4);
+    for (unsigned segId = 0; segId < 4; ++segId)
+        references.leftMeta[segId].motifPos = segId == 3 ? 61 : 60;
+    buildLeftSCFs(references, -7, 10);
+}
+
+SEQAN_DEFINE_TEST(unit_tests_imseq_reference_preparation_buildSCFWindowIds)
+{
+    CdrReferences references;
+    _windowTestReferences(references);
+    buildSCFWindowIds(references, 0, LeftOverlap());
+
+    SEQAN_ASSERT_EQ(length(references.leftSCFs), 1u);
+    String<unsigned> const & windowIds = references.leftSCFWindowIds[0];
+    String<unsigned> const & windowShared = references.leftSCFWindowShared[0];
+    SEQAN_ASSERT_EQ(length(windowIds), 4u);
+    SEQAN_ASSERT_EQ(windowIds[0], 0u);
+    SEQAN_ASSERT_EQ(windowIds[1], 0u);
+    SEQAN_ASSERT_EQ(windowIds[2], 0u);
+    SEQAN_ASSERT_EQ(windowIds[3], 3u);
+    SEQAN_ASSERT_EQ(windowShared[0], 63u);
+    SEQAN_ASSERT_EQ(windowShared[1], 62u);
+    SEQAN_ASSERT_EQ(windowShared[2], 12u);
+    SEQAN_ASSERT_EQ(windowShared[3], 64u);
+
+    // A shift into the CDR3 region extends all windows alike
+    buildSCFWindowIds(references, 2, LeftOverlap());
+    SEQAN_ASSERT_EQ(references.leftSCFWindowIds[0][1], 0u);
+    SEQAN_ASSERT_EQ(references.leftSCFWindowShared[0][1], 64u);
+    SEQAN_ASSERT_EQ(references.leftSCFWindowShared[0][2], 14u);
+}
+
+SEQAN_DEFINE_TEST(unit_tests_imseq_reference_preparation_findBestSCFs_sharedWindows)
+{
+    typedef Infix<String<Dna5> const>::Type TInfix;
+    typedef String<SegmentMatch<TInfix> > TSegmentMatches;
+
+    CdrReferences references;
+    _windowTestReferences(references);
+    buildSCFWindowIds(references, 0, LeftOverlap());
+
+    CdrOptions options;
+    options.vSCFOffset = 0;
+    options.maxErrRateV = 0.2;
+
+    // The read covers the window of segment 0 from position 18 on, the SCF
+    // matches read positions [35, 45)
+    StringSet<String<Dna5> > reads;
+    appendValue(reads, "CTCACTCCAACCCCGGCCCCTGAGTCCGAGGAGAGGGTGCTTCAGTTTTTTTTTT");
+    StringSet<String<CandidateCoreSegmentMatch> > candidates;
+    resize(candidates, 1);
+    appendValue(candidates[0], CandidateCoreSegmentMatch(0, 35, 45));
+
+    // The band does not reach the first window positions: segment 1 shares
+    // the alignment of segment 0, segment 2 does not
+    unsigned const banded = bandedWindowLength(candidates[0][0], reads[0], 0, references, options.maxErrRateV, 0,
+            LeftOverlap());
+    SEQAN_ASSERT_LEQ(banded, 62u);
+    SEQAN_ASSERT_GT(banded, 12u);
+
+    StringSet<TSegmentMatches> shared, unshared;
+    findBestSCFs(shared, candidates, reads, references, options, LeftOverlap());
+    for (unsigned i = 0; i < length(references.leftSCFWindowIds[0]); ++i)
+        references.leftSCFWindowIds[0][i] = references.leftSCFToSegIds[0][i];
+    findBestSCFs(unshared, candidates, reads, references, options, LeftOverlap());
+
+    SEQAN_ASSERT_EQ(length(shared[0]), 3u);
+    SEQAN_ASSERT_EQ(shared[0][0].db, 0u);
+    SEQAN_ASSERT_EQ(shared[0][1].db, 1u);
+    SEQAN_ASSERT_EQ(shared[0][2].db, 3u);
+    SEQAN_ASSERT_EQ(length(unshared[0]), length(shared[0]));
+    for (unsigned i = 0; i < length(shared[0]); ++i)
+    {
+        SEQAN_ASSERT_EQ(shared[0][i].db, unshared[0][i].db);
+        SEQAN_ASSERT_EQ(shared[0][i].score, unshared[0][i].score);
+        // The alignment refers to the sequence of its own segment
+        SEQAN_ASSERT(&host(source(row(shared[0][i].align, 1))) == &references.leftSegs[shared[0][i].db]);
+        for (unsigned r = 0; r < 2; ++r)
+        {
+            std::stringstream sharedRow, unsharedRow;
+            sharedRow << row(shared[0][i].align, r);
+            unsharedRow << row(unshared[0][i].align, r);
+            SEQAN_ASSERT_EQ(sharedRow.str(), unsharedRow.str());
+            SEQAN_ASSERT_EQ(beginPosition(source(row(shared[0][i].align, r))),
+                    beginPosition(source(row(unshared[0][i].align, r))));
+        }
+    }
+}
+
+template <typename TStringSet>
+void _assertEqualStringSets(TStringSet const & a, TStringSet const & b)
+{
+    SEQAN_ASSERT_EQ(length(a), length(b));
+    for (unsigned i = 0; i < length(a); ++i)
+        SEQAN_ASSERT(a[i] == b[i]);
+}
+
+inline void _assertEqualSegmentMeta(String<SegmentMeta> const & a, String<SegmentMeta> const & b)
+{
+    SEQAN_ASSERT_EQ(length(a), length(b));
+    for (unsigned i = 0; i < length(a); ++i)
+    {
+        SEQAN_ASSERT_EQ(a[i].geneName, b[i].geneName);
+        SEQAN_ASSERT_EQ(a[i].segType, b[i].segType);
+        SEQAN_ASSERT_EQ(a[i].segId, b[i].segId);
+        SEQAN_ASSERT_EQ(a[i].allel, b[i].allel);
+        SEQAN_ASSERT_EQ(a[i].motifPos, b[i].motifPos);
+    }
+}
+
+inline void _assertEqualSCFPos(CdrReferences::TSCFPos const & a, CdrReferences::TSCFPos const & b)
+{
+    SEQAN_ASSERT_EQ(length(a), length(b));
+    for (unsigned i = 0; i < length(a); ++i)
+    {
+        SEQAN_ASSERT_EQ(a[i].beginPos, b[i].beginPos);
+        SEQAN_ASSERT_EQ(a[i].endPos, b[i].endPos);
+    }
+}
+
+/**
+ * Overwrites the bytes of a file at the given offset
+ */
+inline void _overwriteFile(std::string const & path, size_t const offset, char const * bytes, size_t const n)
+{
+    std::fstream fs(path.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+    fs.seekp(offset);
+    fs.write(bytes, n);
+}
+
+SEQAN_DEFINE_TEST(unit_tests_imseq_reference_preparation_referenceIndex_roundTrip)
+{
+    std::string const fastaPath = std::string(SEQAN_TEMP_FILENAME()) + ".fa";
+    std::string const indexPath = std::string(SEQAN_TEMP_FILENAME()) + ".idx";
+    CharString const indexPathStr = indexPath.c_str();
+    {
+        std::ofstream ofs(fastaPath.c_str());
+        ofs << ">TRB|V|1|01|40\ntttcctcatgcaattcaaaaccatgtccgtaatgtaggcgaaatagtaaa\n"
+            << ">TRB|V|1|02|40\ntttcctcatgaaattcaaaaccatgtccgtaatgtaggcgaaatagtaaa\n"
+            << ">TRB|V|2|01|38\nccattttacggaggataccaaattcctccttattcaggacctaacctg\n"
+            << ">TRB|J|1|01|12\naggtaaaccaggtctctccgcccccttataaaagctgttg\n"
+            << ">TRB|J|2|01|12\ncacctagccaagttcaacggcagctgcaatggaaataggcaa\n";
+    }
+
+    CdrOptions options;
+    options.refFasta = fastaPath.c_str();
+    options.vSCFLength = 10;
+    options.vSCFOffset = 0;
+    options.jSCFLength = 10;
+    options.jSCFOffset = -6;
+
+    CdrReferences expected;
+    readAndPreprocessReferences(expected, options, 150);
+    SEQAN_ASSERT(writeReferenceIndex(indexPathStr, expected));
+
+    // Reading the index yields the references prepared from the FASTA file
+    options.refIndexPath = indexPathStr;
+    CdrReferences loaded;
+    readAndPreprocessReferences(loaded, options, 150);
+
+    _assertEqualStringSets(loaded.leftSegs, expected.leftSegs);
+    _assertEqualSegmentMeta(loaded.leftMeta, expected.leftMeta);
+    _assertEqualStringSets(loaded.leftIdentOffsets, expected.leftIdentOffsets);
+    SEQAN_ASSERT(loaded.leftToFirstAllel == expected.leftToFirstAllel);
+    SEQAN_ASSERT_EQ(loaded.leftSCFStart, expected.leftSCFStart);
+    SEQAN_ASSERT_EQ(loaded.leftSCFLength, expected.leftSCFLength);
+    _assertEqualStringSets(loaded.leftSCFs, expected.leftSCFs);
+    _assertEqualStringSets(loaded.leftSCFToSegIds, expected.leftSCFToSegIds);
+    SEQAN_ASSERT(loaded.leftSegToScfId == expected.leftSegToScfId);
+    _assertEqualSCFPos(loaded.leftSCFPos, expected.leftSCFPos);
+
+    _assertEqualStringSets(loaded.rightSegs, expected.rightSegs);
+    _assertEqualSegmentMeta(loaded.rightMeta, expected.rightMeta);
+    _assertEqualStringSets(loaded.rightIdentOffsets, expected.rightIdentOffsets);
+    SEQAN_ASSERT(loaded.rightToFirstAllel == expected.rightToFirstAllel);
+    SEQAN_ASSERT_EQ(loaded.rightSCFStart, expected.rightSCFStart);
+    SEQAN_ASSERT_EQ(loaded.rightSCFLength, expected.rightSCFLength);
+    _assertEqualStringSets(loaded.rightSCFs, expected.rightSCFs);
+    _assertEqualStringSets(loaded.rightSCFToSegIds, expected.rightSCFToSegIds);
+    SEQAN_ASSERT(loaded.rightSegToScfId == expected.rightSegToScfId);
+    _assertEqualSCFPos(loaded.rightSCFPos, expected.rightSCFPos);
+
+    // The alleles of V segment 1 share their first allele and their SCF
+    SEQAN_ASSERT_EQ(length(loaded.leftSegs), 3u);
+    SEQAN_ASSERT_EQ(loaded.leftToFirstAllel[1], 0u);
+    SEQAN_ASSERT_EQ(loaded.leftSegToScfId[0], loaded.leftSegToScfId[1]);
+
+    // A file written by another format version is rejected
+    {
+        char version[8] = { 2, 0, 0, 0, 0, 0, 0, 0 };
+        _overwriteFile(indexPath, sizeof(REFERENCE_INDEX_MAGIC), version, sizeof(version));
+        CdrReferences rejected;
+        SEQAN_ASSERT(!loadReferenceIndex(rejected, indexPathStr));
+    }
+
+    // A file that is no reference index is rejected
+    SEQAN_ASSERT(writeReferenceIndex(indexPathStr, expected));
+    {
+        _overwriteFile(indexPath, 0, "IMSEQIDX", 8);
+        CdrReferences rejected;
+        SEQAN_ASSERT(!loadReferenceIndex(rejected, indexPathStr));
+    }
+    {
+        CdrReferences rejected;
+        SEQAN_ASSERT(!loadReferenceIndex(rejected, options.refFasta));
+    }
+
+    std::remove(fastaPath.c_str());
+    std::remove(indexPath.c_str());
+}
+
+#endif
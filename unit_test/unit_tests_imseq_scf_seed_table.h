@@ -0,0 +1,72 @@
+// ============================================================================
+// IMSEQ - An immunogenetic sequence analysis tool
+// (C) Charite, Universitaetsmedizin Berlin
+// Author: Leon Kuchenbecker
+// ============================================================================
+// 
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License version 2 as published by
+// the Free Software Foundation.
+// 
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+// 
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+// ============================================================================
+
+
+#ifndef IMSEQ_UNIT_TESTS_IMSEQ_SCF_SEED_TABLE_H
+#define IMSEQ_UNIT_TESTS_IMSEQ_SCF_SEED_TABLE_H
+
+#include "../src/scf_seed_table.h"
+
+SEQAN_DEFINE_TEST(unit_tests_imseq_scf_seed_table_build)
+{
+    StringSet<String<Dna5> > scfs;
+    appendValue(scfs, "ACGTACGTAC");
+    appendValue(scfs, "GGGGGNTTTT");
+
+    SCFSeedTable table;
+    buildSCFSeedTable(table, scfs, 1);
+    SEQAN_ASSERT_EQ(table.seedLength, 5u);
+    SEQAN_ASSERT_EQ(table.scfLength, 10u);
+    SEQAN_ASSERT_EQ(table.seeds.size(), 2u);
+    SEQAN_ASSERT_EQ(table.unseededSCFs.size(), 1u);
+    SEQAN_ASSERT_EQ(table.unseededSCFs[0], 1u);
+
+    // More errors than bases per part
+    buildSCFSeedTable(table, scfs, 10);
+    SEQAN_ASSERT_EQ(table.seedLength, 0u);
+    SEQAN_ASSERT_EQ(table.unseededSCFs.size(), 2u);
+}
+
+SEQAN_DEFINE_TEST(unit_tests_imseq_scf_seed_table_forEachSCFSeedHit)
+{
+    StringSet<String<Dna5> > scfs;
+    appendValue(scfs, "ACGTACGTAC");
+    SCFSeedTable table;
+    buildSCFSeedTable(table, scfs, 1);
+
+    // Second part (offset 5) matches at read position 9, the first one not
+    String<Dna5> read = "TTTTNTTTTCGTACTTT";
+    std::vector<std::pair<unsigned, long long> > hits;
+    forEachSCFSeedHit(read, table, [&](unsigned scfId, long long diagonal) { hits.push_back(std::make_pair(scfId, diagonal)); });
+    SEQAN_ASSERT_EQ(hits.size(), 1u);
+    SEQAN_ASSERT_EQ(hits[0].first, 0u);
+    SEQAN_ASSERT_EQ(hits[0].second, 4);
+
+    // Seeds spanning an N are skipped
+    read = "ACGNACGTAC";
+    hits.clear();
+    forEachSCFSeedHit(read, table, [&](unsigned scfId, long long diagonal) { hits.push_back(std::make_pair(scfId, diagonal)); });
+    SEQAN_ASSERT_EQ(hits.size(), 2u);
+    SEQAN_ASSERT_EQ(hits[0].second, 4);     // First part at read position 4
+    SEQAN_ASSERT_EQ(hits[1].second, 0);     // Second part at read position 5
+}
+
+#endif
@@ -0,0 +1,65 @@
+// ============================================================================
+// IMSEQ - An immunogenetic sequence analysis tool
+// (C) Charite, Universitaetsmedizin Berlin
+// Author: Leon Kuchenbecker
+// ============================================================================
+// 
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License version 2 as published by
+// the Free Software Foundation.
+// 
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+// 
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+// ============================================================================
+
+
+#ifndef IMSEQ_UNIT_TESTS_IMSEQ_SEQUENCE_KERNELS_H
+#define IMSEQ_UNIT_TESTS_IMSEQ_SEQUENCE_KERNELS_H
+
+#include "../src/sequence_kernels.h"
+
+SEQAN_DEFINE_TEST(unit_tests_imseq_sequence_kernels_packedLaneMismatches)
+{
+    {
+        uint64_t wordsA[5] = { 0, 0, 0, 0, 0 };
+        uint64_t wordsB[5] = { 3, 0, 2, 1ULL << 63, 0xF0 };
+        SEQAN_ASSERT_EQ(packedLaneMismatches(wordsA, wordsB, 1, 10), 1u);
+        SEQAN_ASSERT_EQ(packedLaneMismatches(wordsA, wordsB, 4, 10), 3u);
+        SEQAN_ASSERT_EQ(packedLaneMismatches(wordsA, wordsB, 5, 10), 5u);
+        SEQAN_ASSERT_EQ(packedLaneMismatches(wordsA, wordsA, 5, 0), 0u);
+    }
+}
+
+SEQAN_DEFINE_TEST(unit_tests_imseq_sequence_kernels_boundedEditDistance)
+{
+    {
+        String<Dna5> a = "ACGTACGTAC";
+        SEQAN_ASSERT_EQ(boundedEditDistance(a, a, 0), 0u);
+        SEQAN_ASSERT_EQ(boundedEditDistance(a, String<Dna5>("CGTACGTAC"), 1), 1u);
+        SEQAN_ASSERT_EQ(boundedEditDistance(a, String<Dna5>("AGTACCTACN"), 5), 3u);
+        SEQAN_ASSERT_EQ(boundedEditDistance(a, String<Dna5>("AGTACCTACN"), 2), 3u);
+        SEQAN_ASSERT_EQ(boundedEditDistance(a, String<Dna5>(""), 20), 10u);
+    }
+    {
+        // Spans several blocks
+        String<Dna5> a, b;
+        for (unsigned i = 0; i < 150; ++i)
+            appendValue(a, Dna5(i * 7 % 5));
+        b = a;
+        b[3] = 'N';
+        erase(b, 70);
+        insertValue(b, 130, Dna5('G'));
+        SEQAN_ASSERT_EQ(boundedEditDistance(a, b, 10), 3u);
+        SEQAN_ASSERT_EQ(boundedEditDistance(a, b, 2), 3u);
+        SEQAN_ASSERT_EQ(boundedEditDistance(b, a, 3), 3u);
+    }
+}
+
+#endif
@@ -0,0 +1,131 @@
+// ============================================================================
+// IMSEQ - An immunogenetic sequence analysis tool
+// (C) Charite, Universitaetsmedizin Berlin
+// Author: Leon Kuchenbecker
+// ============================================================================
+// 
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License version 2 as published by
+// the Free Software Foundation.
+// 
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+// 
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+// ============================================================================
+
+
+
+#ifndef IMSEQ_UNIT_TESTS_IMSEQ_VJ_MATCHING_H
+#define IMSEQ_UNIT_TESTS_IMSEQ_VJ_MATCHING_H
+
+#include "../src/vjMatching.h"
+
+SEQAN_DEFINE_TEST(unit_tests_imseq_vj_matching_filterSCFsBySeeds)
+{
+    StringSet<String<Dna5> > scfs;
+    appendValue(scfs, "ACGTACGTAC");
+    appendValue(scfs, "GGGGGNTTTT");    // Not seeded
+    SCFSeedTable table;
+    buildSCFSeedTable(table, scfs, 1);
+
+    // Seed hit on diagonal 4, the window is widened by the maximum number of
+    // errors on both sides
+    String<Dna5> read = "TTTTNTTTTCGTACTTT";
+    TSCFInfixPosMap windows = filterSCFsBySeeds(read, table);
+    SEQAN_ASSERT_EQ(windows.size(), 2u);
+    SEQAN_ASSERT_EQ(windows[0].beginPos, 3);
+    SEQAN_ASSERT_EQ(windows[0].endPos, 15);
+    // Unseeded SCFs are verified against the whole read
+    SEQAN_ASSERT_EQ(windows[1].beginPos, 0);
+    SEQAN_ASSERT_EQ(windows[1].endPos, 17);
+
+    // Windows are clipped to the read, here the seed hit is on diagonal -5
+    read = "CGTACTTT";
+    windows = filterSCFsBySeeds(read, table);
+    SEQAN_ASSERT_EQ(windows[0].beginPos, 0);
+    SEQAN_ASSERT_EQ(windows[0].endPos, 6);
+
+    // Hits on different diagonals are merged into one window
+    read = "ACGTATTTTTTTCGTACTTT";
+    windows = filterSCFsBySeeds(read, table);
+    SEQAN_ASSERT_EQ(windows[0].beginPos, 0);    // First part on diagonal 0
+    SEQAN_ASSERT_EQ(windows[0].endPos, 18);     // Second part on diagonal 7
+
+    // Only the SCFs in the limiting set are reported
+    TArenaIdSet scfIdLim;
+    scfIdLim.insert(0);
+    windows = filterSCFsBySeeds(read, table, &scfIdLim);
+    SEQAN_ASSERT_EQ(windows.size(), 1u);
+    SEQAN_ASSERT(windows.find(0) != windows.end());
+    scfIdLim.clear();
+    windows = filterSCFsBySeeds(read, table, &scfIdLim);
+    SEQAN_ASSERT(windows.empty());
+}
+
+SEQAN_DEFINE_TEST(unit_tests_imseq_vj_matching_findCandidateCoreSegments_kmer_swift)
+{
+    unsigned const maxErrors = 1;
+
+    CdrReferences::TSegCoreFragmentStringSet scfs;
+    appendValue(scfs, "ACGGACCAGA");
+    appendValue(scfs, "GCAACGGCCA");
+    appendValue(scfs, "CCGAGAAGCG");
+
+    // Prepared like buildSCFIndex()
+    CdrReferences::TQGramIndex index(scfs);
+    resize(indexShape(index), length(scfs[0]) / (maxErrors + 1));
+    indexRequire(index, QGramSADir());
+    CdrReferences::TSCFPatterns patterns;
+    resize(patterns, length(scfs));
+    for (unsigned scfId = 0; scfId < length(scfs); ++scfId)
+        setHost(patterns[scfId], scfs[scfId]);
+    SCFSeedTable table;
+    buildSCFSeedTable(table, scfs, maxErrors);
+
+    StringSet<String<Dna5> > reads;
+    appendValue(reads, "TTTTTACGGACCAGATTTTTTTTTTCCGAGAAGCGTTTTT");
+    appendValue(reads, "TTTTTTTTTTTTGCAACGGCCATTTTTTTTTTTTTTTTTT");
+    appendValue(reads, "TTTTTTTTTTTTTTTTTTTTTTTTTTTTTTTTTTTTTTTT");
+    appendValue(reads, "CCGAGAAGCGTTTTTTTTTTTTTTTTTTTTACGGACCAGA");
+    // One error within each SCF
+    appendValue(reads, "TTTTTACGGTCCAGATTTTTTTTTTTTTTTGCAACGCCAT");
+
+    StringSet<String<CandidateCoreSegmentMatch> > swiftResults, kmerResults;
+    findCandidateCoreSegments(swiftResults, reads, scfs, index, patterns, nullptr, maxErrors);
+    findCandidateCoreSegments(kmerResults, reads, scfs, index, patterns, &table, maxErrors);
+
+    SEQAN_ASSERT_EQ(length(swiftResults), length(reads));
+    SEQAN_ASSERT_EQ(length(kmerResults), length(reads));
+    for (unsigned readId = 0; readId < length(reads); ++readId)
+    {
+        SEQAN_ASSERT_EQ(length(swiftResults[readId]), length(kmerResults[readId]));
+        for (unsigned i = 0; i < length(swiftResults[readId]); ++i)
+        {
+            SEQAN_ASSERT_EQ(swiftResults[readId][i].coreSegId, kmerResults[readId][i].coreSegId);
+            SEQAN_ASSERT_EQ(swiftResults[readId][i].readBeginPos, kmerResults[readId][i].readBeginPos);
+            SEQAN_ASSERT_EQ(swiftResults[readId][i].readEndPos, kmerResults[readId][i].readEndPos);
+        }
+    }
+
+    // The filters find the expected SCFs at all
+    SEQAN_ASSERT_EQ(length(kmerResults[0]), 2u);
+    SEQAN_ASSERT_EQ(kmerResults[0][0].coreSegId, 0u);
+    SEQAN_ASSERT_EQ(kmerResults[0][0].readBeginPos, 5u);
+    SEQAN_ASSERT_EQ(kmerResults[0][0].readEndPos, 15u);
+    SEQAN_ASSERT_EQ(kmerResults[0][1].coreSegId, 2u);
+    SEQAN_ASSERT_EQ(kmerResults[0][1].readBeginPos, 25u);
+    SEQAN_ASSERT_EQ(kmerResults[0][1].readEndPos, 35u);
+    SEQAN_ASSERT_EQ(length(kmerResults[1]), 1u);
+    SEQAN_ASSERT_EQ(kmerResults[1][0].coreSegId, 1u);
+    SEQAN_ASSERT_EQ(length(kmerResults[2]), 0u);
+    SEQAN_ASSERT_EQ(length(kmerResults[3]), 2u);
+    SEQAN_ASSERT_EQ(length(kmerResults[4]), 2u);
+}
+
+#endif
@@ -0,0 +1,115 @@
+// ============================================================================
+// IMSEQ - An immunogenetic sequence analysis tool
+// (C) Charite, Universitaetsmedizin Berlin
+// Author: Leon Kuchenbecker
+// ============================================================================
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License version 2 as published by
+// the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+// ============================================================================
+
+// ============================================================================
+// Throughput benchmark for the input decompression (src/gzip_input.h).
+//
+// Built as the target gzip_input_benchmark if IMSEQ is configured with
+// -DIMSEQ_BUILD_BENCHMARKS=ON.
+//
+// Scaled up inputs can be generated from the example data, e.g. a
+// multi-member gzip file with
+//   for i in $(seq 50); do cat ../examples/data/*.fq.gz; done > large.fq.gz
+// and a BGZF file with
+//   zcat large.fq.gz | bgzip > large.bgzf.gz
+//
+// Usage:
+//   gzip_input_benchmark <file> [<threads> ...]
+// ============================================================================
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include <zlib.h>
+
+#include "gzip_input.h"
+
+/**
+ * Reads the file once through plain zlib to obtain a single-threaded baseline
+ */
+static uint64_t readWithZlib(std::string const & path)
+{
+    gzFile file = gzopen(path.c_str(), "rb");
+    if (file == NULL)
+        return 0;
+    std::vector<char> buf(1 << 16);
+    uint64_t total = 0;
+    int n;
+    while ((n = gzread(file, &buf[0], buf.size())) > 0)
+        total += n;
+    gzclose(file);
+    return total;
+}
+
+/**
+ * Reads the file once through an InputFile with the given number of threads
+ */
+static uint64_t readWithInputFile(std::string const & path, unsigned threads)
+{
+    InputFile file;
+    if (!file.open(path, threads))
+        return 0;
+    std::vector<char> buf(1 << 16);
+    uint64_t total = 0;
+    std::istream & stream = file.stream();
+    while (true) {
+        stream.read(&buf[0], buf.size());
+        if (stream.gcount() == 0)
+            break;
+        total += stream.gcount();
+    }
+    return total;
+}
+
+template <typename TFunc>
+static void report(std::string const & label, TFunc f)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    uint64_t bytes = f();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << label << '\t' << bytes << " bytes\t" << seconds << " s\t" << (bytes / seconds / (1 << 20)) << " MiB/s" << std::endl;
+}
+
+int main(int argc, char const ** argv)
+{
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <file> [<threads> ...]" << std::endl;
+        return 1;
+    }
+    std::string path = argv[1];
+    std::vector<unsigned> threads;
+    for (int i = 2; i < argc; ++i)
+        threads.push_back(std::atoi(argv[i]));
+    if (threads.empty())
+        threads.push_back(1);
+
+    try {
+        report("zlib", [&]() { return readWithZlib(path); });
+        for (unsigned t : threads)
+            report("InputFile -j" + std::to_string(t), [&]() { return readWithInputFile(path, t); });
+    } catch (std::string const & s) {
+        std::cerr << "[ERROR] " << s << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,224 @@
+// ============================================================================
+// IMSEQ - An immunogenetic sequence analysis tool
+// (C) Charite, Universitaetsmedizin Berlin
+// Author: Leon Kuchenbecker
+// ============================================================================
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License version 2 as published by
+// the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+// ============================================================================
+
+// ============================================================================
+// Benchmark of the two SCF candidate filters ('--scf-filter swift|kmer',
+// filterSCFs() and filterSCFsBySeeds() in src/vjMatching.h).
+//
+// Reads are simulated from the segments of a reference file. For the J
+// direction, a random prefix is followed by the beginning of a J segment, for
+// the V direction the end of a V segment is followed by a random suffix. The
+// segment parts are mutated with the V / J error rate, half of the errors are
+// indels. One read in ten is random sequence without any segment.
+//
+// For both filters and directions, the benchmark reports the filter time, the
+// number of candidate windows, the share of windows in which verifySCFHits()
+// finds no SCF match (false positives) and the number of reads for which the
+// verified candidate matches differ between the two filters.
+//
+// Built as the target scf_filter_benchmark if IMSEQ is configured with
+// -DIMSEQ_BUILD_BENCHMARKS=ON.
+//
+// Usage:
+//   scf_filter_benchmark <reference.fa> [<reads> [<V SCF length>]]
+//
+//   e.g. with ../references/Homo.Sapiens.TRB.fa and Homo.Sapiens.IGH.fa
+// ============================================================================
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "vjMatching.h"
+#include "referencePreparation.h"
+
+using namespace seqan;
+
+typedef String<Dna5> TSeq;
+
+static double seconds(std::chrono::steady_clock::time_point const & start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void appendRandom(TSeq & seq, unsigned const n, std::mt19937 & rng)
+{
+    for (unsigned i = 0; i < n; ++i)
+        appendValue(seq, Dna5(static_cast<unsigned>(rng() % 4)));
+}
+
+static TSeq mutate(TSeq seq, double const errRate, std::mt19937 & rng)
+{
+    std::uniform_real_distribution<double> uniform(0, 1);
+    TSeq res;
+    for (unsigned i = 0; i < length(seq); ++i)
+    {
+        if (uniform(rng) >= errRate)
+            appendValue(res, seq[i]);
+        else if (rng() % 2 == 0)
+            appendValue(res, Dna5(static_cast<unsigned>((ordValue(seq[i]) + 1 + rng() % 3) % 4)));
+        else if (rng() % 2 == 0) {
+            // Insertion
+            appendValue(res, seq[i]);
+            appendRandom(res, 1, rng);
+        }
+        // else: deletion
+    }
+    return res;
+}
+
+template <typename TOverlapDirection>
+StringSet<TSeq> simulateReads(CdrReferences const & references, unsigned const nReads, double const errRate,
+        std::mt19937 & rng, TOverlapDirection const)
+{
+    StringSet<TSeq> const & segs = getSegmentSequences(references, TOverlapDirection());
+    StringSet<TSeq> reads;
+    for (unsigned r = 0; r < nReads; ++r)
+    {
+        TSeq read;
+        TSeq const & seg = segs[rng() % length(segs)];
+        if (r % 10 == 9)
+            appendRandom(read, 150, rng);
+        else if (IsSameType<TOverlapDirection, RightOverlap>::VALUE) {
+            appendRandom(read, 100, rng);
+            append(read, mutate(prefix(seg, std::min<unsigned>(50, length(seg))), errRate, rng));
+        } else {
+            append(read, mutate(suffix(seg, length(seg) - std::min<unsigned>(110, length(seg))), errRate, rng));
+            appendRandom(read, 40, rng);
+        }
+        appendValue(reads, read);
+    }
+    return reads;
+}
+
+struct FilterResult {
+    double seconds;
+    uint64_t nWindows;
+    uint64_t nEmptyWindows;
+    std::vector<std::vector<std::pair<unsigned, unsigned> > > matches;
+
+    FilterResult() : seconds(0), nWindows(0), nEmptyWindows(0) {}
+};
+
+template <typename TOverlapDirection>
+FilterResult runFilter(StringSet<TSeq> const & reads, CdrReferences const & references, unsigned const maxErrors,
+        bool const kmer, TOverlapDirection const)
+{
+    typedef Pattern<CdrReferences::TQGramIndex, Swift<SwiftSemiGlobal> > TPattern;
+
+    FilterResult res;
+    CdrReferences::TSegCoreFragmentStringSet const & scfs = getSCFs(references, TOverlapDirection());
+    double const errRate = 1.0 * maxErrors / length(scfs[0]);
+    TPattern segmentPattern(getSCFIndex(references, TOverlapDirection()));
+    SCFSeedTable const & seedTable = getSCFSeedTable(references, TOverlapDirection());
+
+    // Filter only
+    std::vector<TSCFInfixPosMap> windows(length(reads));
+    std::chrono::steady_clock::time_point const start = std::chrono::steady_clock::now();
+    for (unsigned r = 0; r < length(reads); ++r)
+    {
+        TSeq & readSeq = const_cast<TSeq &>(reads[r]);
+        windows[r] = kmer ? filterSCFsBySeeds(readSeq, seedTable) : filterSCFs(readSeq, segmentPattern, errRate);
+    }
+    res.seconds = seconds(start);
+
+    // Verification
+    CdrReferences::TSCFPatterns verifyPatterns = getSCFPatterns(references, TOverlapDirection());
+    res.matches.resize(length(reads));
+    for (unsigned r = 0; r < length(reads); ++r)
+    {
+        for (TSCFInfixPosMap::value_type const & window : windows[r])
+        {
+            TSCFInfixPosMap single;
+            single.insert(window);
+            String<CandidateCoreSegmentMatch> ccsms = verifySCFHits(reads[r], verifyPatterns, single, maxErrors);
+            ++res.nWindows;
+            res.nEmptyWindows += empty(ccsms);
+            for (CandidateCoreSegmentMatch const & ccsm : ccsms)
+                res.matches[r].push_back(std::make_pair(ccsm.coreSegId, ccsm.readEndPos));
+        }
+        std::sort(res.matches[r].begin(), res.matches[r].end());
+    }
+    return res;
+}
+
+template <typename TOverlapDirection>
+void benchmark(char const * name, CdrReferences const & references, unsigned const maxErrors,
+        double const errRate, unsigned const nReads, std::mt19937 & rng, TOverlapDirection const)
+{
+    StringSet<TSeq> reads = simulateReads(references, nReads, errRate, rng, TOverlapDirection());
+    FilterResult swift = runFilter(reads, references, maxErrors, false, TOverlapDirection());
+    FilterResult kmer = runFilter(reads, references, maxErrors, true, TOverlapDirection());
+    threadBlockArena().reset();
+
+    unsigned nDiffering = 0;
+    for (unsigned r = 0; r < nReads; ++r)
+        nDiffering += swift.matches[r] != kmer.matches[r];
+
+    std::cout << std::fixed << std::setprecision(3);
+    for (int i = 0; i < 2; ++i)
+    {
+        FilterResult const & fr = i == 0 ? swift : kmer;
+        std::cout << name << '\t' << (i == 0 ? "swift" : "kmer") << '\t' << length(getSCFs(references, TOverlapDirection()))
+            << '\t' << length(getSCFs(references, TOverlapDirection())[0]) << '\t' << maxErrors
+            << '\t' << fr.seconds << '\t' << 1.0 * fr.nWindows / nReads
+            << '\t' << (fr.nWindows > 0 ? 100.0 * fr.nEmptyWindows / fr.nWindows : 0.0)
+            << '\t' << nDiffering << '\n';
+    }
+}
+
+int main(int argc, char const ** argv)
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: " << argv[0] << " <reference.fa> [<reads> [<V SCF length>]]" << std::endl;
+        return 1;
+    }
+
+    CdrOptions options;
+    options.refFasta = argv[1];
+    unsigned const nReads = argc > 2 ? std::atoi(argv[2]) : 100000;
+    options.vSCFLength = argc > 3 ? std::atoi(argv[3]) : 20;
+    options.jSCFLength = 12;
+    options.vSCFOffset = 0;
+    options.jSCFOffset = -6;
+    options.maxErrRateV = 0.05;
+    options.maxErrRateJ = 0.15;
+    options.maxVCoreErrors = std::ceil(options.maxErrRateV * options.vSCFLength);
+    options.maxJCoreErrors = std::ceil(options.maxErrRateJ * options.jSCFLength);
+    // Both filters are compared, the seed tables are required as well
+    options.scfKmerFilter = true;
+
+    CdrReferences references;
+    readAndPreprocessReferences(references, options, 150);
+    buildSCFIndices(references, options);
+
+    std::mt19937 rng(42);
+    std::cout << "direction\tfilter\tnSCFs\tscfLength\tmaxErrors\tfilterSeconds\twindowsPerRead\tfalsePositivePercent\treadsDiffering\n";
+    benchmark("V", references, options.maxVCoreErrors, options.maxErrRateV, nReads, rng, LeftOverlap());
+    benchmark("J", references, options.maxJCoreErrors, options.maxErrRateJ, nReads, rng, RightOverlap());
+    return 0;
+}
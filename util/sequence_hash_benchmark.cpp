@@ -0,0 +1,196 @@
+// ============================================================================
+// IMSEQ - An immunogenetic sequence analysis tool
+// (C) Charite, Universitaetsmedizin Berlin
+// Author: Leon Kuchenbecker
+// ============================================================================
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License version 2 as published by
+// the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+// ============================================================================
+
+// ============================================================================
+// Quality and throughput benchmark for the read sequence hash used to
+// deduplicate reads (hashPacked() in src/packed_sequence.h). It compares the
+// hash to the base-by-base polynomial hash previously used for String<Dna5>.
+//
+// For every hash function, the distinct read sequences of the input are
+// inserted into a linear probing table with the layout and maximum load of the
+// FastqMultiRecordCollection lookup table. The benchmark reports the number of
+// full 64 bit collisions, the share of distinct sequences that do not land in
+// their home slot, the mean and maximum probe lengths, and the time to look up
+// every read of the input.
+//
+// Built as the target sequence_hash_benchmark if IMSEQ is configured with
+// -DIMSEQ_BUILD_BENCHMARKS=ON.
+//
+// Usage:
+//   sequence_hash_benchmark <reads.fastq[.gz]> [<max reads>]
+// ============================================================================
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+#include <seqan/seq_io.h>
+
+#include "packed_sequence.h"
+
+using namespace seqan;
+
+/**
+ * The base-by-base hash previously specialized as std::hash<String<Dna5> >
+ */
+struct LegacyHash {
+    static char const * name() { return "legacy"; }
+    uint64_t operator()(String<Dna5> const & seq, PackedDna5String const &) const
+    {
+        size_t res = 12345678910;
+        for (Iterator<String<Dna5> const, Rooted>::Type it = begin(seq); !atEnd(it); goNext(it))
+            res = res * 101 + static_cast<int>(*it) * 60;
+        return res;
+    }
+};
+
+struct PackedHash {
+    static char const * name() { return "hashPacked"; }
+    uint64_t operator()(String<Dna5> const &, PackedDna5String const & packed) const
+    {
+        return hashPacked(packed);
+    }
+};
+
+struct Slot {
+    uint32_t seqId;
+    uint32_t fingerprint;
+};
+
+static uint32_t const EMPTY = std::numeric_limits<uint32_t>::max();
+
+/**
+ * Table size used by the FastqMultiRecordCollection, load factor at most 3/4
+ */
+static size_t requiredSlots(size_t const n)
+{
+    size_t nSlots = 16;
+    while (nSlots / 4 * 3 < n)
+        nSlots *= 2;
+    return nSlots;
+}
+
+template <typename THash>
+void benchmark(THash const & hash,
+        std::vector<String<Dna5> > const & seqs,
+        std::vector<PackedDna5String> const & packed,
+        std::vector<size_t> const & distinct)
+{
+    // Collisions of the full hash values
+    std::vector<uint64_t> hashes;
+    hashes.reserve(distinct.size());
+    for (size_t i : distinct)
+        hashes.push_back(hash(seqs[i], packed[i]));
+    std::sort(hashes.begin(), hashes.end());
+    size_t fullCollisions = 0;
+    for (size_t i = 1; i < hashes.size(); ++i)
+        fullCollisions += hashes[i] == hashes[i - 1];
+
+    // Build the table from the distinct sequences
+    std::vector<Slot> slots(requiredSlots(distinct.size()), Slot{EMPTY, 0});
+    size_t const mask = slots.size() - 1;
+    uint64_t displaced = 0, probeSum = 0, probeMax = 0;
+    for (size_t i : distinct) {
+        uint64_t const h = hash(seqs[i], packed[i]);
+        uint64_t probes = 1;
+        size_t slotIdx = h & mask;
+        for (; slots[slotIdx].seqId != EMPTY; slotIdx = (slotIdx + 1) & mask)
+            ++probes;
+        slots[slotIdx] = Slot{static_cast<uint32_t>(i), static_cast<uint32_t>(h >> 32)};
+        displaced += probes > 1;
+        probeSum += probes;
+        probeMax = std::max(probeMax, probes);
+    }
+
+    // Look up every read
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    uint64_t found = 0;
+    for (size_t i = 0; i < seqs.size(); ++i) {
+        uint64_t const h = hash(seqs[i], packed[i]);
+        for (size_t slotIdx = h & mask; slots[slotIdx].seqId != EMPTY; slotIdx = (slotIdx + 1) & mask) {
+            if (slots[slotIdx].fingerprint == static_cast<uint32_t>(h >> 32) && packed[slots[slotIdx].seqId] == packed[i]) {
+                ++found;
+                break;
+            }
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (found != seqs.size())
+        std::cerr << "[WARNING] " << (seqs.size() - found) << " reads were not found by " << THash::name() << std::endl;
+
+    std::cout << THash::name()
+        << "\tcollisions=" << fullCollisions
+        << "\tdisplaced=" << (100.0 * displaced / distinct.size()) << '%'
+        << "\tmeanProbes=" << (static_cast<double>(probeSum) / distinct.size())
+        << "\tmaxProbes=" << probeMax
+        << "\tlookups=" << (seqs.size() / seconds / 1e6) << " M/s" << std::endl;
+}
+
+int main(int argc, char const ** argv)
+{
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <reads.fastq[.gz]> [<max reads>]" << std::endl;
+        return 1;
+    }
+    size_t maxReads = argc > 2 ? std::strtoull(argv[2], NULL, 10) : std::numeric_limits<size_t>::max();
+
+    SeqFileIn seqFileIn;
+    if (!open(seqFileIn, argv[1])) {
+        std::cerr << "[ERROR] Cannot open " << argv[1] << std::endl;
+        return 1;
+    }
+    std::vector<String<Dna5> > seqs;
+    CharString id;
+    String<Dna5> seq;
+    while (!atEnd(seqFileIn) && seqs.size() < maxReads) {
+        readRecord(id, seq, seqFileIn);
+        seqs.push_back(seq);
+    }
+
+    PackedSequenceStore store;
+    std::vector<PackedDna5String> packed(seqs.size());
+    for (size_t i = 0; i < seqs.size(); ++i)
+        assignPacked(packed[i], seqs[i], store);
+
+    // Determine the distinct sequences
+    std::vector<size_t> order(seqs.size());
+    for (size_t i = 0; i < order.size(); ++i)
+        order[i] = i;
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return seqs[a] < seqs[b]; });
+    std::vector<size_t> distinct;
+    for (size_t i = 0; i < order.size(); ++i)
+        if (i == 0 || seqs[order[i]] != seqs[order[i - 1]])
+            distinct.push_back(order[i]);
+    if (distinct.empty()) {
+        std::cerr << "[ERROR] No reads in " << argv[1] << std::endl;
+        return 1;
+    }
+    std::sort(distinct.begin(), distinct.end());
+
+    std::cout << "reads=" << seqs.size() << "\tdistinct=" << distinct.size()
+        << "\tslots=" << requiredSlots(distinct.size()) << std::endl;
+    benchmark(LegacyHash(), seqs, packed, distinct);
+    benchmark(PackedHash(), seqs, packed, distinct);
+    return 0;
+}
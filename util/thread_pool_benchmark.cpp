@@ -0,0 +1,176 @@
+// ============================================================================
+// IMSEQ - An immunogenetic sequence analysis tool
+// (C) Charite, Universitaetsmedizin Berlin
+// Author: Leon Kuchenbecker
+// ============================================================================
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License version 2 as published by
+// the Free Software Foundation.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+// ============================================================================
+
+// ============================================================================
+// Scheduling benchmark for the work-stealing ThreadPool (src/thread_pool.h).
+// It compares parallelFor() to the previous single-queue pool, which was fed
+// one enqueue() per item, on synthetic workloads shaped like the two stages
+// using the pool:
+//
+//   barcode  Many cheap items of similar cost, like the per-read candidate
+//            search in barcodeCorrection().
+//   cluster  Items of linearly decreasing cost, like the comparison of every
+//            clonotype to all larger ones in runClonotypeClustering().
+//
+// Built as the target thread_pool_benchmark if IMSEQ is configured with
+// -DIMSEQ_BUILD_BENCHMARKS=ON.
+//
+// Usage:
+//   thread_pool_benchmark [<threads> ...]
+// ============================================================================
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <queue>
+#include <vector>
+
+#include "thread_pool.h"
+
+/**
+ * The previous ThreadPool: one task queue behind one mutex, one packaged_task
+ * per enqueue() and completion by joining the threads on destruction.
+ */
+class LegacyThreadPool {
+public:
+    LegacyThreadPool(size_t threads) : stop(false)
+    {
+        for (size_t i = 0; i < threads; ++i)
+            workers.push_back(std::thread([this]() {
+                while (true)
+                {
+                    std::unique_lock<std::mutex> lock(queue_mutex);
+                    while (!stop && tasks.empty())
+                        condition.wait(lock);
+                    if (stop && tasks.empty())
+                        return;
+                    std::function<void()> task(tasks.front());
+                    tasks.pop();
+                    lock.unlock();
+                    task();
+                }
+            }));
+    }
+
+    template<class T, class F>
+    std::future<T> enqueue(F f)
+    {
+        auto task = std::make_shared< std::packaged_task<T()> >(f);
+        std::future<T> res = task->get_future();
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            tasks.push([task](){ (*task)(); });
+        }
+        condition.notify_one();
+        return res;
+    }
+
+    ~LegacyThreadPool()
+    {
+        stop = true;
+        condition.notify_all();
+        for (size_t i = 0; i < workers.size(); ++i)
+            workers[i].join();
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()> > tasks;
+    std::mutex queue_mutex;
+    std::condition_variable condition;
+    bool stop;
+};
+
+/**
+ * Burns a number of work units and records the result, such that the work
+ * cannot be optimized away
+ */
+static void work(std::vector<uint64_t> & results, size_t const item, uint64_t const units)
+{
+    uint64_t x = item + 1;
+    for (uint64_t u = 0; u < units; ++u)
+        x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+    results[item] = x;
+}
+
+struct Workload {
+    char const * name;
+    size_t       nItems;
+    size_t       grain;
+    uint64_t     (*units)(size_t item, size_t nItems);
+};
+
+static uint64_t barcodeUnits(size_t item, size_t)
+{
+    return 200 + (item * 2654435761u) % 400;
+}
+
+static uint64_t clusterUnits(size_t item, size_t nItems)
+{
+    return 4 * (nItems - item);
+}
+
+static double seconds(std::chrono::steady_clock::time_point const & start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char const ** argv)
+{
+    std::vector<unsigned> threadCounts;
+    for (int i = 1; i < argc; ++i)
+        threadCounts.push_back(std::atoi(argv[i]));
+    if (threadCounts.empty())
+        threadCounts = { 1, 2, 4, 8 };
+
+    Workload const workloads[] = {
+        { "barcode", 2000000, 64, &barcodeUnits },
+        { "cluster", 20000, 16, &clusterUnits }
+    };
+
+    std::cout << "workload\tthreads\tlegacy [s]\tparallelFor [s]\tspeedup" << std::endl;
+    for (Workload const & workload : workloads)
+    {
+        std::vector<uint64_t> results(workload.nItems);
+        for (unsigned threads : threadCounts)
+        {
+            auto start = std::chrono::steady_clock::now();
+            {
+                LegacyThreadPool pool(threads);
+                for (size_t i = 0; i < workload.nItems; ++i)
+                    pool.enqueue<void>([i, &results, &workload]() { work(results, i, workload.units(i, workload.nItems)); });
+            }
+            double const legacy = seconds(start);
+
+            start = std::chrono::steady_clock::now();
+            {
+                ThreadPool pool(threads);
+                pool.parallelFor(0, workload.nItems, workload.grain,
+                        [&results, &workload](size_t i) { work(results, i, workload.units(i, workload.nItems)); })->wait();
+            }
+            double const stealing = seconds(start);
+
+            std::cout << workload.name << '\t' << threads << '\t' << legacy << '\t' << stealing
+                << '\t' << legacy / stealing << std::endl;
+        }
+    }
+    return 0;
+}